@@ -98,6 +98,25 @@ typedef struct {
 
 
 
+//===============================================================
+
+// G_TRACE_BATCH, check the cvar before using it
+#define	GAME_TRACE_BATCH_CVAR	"sv_traceBatch"
+#define	MAX_TRACE_BATCH			256
+
+// G_ENTITIES_IN_PVS, check the cvar before using it
+#define	GAME_ENTITIES_IN_PVS_CVAR	"sv_entitiesInPVS"
+
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	qboolean	capsule;
+} traceRequest_t;
+
 //===============================================================
 
 //
@@ -229,6 +248,15 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACE_BATCH,	// ( const traceRequest_t *requests, trace_t *results, int count );
+	// up to MAX_TRACE_BATCH traces in one call, only available when the
+	// server has set GAME_TRACE_BATCH_CVAR, older engines drop the game
+
+	G_ENTITIES_IN_PVS,	// ( int entityNum1, int entityNum2, qboolean portals );
+	// trap_InPVS on the r.currentOrigin of two entities, taken from the
+	// last trap_LinkEntity of each, only available when the server has
+	// set GAME_ENTITIES_IN_PVS_CVAR
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -154,6 +154,10 @@ void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins,
 	syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
+void trap_TraceBatch( const traceRequest_t *requests, trace_t *results, int count ) {
+	syscall( G_TRACE_BATCH, requests, results, count );
+}
+
 int trap_PointContents( const vec3_t point, int passEntityNum ) {
 	return syscall( G_POINT_CONTENTS, point, passEntityNum );
 }
@@ -167,6 +171,10 @@ qboolean trap_InPVSIgnorePortals( const vec3_t p1, const vec3_t p2 ) {
 	return syscall( G_IN_PVS_IGNORE_PORTALS, p1, p2 );
 }
 
+qboolean trap_EntitiesInPVS( int entityNum1, int entityNum2, qboolean portals ) {
+	return syscall( G_ENTITIES_IN_PVS, entityNum1, entityNum2, portals );
+}
+
 void trap_AdjustAreaPortalState( gentity_t *ent, qboolean open ) {
 	syscall( G_ADJUST_AREA_PORTAL_STATE, ent, open );
 }
@@ -629,6 +629,63 @@ void G_SetOrigin( gentity_t *ent, vec3_t origin ) {
 	VectorCopy( origin, ent->r.currentOrigin );
 }
 
+/*
+================
+G_TraceBatch
+
+Runs count traces with a single G_TRACE_BATCH trap when the engine has
+it, one trap_Trace at a time otherwise
+================
+*/
+void G_TraceBatch( const traceRequest_t *requests, trace_t *results, int count ) {
+	static int	batch = -1;
+	int			i, n;
+
+	if ( batch < 0 ) {
+		batch = trap_Cvar_VariableIntegerValue( GAME_TRACE_BATCH_CVAR ) ? 1 : 0;
+	}
+
+	if ( batch ) {
+		for ( i = 0 ; i < count ; i += n ) {
+			n = count - i > MAX_TRACE_BATCH ? MAX_TRACE_BATCH : count - i;
+			trap_TraceBatch( requests + i, results + i, n );
+		}
+		return;
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( requests[i].capsule ) {
+			trap_TraceCapsule( &results[i], requests[i].start, requests[i].mins, requests[i].maxs,
+				requests[i].end, requests[i].passEntityNum, requests[i].contentmask );
+		} else {
+			trap_Trace( &results[i], requests[i].start, requests[i].mins, requests[i].maxs,
+				requests[i].end, requests[i].passEntityNum, requests[i].contentmask );
+		}
+	}
+}
+
+/*
+================
+G_EntitiesInPVS
+
+trap_InPVS between the origins of two entities.  Linked entities are
+taken where they were last linked, so the engine can use the leafs it
+found then instead of walking the tree again.
+================
+*/
+qboolean G_EntitiesInPVS( gentity_t *ent1, gentity_t *ent2 ) {
+	static int	entities = -1;
+
+	if ( entities < 0 ) {
+		entities = trap_Cvar_VariableIntegerValue( GAME_ENTITIES_IN_PVS_CVAR ) ? 1 : 0;
+	}
+
+	if ( entities ) {
+		return trap_EntitiesInPVS( ent1->s.number, ent2->s.number, qtrue );
+	}
+	return trap_InPVS( ent1->r.currentOrigin, ent2->r.currentOrigin );
+}
+
 /*
 ================
 DebugLine
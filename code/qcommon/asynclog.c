@@ -0,0 +1,597 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// asynclog.c -- log files written from a background thread
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/*
+=============================================================================
+
+A log file handed to AsyncLog_Open belongs to the writer thread from then
+on.  Producers copy their text into a bounded ring of fixed size slots
+(a sequence number per slot, claimed with compare-and-swap, so any thread
+may print) and never touch the disk.  The writer gathers slots into one
+buffer per channel and writes them out when a buffer fills, every
+com_logFlushMsec, or on request.  When the ring is full the text is
+dropped and counted instead of stalling the frame.
+
+=============================================================================
+*/
+
+#define	ASYNCLOG_SLOTS			4096		// must be a power of two
+#define	ASYNCLOG_SLOT_DATA		244
+#define	ASYNCLOG_CHANNELS		16
+#define	ASYNCLOG_BATCH			65536
+
+#define	ASYNCLOG_FLUSH			-1			// slot commands in place of a length
+#define	ASYNCLOG_CLOSE			-2
+
+#ifdef _MSC_VER
+#define	ASYNCLOG_CAS( p, old, new )	( InterlockedCompareExchange( (volatile LONG *)(p), (new), (old) ) == (LONG)(old) )
+#define	ASYNCLOG_ADD( p, n )		InterlockedExchangeAdd( (volatile LONG *)(p), (n) )
+#define	ASYNCLOG_BARRIER()			MemoryBarrier()
+#else
+#define	ASYNCLOG_CAS( p, old, new )	__sync_bool_compare_and_swap( (p), (old), (new) )
+#define	ASYNCLOG_ADD( p, n )		__sync_fetch_and_add( (p), (n) )
+#define	ASYNCLOG_BARRIER()			__sync_synchronize()
+#endif
+
+typedef struct {
+	volatile unsigned int	sequence;
+	short					channel;
+	short					length;		// bytes of data, or ASYNCLOG_FLUSH / ASYNCLOG_CLOSE
+	char					data[ASYNCLOG_SLOT_DATA];
+} asyncLogSlot_t;
+
+typedef enum {
+	ALC_FREE,
+	ALC_OPEN,
+	ALC_CLOSING		// close queued, the writer frees the channel
+} asyncLogState_t;
+
+typedef struct {
+	volatile asyncLogState_t	state;
+	char			ospath[MAX_OSPATH];
+	qboolean		sync;				// flush after every pass that wrote
+	volatile int	size;				// bytes in the current file
+
+	// writer thread only
+	FILE			*file;
+	char			*batch;
+	int				batchLength;
+	qboolean		flushPending;
+
+	// statistics
+	volatile int	queuedBytes;
+	volatile int	writtenBytes;
+	volatile int	droppedBytes;
+	volatile int	droppedWrites;
+	volatile int	rotations;
+	volatile int	errors;
+} asyncLogChannel_t;
+
+static asyncLogSlot_t		asyncLogRing[ASYNCLOG_SLOTS];
+static volatile unsigned int	asyncLogEnqueue;
+static unsigned int			asyncLogDequeue;		// writer thread only
+
+static asyncLogChannel_t	asyncLogChannels[ASYNCLOG_CHANNELS];
+
+static void					*asyncLogThread;
+static volatile qboolean	asyncLogQuit;
+static volatile int			asyncLogDrainRequest;
+static volatile int			asyncLogDrainDone;
+static volatile int			asyncLogFlushMsec = 250;
+static volatile int			asyncLogMaxSize;		// bytes, 0 = never rotate
+
+cvar_t	*com_logAsync;
+cvar_t	*com_logFlushMsec;
+cvar_t	*com_logMaxSize;
+
+
+/*
+=============================================================================
+
+WRITER THREAD
+
+=============================================================================
+*/
+
+/*
+==================
+AsyncLog_Rotate
+
+Moves the full log aside to <name>.1 and starts a new one
+==================
+*/
+static void AsyncLog_Rotate( asyncLogChannel_t *ch ) {
+	char	rotated[MAX_OSPATH];
+
+	fclose( ch->file );
+
+	Com_sprintf( rotated, sizeof( rotated ), "%s.1", ch->ospath );
+	remove( rotated );
+	rename( ch->ospath, rotated );
+
+	ch->file = fopen( ch->ospath, "wb" );
+	ch->size = 0;
+	ch->rotations++;
+	if ( !ch->file ) {
+		ch->errors++;
+	}
+}
+
+/*
+==================
+AsyncLog_WriteBatch
+==================
+*/
+static void AsyncLog_WriteBatch( asyncLogChannel_t *ch ) {
+	int		written;
+
+	if ( !ch->batchLength ) {
+		return;
+	}
+
+	if ( ch->file && asyncLogMaxSize > 0 && ch->size > 0
+		&& ch->size + ch->batchLength > asyncLogMaxSize ) {
+		AsyncLog_Rotate( ch );
+	}
+
+	if ( ch->file ) {
+		written = fwrite( ch->batch, 1, ch->batchLength, ch->file );
+		if ( written != ch->batchLength ) {
+			ch->errors++;
+		}
+		ch->size += written;
+		ch->writtenBytes += written;
+	} else {
+		ch->droppedBytes += ch->batchLength;
+	}
+	ch->batchLength = 0;
+	ch->flushPending = qtrue;
+}
+
+/*
+==================
+AsyncLog_FlushChannel
+==================
+*/
+static void AsyncLog_FlushChannel( asyncLogChannel_t *ch ) {
+	AsyncLog_WriteBatch( ch );
+	if ( ch->flushPending && ch->file ) {
+		fflush( ch->file );
+	}
+	ch->flushPending = qfalse;
+}
+
+/*
+==================
+AsyncLog_CloseChannel
+==================
+*/
+static void AsyncLog_CloseChannel( asyncLogChannel_t *ch ) {
+	AsyncLog_WriteBatch( ch );
+	if ( ch->file ) {
+		fclose( ch->file );
+		ch->file = NULL;
+	}
+	free( ch->batch );
+	ch->batch = NULL;
+	ch->flushPending = qfalse;
+
+	ASYNCLOG_BARRIER();
+	ch->state = ALC_FREE;
+}
+
+/*
+==================
+AsyncLog_Consume
+
+Takes everything currently in the ring, returns the number of slots
+==================
+*/
+static int AsyncLog_Consume( void ) {
+	asyncLogSlot_t		*slot;
+	asyncLogChannel_t	*ch;
+	int					count;
+
+	for ( count = 0 ; ; count++ ) {
+		slot = &asyncLogRing[asyncLogDequeue & ( ASYNCLOG_SLOTS - 1 )];
+		if ( slot->sequence != asyncLogDequeue + 1 ) {
+			break;		// empty, or the producer hasn't finished the slot
+		}
+		ASYNCLOG_BARRIER();
+
+		ch = &asyncLogChannels[slot->channel];
+		if ( ch->state == ALC_FREE || !ch->batch ) {
+			// left over from before a shutdown, the file is gone
+		} else if ( slot->length == ASYNCLOG_FLUSH ) {
+			AsyncLog_FlushChannel( ch );
+		} else if ( slot->length == ASYNCLOG_CLOSE ) {
+			AsyncLog_CloseChannel( ch );
+		} else {
+			if ( ch->batchLength + slot->length > ASYNCLOG_BATCH ) {
+				AsyncLog_WriteBatch( ch );
+			}
+			Com_Memcpy( ch->batch + ch->batchLength, slot->data, slot->length );
+			ch->batchLength += slot->length;
+		}
+
+		ASYNCLOG_BARRIER();
+		slot->sequence = asyncLogDequeue + ASYNCLOG_SLOTS;
+		asyncLogDequeue++;
+	}
+
+	return count;
+}
+
+/*
+==================
+AsyncLog_FlushAll
+==================
+*/
+static void AsyncLog_FlushAll( qboolean syncOnly ) {
+	asyncLogChannel_t	*ch;
+	int					i;
+
+	for ( i = 0, ch = asyncLogChannels ; i < ASYNCLOG_CHANNELS ; i++, ch++ ) {
+		if ( ch->state == ALC_FREE || !ch->batch ) {
+			continue;
+		}
+		if ( syncOnly && !ch->sync ) {
+			continue;
+		}
+		AsyncLog_FlushChannel( ch );
+	}
+}
+
+/*
+==================
+AsyncLog_ThreadMain
+==================
+*/
+static void AsyncLog_ThreadMain( void *arg ) {
+	int		lastFlush, now, drain, count;
+
+	lastFlush = Sys_Milliseconds();
+
+	while ( 1 ) {
+		drain = asyncLogDrainRequest;
+		ASYNCLOG_BARRIER();
+
+		count = AsyncLog_Consume();
+		if ( count ) {
+			AsyncLog_FlushAll( qtrue );
+		}
+
+		// a drain is complete once the ring has been seen empty after it was asked for
+		now = Sys_Milliseconds();
+		if ( now - lastFlush >= asyncLogFlushMsec || ( !count && drain != asyncLogDrainDone ) ) {
+			AsyncLog_FlushAll( qfalse );
+			lastFlush = now;
+		}
+		if ( !count && drain != asyncLogDrainDone ) {
+			ASYNCLOG_BARRIER();
+			asyncLogDrainDone = drain;
+		}
+
+		if ( asyncLogQuit ) {
+			// anything queued before the quit was set
+			while ( AsyncLog_Consume() ) {
+			}
+			AsyncLog_FlushAll( qfalse );
+			break;
+		}
+
+		if ( !count ) {
+			Sys_ThreadSleep( 5 );
+		}
+	}
+}
+
+
+/*
+=============================================================================
+
+PRODUCERS
+
+=============================================================================
+*/
+
+/*
+==================
+AsyncLog_Enqueue
+
+Returns qfalse if the ring is full
+==================
+*/
+static qboolean AsyncLog_Enqueue( int channel, const char *data, int length ) {
+	asyncLogSlot_t	*slot;
+	unsigned int	pos;
+	int				diff;
+
+	pos = asyncLogEnqueue;
+	while ( 1 ) {
+		slot = &asyncLogRing[pos & ( ASYNCLOG_SLOTS - 1 )];
+		diff = (int)( slot->sequence - pos );
+		if ( diff == 0 ) {
+			if ( ASYNCLOG_CAS( &asyncLogEnqueue, pos, pos + 1 ) ) {
+				break;
+			}
+		} else if ( diff < 0 ) {
+			return qfalse;
+		}
+		pos = asyncLogEnqueue;
+	}
+
+	slot->channel = channel;
+	slot->length = length;
+	if ( length > 0 ) {
+		Com_Memcpy( slot->data, data, length );
+	}
+
+	ASYNCLOG_BARRIER();
+	slot->sequence = pos + 1;
+	return qtrue;
+}
+
+/*
+==================
+AsyncLog_Command
+
+Flush and close have to get through, so wait for room
+==================
+*/
+static void AsyncLog_Command( int channel, int command ) {
+	while ( !AsyncLog_Enqueue( channel, NULL, command ) ) {
+		Sys_ThreadSleep( 1 );
+	}
+}
+
+/*
+==================
+AsyncLog_Write
+==================
+*/
+void AsyncLog_Write( int channel, const void *data, int length ) {
+	asyncLogChannel_t	*ch;
+	const char			*s;
+	int					block;
+
+	ch = &asyncLogChannels[channel];
+	asyncLogFlushMsec = com_logFlushMsec->integer > 0 ? com_logFlushMsec->integer : 1;
+	asyncLogMaxSize = com_logMaxSize->integer * 1024;
+
+	s = (const char *)data;
+	while ( length > 0 ) {
+		block = length > ASYNCLOG_SLOT_DATA ? ASYNCLOG_SLOT_DATA : length;
+		if ( !AsyncLog_Enqueue( channel, s, block ) ) {
+			ASYNCLOG_ADD( &ch->droppedWrites, 1 );
+			ASYNCLOG_ADD( &ch->droppedBytes, length );
+			return;
+		}
+		ASYNCLOG_ADD( &ch->queuedBytes, block );
+		s += block;
+		length -= block;
+	}
+}
+
+/*
+==================
+AsyncLog_Flush
+==================
+*/
+void AsyncLog_Flush( int channel ) {
+	AsyncLog_Command( channel, ASYNCLOG_FLUSH );
+}
+
+/*
+==================
+AsyncLog_SetSync
+
+Flush the channel after every write the thread makes
+==================
+*/
+void AsyncLog_SetSync( int channel, qboolean sync ) {
+	asyncLogChannels[channel].sync = sync;
+}
+
+/*
+==================
+AsyncLog_Open
+
+Takes ownership of file, returns the channel or 0 if the caller
+should keep writing it directly.
+==================
+*/
+int AsyncLog_Open( FILE *file, const char *ospath, qboolean sync ) {
+	asyncLogChannel_t	*ch;
+	int					i;
+
+	if ( !com_logAsync || !com_logAsync->integer ) {
+		return 0;
+	}
+
+	if ( !asyncLogThread ) {
+		asyncLogQuit = qfalse;
+		asyncLogThread = Sys_CreateThread( AsyncLog_ThreadMain, NULL );
+		if ( !asyncLogThread ) {
+			Com_Printf( "AsyncLog_Open: couldn't start the log thread, logging synchronously\n" );
+			Cvar_Set( "com_logAsync", "0" );
+			return 0;
+		}
+	}
+
+	// channel 0 means "not async"
+	for ( i = 1, ch = asyncLogChannels + 1 ; i < ASYNCLOG_CHANNELS ; i++, ch++ ) {
+		if ( ch->state == ALC_FREE ) {
+			break;
+		}
+	}
+	if ( i == ASYNCLOG_CHANNELS ) {
+		return 0;
+	}
+
+	ASYNCLOG_BARRIER();
+	Com_Memset( ch, 0, sizeof( *ch ) );
+	ch->batch = malloc( ASYNCLOG_BATCH );
+	if ( !ch->batch ) {
+		return 0;
+	}
+	ch->file = file;
+	ch->sync = sync;
+	Q_strncpyz( ch->ospath, ospath, sizeof( ch->ospath ) );
+
+	fseek( file, 0, SEEK_END );
+	ch->size = ftell( file );
+
+	ASYNCLOG_BARRIER();
+	ch->state = ALC_OPEN;
+	return i;
+}
+
+/*
+==================
+AsyncLog_Close
+
+Everything queued before the close is still written
+==================
+*/
+void AsyncLog_Close( int channel ) {
+	asyncLogChannels[channel].state = ALC_CLOSING;
+	AsyncLog_Command( channel, ASYNCLOG_CLOSE );
+}
+
+/*
+==================
+AsyncLog_Drain
+
+Blocks until everything queued so far is on disk
+==================
+*/
+void AsyncLog_Drain( void ) {
+	int		request;
+
+	if ( !asyncLogThread ) {
+		return;
+	}
+
+	request = ++asyncLogDrainRequest;
+	while ( asyncLogDrainDone != request ) {
+		Sys_ThreadSleep( 1 );
+	}
+}
+
+/*
+==================
+AsyncLog_AfterFork
+
+The forked process doesn't have the writer thread.  The parent drained
+before forking, so only the thread needs to be started again.
+==================
+*/
+void AsyncLog_AfterFork( void ) {
+	if ( !asyncLogThread ) {
+		return;
+	}
+	asyncLogThread = Sys_CreateThread( AsyncLog_ThreadMain, NULL );
+	if ( !asyncLogThread ) {
+		Sys_Error( "AsyncLog_AfterFork: couldn't restart the log thread" );
+	}
+}
+
+/*
+==================
+AsyncLog_Stats_f
+==================
+*/
+static void AsyncLog_Stats_f( void ) {
+	asyncLogChannel_t	*ch;
+	int					i, used;
+
+	if ( !asyncLogThread ) {
+		Com_Printf( "Asynchronous logging is not running.\n" );
+		return;
+	}
+
+	used = (int)( asyncLogEnqueue - asyncLogDequeue );
+	Com_Printf( "ring: %i of %i slots in use\n", used, ASYNCLOG_SLOTS );
+	Com_Printf( "    queued  written  dropped  drops rotations errors file\n" );
+	for ( i = 1, ch = asyncLogChannels + 1 ; i < ASYNCLOG_CHANNELS ; i++, ch++ ) {
+		if ( ch->state != ALC_OPEN ) {
+			continue;
+		}
+		Com_Printf( "%10i %8i %8i %6i %9i %6i %s\n", ch->queuedBytes, ch->writtenBytes,
+			ch->droppedBytes, ch->droppedWrites, ch->rotations, ch->errors, ch->ospath );
+	}
+}
+
+/*
+==================
+AsyncLog_Init
+==================
+*/
+void AsyncLog_Init( void ) {
+	int		i;
+
+	com_logAsync = Cvar_Get( "com_logAsync", "0", CVAR_ARCHIVE );
+	com_logFlushMsec = Cvar_Get( "com_logFlushMsec", "250", CVAR_ARCHIVE );
+	com_logMaxSize = Cvar_Get( "com_logMaxSize", "0", CVAR_ARCHIVE );
+
+	for ( i = 0 ; i < ASYNCLOG_SLOTS ; i++ ) {
+		asyncLogRing[i].sequence = i;
+	}
+
+	Cmd_AddCommand( "logstats", AsyncLog_Stats_f );
+}
+
+/*
+==================
+AsyncLog_Shutdown
+
+Writes out whatever is left and stops the thread.  Channels still open
+are closed here, their handles are never written again.
+==================
+*/
+void AsyncLog_Shutdown( void ) {
+	int		i;
+
+	if ( !asyncLogThread ) {
+		return;
+	}
+
+	for ( i = 1 ; i < ASYNCLOG_CHANNELS ; i++ ) {
+		if ( asyncLogChannels[i].state == ALC_OPEN ) {
+			AsyncLog_Close( i );
+		}
+	}
+
+	ASYNCLOG_BARRIER();
+	asyncLogQuit = qtrue;
+	Sys_JoinThread( asyncLogThread );
+	asyncLogThread = NULL;
+}
@@ -22,6 +22,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
+#ifndef _WIN32
+#include <unistd.h>	// getpid
+#else
+#include <process.h>
+#endif
 
 #ifdef BSPC
 
@@ -41,19 +47,14 @@ void SetPlaneSignbits (cplane_t *out) {
 }
 #endif //BSPC
 
-// to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
-#define	BOX_LEAFS		2
-#define	BOX_PLANES		12
-
 #define	LL(x) x=LittleLong(x)
 
 
 clipMap_t	cm;
-int			c_pointcontents;
-int			c_traces, c_brush_traces, c_patch_traces;
+int			cm_mapCount = 1;	// bumped whenever cm changes
+THREAD_LOCAL int	c_pointcontents;
+THREAD_LOCAL int	c_traces, c_brush_traces, c_patch_traces;
+THREAD_LOCAL int	c_patch_facets;
 
 
 byte		*cmod_base;
@@ -62,15 +63,13 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_debugSurfaceUpdate;
+cvar_t		*cm_cache;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+static THREAD_LOCAL cmThread_t	cm_thread;
 
 
-
-void	CM_InitBoxHull (void);
 void	CM_FloodAreaConnections (void);
 
 
@@ -224,6 +223,35 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+/*
+=================
+CM_SetBrushSides4
+
+Fills in ( brush->numsides + 3 ) / 4 groups
+=================
+*/
+void CM_SetBrushSides4( cbrush_t *brush, cbrushsides4_t *groups ) {
+	int			i, j;
+	cplane_t	*plane;
+
+	brush->sides4 = groups;
+	for ( i = 0 ; i < ( ( brush->numsides + 3 ) & ~3 ) ; i++ ) {
+		if ( i < brush->numsides ) {
+			plane = brush->sides[i].plane;
+			for ( j = 0 ; j < 3 ; j++ ) {
+				groups[i >> 2].normal[j][i & 3] = plane->normal[j];
+			}
+			groups[i >> 2].dist[i & 3] = plane->dist;
+		} else {
+			// every point is 1 behind it
+			for ( j = 0 ; j < 3 ; j++ ) {
+				groups[i >> 2].normal[j][i & 3] = 0;
+			}
+			groups[i >> 2].dist[i & 3] = 1;
+		}
+	}
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -234,6 +262,10 @@ void CMod_LoadBrushes( lump_t *l ) {
 	dbrush_t	*in;
 	cbrush_t	*out;
 	int			i, count;
+#if idsse2
+	cbrushsides4_t	*sides4;
+	int			groups;
+#endif
 
 	in = (void *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in)) {
@@ -241,7 +273,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = Hunk_Alloc( count * sizeof( *cm.brushes ), h_high );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -259,6 +291,18 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#if idsse2
+	// the same sides again four at a time
+	groups = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		groups += ( cm.brushes[i].numsides + 3 ) >> 2;
+	}
+	sides4 = Hunk_Alloc( groups * sizeof( *sides4 ), h_high );
+	for ( i = 0 ; i < count ; i++ ) {
+		CM_SetBrushSides4( &cm.brushes[i], sides4 );
+		sides4 += ( cm.brushes[i].numsides + 3 ) >> 2;
+	}
+#endif
 }
 
 /*
@@ -281,7 +325,7 @@ void CMod_LoadLeafs (lump_t *l)
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no leafs");
 
-	cm.leafs = Hunk_Alloc( ( BOX_LEAFS + count ) * sizeof( *cm.leafs ), h_high );
+	cm.leafs = Hunk_Alloc( count * sizeof( *cm.leafs ), h_high );
 	cm.numLeafs = count;
 
 	out = cm.leafs;	
@@ -302,6 +346,11 @@ void CMod_LoadLeafs (lump_t *l)
 
 	cm.areas = Hunk_Alloc( cm.numAreas * sizeof( *cm.areas ), h_high );
 	cm.areaPortals = Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ), h_high );
+	cm.areaNeighbors = Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaNeighbors ), h_high );
+	cm.numAreaNeighbors = Hunk_Alloc( cm.numAreas * sizeof( *cm.numAreaNeighbors ), h_high );
+	cm.areaBytes = ( cm.numAreas + 7 ) >> 3;
+	cm.areaBits = Hunk_Alloc( cm.numAreas * cm.areaBytes, h_high );
+	cm.areaBitsFlood = Hunk_Alloc( cm.numAreas * sizeof( *cm.areaBitsFlood ), h_high );
 }
 
 /*
@@ -324,7 +373,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = Hunk_Alloc( count * sizeof( *cm.planes ), h_high );
 	cm.numPlanes = count;
 
 	out = cm.planes;	
@@ -362,7 +411,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = Hunk_Alloc( count * sizeof( *cm.leafbrushes ), h_high );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -418,7 +467,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = Hunk_Alloc( count * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;	
@@ -475,13 +524,278 @@ void CMod_LoadVisibility( lump_t *l ) {
 //==================================================================
 
 
+#ifndef BSPC
+/*
+=============================================================================
+
+cm_cache
+
+Subdividing the patches and adding the facet bevels is most of the work
+of a map load, so the finished patch collides are kept in
+fs_homepath/cmcache, named after the map and its CM_Checksum.  Every
+patch is stored as its patchCollide_t followed by the planes, facets and
+nodes, and a later load reads the whole file into one hunk block and
+only sets the pointers.  Anything that changes the generated facets has
+to bump CM_CACHE_VERSION.
+
+=============================================================================
+*/
+
+#define	CM_CACHE_IDENT		( ( 'C' << 24 ) + ( 'M' << 16 ) + ( 'C' << 8 ) + 'Q' )
+#define	CM_CACHE_VERSION	1
+#define	CM_CACHE_BUILD		Q3_VERSION " " __DATE__ " " __TIME__
+#define	CM_CACHE_ALIGN(x)	( ( (x) + 15 ) & ~15 )
+
+typedef struct {
+	int			ident;
+	int			version;
+	char		build[64];			// CM_CACHE_BUILD, the structures may have changed
+	unsigned	checksum;			// CM_Checksum of the map
+	int			numPatches;
+	int			length;				// of the patches after the header
+} cmCacheHeader_t;
+
+/*
+=================
+CM_CachePath
+=================
+*/
+static char *CM_CachePath( const char *name, unsigned checksum ) {
+	char	base[MAX_QPATH];
+
+	COM_StripExtension( COM_SkipPath( (char *)name ), base, sizeof( base ) );
+	return va( "cmcache/%s-%08x.cm", base, checksum );
+}
+
+/*
+=================
+CM_CacheHeader
+=================
+*/
+static void CM_CacheHeader( cmCacheHeader_t *cache, unsigned checksum, int numPatches ) {
+	Com_Memset( cache, 0, sizeof( *cache ) );
+	cache->ident = CM_CACHE_IDENT;
+	cache->version = CM_CACHE_VERSION;
+	Q_strncpyz( cache->build, CM_CACHE_BUILD, sizeof( cache->build ) );
+	cache->checksum = checksum;
+	cache->numPatches = numPatches;
+}
+
+/*
+=================
+CM_CachedPatchSize
+=================
+*/
+static int CM_CachedPatchSize( const patchCollide_t *pc ) {
+	return CM_CACHE_ALIGN( sizeof( *pc ) )
+		+ CM_CACHE_ALIGN( pc->numPlanes * sizeof( *pc->planes ) )
+		+ CM_CACHE_ALIGN( pc->numFacets * sizeof( *pc->facets ) )
+		+ CM_CACHE_ALIGN( pc->numNodes * sizeof( *pc->nodes ) );
+}
+
+/*
+=================
+CM_LinkCachedPatch
+
+Points the arrays of a patch at the data that follows it in the cache block
+=================
+*/
+static void CM_LinkCachedPatch( patchCollide_t *pc ) {
+	pc->planes = (patchPlane_t *)( (byte *)pc + CM_CACHE_ALIGN( sizeof( *pc ) ) );
+	pc->facets = (facet_t *)( (byte *)pc->planes + CM_CACHE_ALIGN( pc->numPlanes * sizeof( *pc->planes ) ) );
+	pc->nodes = (patchNode_t *)( (byte *)pc->facets + CM_CACHE_ALIGN( pc->numFacets * sizeof( *pc->facets ) ) );
+}
+
+/*
+=================
+CM_ValidCachedPatch
+
+Sets the pointers of a patch in the cache block and checks every index
+a trace will follow, so a damaged file can't send one outside the block
+=================
+*/
+static qboolean CM_ValidCachedPatch( patchCollide_t *pc, int length ) {
+	const patchPlane_t	*plane;
+	const facet_t		*facet;
+	const patchNode_t	*node;
+	int					i, j;
+
+	if ( length < CM_CACHE_ALIGN( sizeof( *pc ) )
+		|| pc->numPlanes < 0 || pc->numPlanes > MAX_PATCH_PLANES
+		|| pc->numFacets < 0 || pc->numFacets > MAX_FACETS
+		|| pc->numNodes < 0 || pc->numNodes > MAX_FACETS * 2
+		|| length < CM_CachedPatchSize( pc ) ) {
+		return qfalse;
+	}
+
+	CM_LinkCachedPatch( pc );
+
+	for ( i = 0, plane = pc->planes ; i < pc->numPlanes ; i++, plane++ ) {
+		if ( (unsigned)plane->signbits > 7 ) {
+			return qfalse;
+		}
+	}
+
+	for ( i = 0, facet = pc->facets ; i < pc->numFacets ; i++, facet++ ) {
+		if ( (unsigned)facet->surfacePlane >= pc->numPlanes
+			|| (unsigned)facet->numBorders > sizeof( facet->borderPlanes ) / sizeof( facet->borderPlanes[0] ) ) {
+			return qfalse;
+		}
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			if ( (unsigned)facet->borderPlanes[j] >= pc->numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+
+	for ( i = 0, node = pc->nodes ; i < pc->numNodes ; i++, node++ ) {
+		if ( node->firstFacet < 0 || node->numFacets < 0
+			|| node->numFacets > pc->numFacets - node->firstFacet
+			|| node->skip <= i || node->skip > pc->numNodes ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_LoadCache
+
+Returns the first patch of the cache block, NULL if there is no usable file.
+The file is checked in temp memory, so a bad one leaves nothing on the hunk.
+=================
+*/
+static byte *CM_LoadCache( const char *name, unsigned checksum, int numPatches ) {
+	cmCacheHeader_t	expected, cache;
+	fileHandle_t	f;
+	byte			*temp, *data, *p;
+	int				i, length, size;
+
+	length = FS_SV_FOpenFileRead( CM_CachePath( name, checksum ), &f );
+	if ( !f ) {
+		return NULL;
+	}
+
+	CM_CacheHeader( &expected, checksum, numPatches );
+	if ( FS_Read( &cache, sizeof( cache ), f ) != sizeof( cache )
+		|| memcmp( &cache, &expected, (byte *)&expected.length - (byte *)&expected )
+		|| cache.length <= 0 || cache.length != length - (int)sizeof( cache ) ) {
+		FS_FCloseFile( f );
+		return NULL;
+	}
+
+	temp = Hunk_AllocateTempMemory( cache.length );
+	if ( FS_Read( temp, cache.length, f ) != cache.length ) {
+		FS_FCloseFile( f );
+		Hunk_FreeTempMemory( temp );
+		return NULL;
+	}
+	FS_FCloseFile( f );
+
+	for ( i = 0, p = temp ; i < numPatches ; i++, p += size ) {
+		if ( !CM_ValidCachedPatch( (patchCollide_t *)p, temp + cache.length - p ) ) {
+			Com_DPrintf( "cm_cache: %s is damaged\n", CM_CachePath( name, checksum ) );
+			Hunk_FreeTempMemory( temp );
+			return NULL;
+		}
+		size = CM_CachedPatchSize( (patchCollide_t *)p );
+	}
+
+	data = Hunk_Alloc( cache.length, h_high );
+	Com_Memcpy( data, temp, cache.length );
+	Hunk_FreeTempMemory( temp );
+
+	for ( i = 0, p = data ; i < numPatches ; i++, p += size ) {
+		CM_LinkCachedPatch( (patchCollide_t *)p );
+		size = CM_CachedPatchSize( (patchCollide_t *)p );
+	}
+
+	return data;
+}
+
+/*
+=================
+CM_CacheWrite
+=================
+*/
+static qboolean CM_CacheWrite( const void *data, int length, fileHandle_t f ) {
+	static const byte	zeros[16];
+
+	return FS_Write( data, length, f ) == length
+		&& FS_Write( zeros, CM_CACHE_ALIGN( length ) - length, f ) == CM_CACHE_ALIGN( length ) - length;
+}
+
+/*
+=================
+CM_SaveCache
+
+Written to a temporary name first, another server on the same
+homepath may be loading the file
+=================
+*/
+static void CM_SaveCache( const char *name, unsigned checksum, int numPatches ) {
+	cmCacheHeader_t	cache;
+	patchCollide_t	pc;
+	char			path[MAX_QPATH], temp[MAX_QPATH];
+	fileHandle_t	f;
+	qboolean		ok;
+	int				i, pid;
+
+	CM_CacheHeader( &cache, checksum, numPatches );
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			cache.length += CM_CachedPatchSize( cm.surfaces[i]->pc );
+		}
+	}
+
+	Q_strncpyz( path, CM_CachePath( name, checksum ), sizeof( path ) );
+	pid = (int)getpid();
+	Com_sprintf( temp, sizeof( temp ), "%s.%i", path, pid );
+	f = FS_SV_FOpenFileWrite( temp );
+	if ( !f ) {
+		Com_DPrintf( "cm_cache: couldn't write %s\n", temp );
+		return;
+	}
+
+	ok = FS_Write( &cache, sizeof( cache ), f ) == sizeof( cache );
+	for ( i = 0 ; i < cm.numSurfaces && ok ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		// the pointers are set again on load
+		pc = *cm.surfaces[i]->pc;
+		pc.planes = NULL;
+		pc.facets = NULL;
+		pc.nodes = NULL;
+		ok = CM_CacheWrite( &pc, sizeof( pc ), f )
+			&& CM_CacheWrite( cm.surfaces[i]->pc->planes, pc.numPlanes * sizeof( *pc.planes ), f )
+			&& CM_CacheWrite( cm.surfaces[i]->pc->facets, pc.numFacets * sizeof( *pc.facets ), f )
+			&& CM_CacheWrite( cm.surfaces[i]->pc->nodes, pc.numNodes * sizeof( *pc.nodes ), f );
+	}
+	FS_FCloseFile( f );
+
+	if ( !ok ) {
+		Com_DPrintf( "cm_cache: couldn't write %s\n", temp );
+		remove( FS_BuildOSPath( Cvar_VariableString( "fs_homepath" ), "cmcache",
+			va( "%s.%i", COM_SkipPath( path ), pid ) ) );
+		return;
+	}
+	FS_SV_Rename( temp, path );
+}
+#endif //BSPC
+
 /*
 =================
 CMod_LoadPatches
+
+The patch collides come from the cache when cacheName is set and it
+has a file for this checksum
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, const char *cacheName, unsigned checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -491,6 +805,9 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	int			numPatches;
+	byte		*cache;
+	char		name[MAX_QPATH];
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -502,6 +819,26 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	numPatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) == MST_PATCH ) {
+			numPatches++;
+		}
+	}
+
+	cache = NULL;
+#ifndef BSPC
+	if ( cacheName && numPatches ) {
+		// it is often a va() string, CM_CachePath would write over it
+		Q_strncpyz( name, cacheName, sizeof( name ) );
+		cacheName = name;
+		cache = CM_LoadCache( cacheName, checksum, numPatches );
+	}
+	if ( cache ) {
+		Com_DPrintf( "%i patches from the collision cache\n", numPatches );
+	}
+#endif
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
 	for ( i = 0 ; i < count ; i++, in++ ) {
@@ -532,8 +869,19 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
 
 		// create the internal facet structure
-		patch->pc = CM_GeneratePatchCollide( width, height, points );
+		if ( cache ) {
+			patch->pc = (patchCollide_t *)cache;
+			cache += CM_CachedPatchSize( patch->pc );
+		} else {
+			patch->pc = CM_GeneratePatchCollide( width, height, points );
+		}
 	}
+
+#ifndef BSPC
+	if ( cacheName && numPatches && !cache ) {
+		CM_SaveCache( cacheName, checksum, numPatches );
+	}
+#endif
 }
 
 //==================================================================
@@ -581,6 +929,8 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_debugSurfaceUpdate = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
+	cm_cache = Cvar_Get ("cm_cache", "1", CVAR_ARCHIVE);
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -592,6 +942,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// free old stuff
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	cm_mapCount++;
 
 	if ( !name[0] ) {
 		cm.numLeafs = 1;
@@ -606,7 +957,8 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, (void **)&buf );
+	// only read, so a stored bsp is used in place in the mapped pk3
+	length = FS_MapFile( name, (const void **)&buf );
 #else
 	length = LoadQuakeFile((quakefile_t *) name, (void **)&buf);
 #endif
@@ -642,13 +994,16 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+#ifndef BSPC
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS],
+		cm_cache->integer ? name : NULL, CM_Checksum( &header ) );
+#else
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], NULL, 0 );
+#endif
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf);
 
-	CM_InitBoxHull ();
-
 	CM_FloodAreaConnections ();
 
 	// allow this to be cached if it is loaded by the server
@@ -665,6 +1020,7 @@ CM_ClearMap
 void CM_ClearMap( void ) {
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	cm_mapCount++;
 }
 
 /*
@@ -680,7 +1036,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &CM_GetThread()->boxModel;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -741,42 +1097,39 @@ Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-void CM_InitBoxHull (void)
+static void CM_InitBoxHull( cmThread_t *thread )
 {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+	thread->boxBrush.numsides = 6;
+	thread->boxBrush.sides = thread->boxSides;
+	thread->boxBrush.contents = CONTENTS_BODY;
+	thread->boxBrush.sides4 = NULL;	// the planes move with every CM_TempBoxModel
 
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+	// the leaf holds no map brushes, CM_TestInLeaf and friends
+	// check for it and use boxBrush instead
+	Com_Memset( &thread->boxModel, 0, sizeof( thread->boxModel ) );
 
 	for (i=0 ; i<6 ; i++)
 	{
 		side = i&1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
+		s = &thread->boxSides[i];
+		s->plane = 	&thread->boxPlanes[i*2+side];
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[i*2];
+		p = &thread->boxPlanes[i*2];
 		p->type = i>>1;
 		p->signbits = 0;
 		VectorClear (p->normal);
 		p->normal[i>>1] = 1;
 
-		p = &box_planes[i*2+1];
+		p = &thread->boxPlanes[i*2+1];
 		p->type = 3 + (i>>1);
 		p->signbits = 0;
 		VectorClear (p->normal);
@@ -786,6 +1139,63 @@ void CM_InitBoxHull (void)
 	}	
 }
 
+/*
+===================
+CM_GetThread
+
+The collision state of the calling thread, set up again for
+every new map.  Threads other than the main one must call
+CM_FreeThread before they exit.
+===================
+*/
+cmThread_t *CM_GetThread( void ) {
+	cmThread_t	*thread;
+
+	thread = &cm_thread;
+	if ( thread->mapCount == cm_mapCount ) {
+		return thread;
+	}
+
+	if ( thread->numBrushes < cm.numBrushes ) {
+		free( thread->brushChecks );
+		thread->brushChecks = malloc( cm.numBrushes * sizeof( *thread->brushChecks ) );
+		thread->numBrushes = cm.numBrushes;
+	}
+	if ( thread->numSurfaces < cm.numSurfaces ) {
+		free( thread->patchChecks );
+		thread->patchChecks = malloc( cm.numSurfaces * sizeof( *thread->patchChecks ) );
+		thread->numSurfaces = cm.numSurfaces;
+	}
+	if ( ( cm.numBrushes && !thread->brushChecks ) || ( cm.numSurfaces && !thread->patchChecks ) ) {
+		CM_FreeThread();
+		Com_Error( ERR_FATAL, "CM_GetThread: out of memory" );
+	}
+
+	if ( thread->brushChecks ) {
+		Com_Memset( thread->brushChecks, 0, thread->numBrushes * sizeof( *thread->brushChecks ) );
+	}
+	if ( thread->patchChecks ) {
+		Com_Memset( thread->patchChecks, 0, thread->numSurfaces * sizeof( *thread->patchChecks ) );
+	}
+	thread->checkcount = 0;
+
+	CM_InitBoxHull( thread );
+
+	thread->mapCount = cm_mapCount;
+	return thread;
+}
+
+/*
+===================
+CM_FreeThread
+===================
+*/
+void CM_FreeThread( void ) {
+	free( cm_thread.brushChecks );
+	free( cm_thread.patchChecks );
+	Com_Memset( &cm_thread, 0, sizeof( cm_thread ) );
+}
+
 /*
 ===================
 CM_TempBoxModel
@@ -793,17 +1203,24 @@ CM_TempBoxModel
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 Capsules are handled differently though.
+The box belongs to the calling thread, so it has to be traced on
+the thread that made it.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cmThread_t	*thread;
+	cplane_t	*box_planes;
+
+	thread = CM_GetThread();
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, thread->boxModel.mins );
+	VectorCopy( maxs, thread->boxModel.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
+	box_planes = thread->boxPlanes;
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = -maxs[0];
 	box_planes[2].dist = mins[0];
@@ -817,8 +1234,8 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	VectorCopy( mins, thread->boxBrush.bounds[0] );
+	VectorCopy( maxs, thread->boxBrush.bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
@@ -62,12 +62,18 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	struct cbrushsides4_s	*sides4;	// NULL if the sides are only clipped one by one
 } cbrush_t;
 
+// the planes of four brush sides, for clipping them with SSE, the
+// last group is padded with planes that never clip anything
+typedef struct cbrushsides4_s {
+	float		normal[3][4];
+	float		dist[4];
+} cbrushsides4_t;
+
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -120,25 +126,53 @@ typedef struct {
 	int			numAreas;
 	cArea_t		*areas;
 	int			*areaPortals;	// [ numAreas*numAreas ] reference counts
+	int			*areaNeighbors;	// [ numAreas*numAreas ] areas with an open portal to each area
+	int			*numAreaNeighbors;	// [ numAreas ]
+	byte		*areaBits;		// [ numAreas*areaBytes ] CM_WriteAreaBits of each area
+	int			*areaBitsFlood;	// [ numAreas ] floodChanges the bits were written at
+	int			areaBytes;
 
 	int			numSurfaces;
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+	int			floodnum;		// highest one handed out
+	int			floodChanges;	// incremented whenever an area gets a new floodnum
 } clipMap_t;
 
+// Everything a collision query writes goes to the cmThread_t of the
+// calling thread, so any number of threads can trace the same map.
+// See CM_GetThread.
+typedef struct {
+	int			mapCount;		// cm_mapCount the rest was set up for
+	int			checkcount;		// incremented on each query
+	int			*brushChecks;	// [numBrushes] checkcount of the last test
+	int			*patchChecks;	// [numSurfaces]
+	int			numBrushes;
+	int			numSurfaces;
+
+	// CM_TempBoxModel
+	cmodel_t	boxModel;
+	cbrush_t	boxBrush;
+	cbrushside_t	boxSides[6];
+	cplane_t	boxPlanes[12];
+} cmThread_t;
+
 
 // keep 1/8 unit away to keep the position valid before network snapping
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
-extern	int			c_pointcontents;
-extern	int			c_traces, c_brush_traces, c_patch_traces;
+extern	int			cm_mapCount;
+extern	THREAD_LOCAL int	c_pointcontents;
+extern	THREAD_LOCAL int	c_traces, c_brush_traces, c_patch_traces;
+extern	THREAD_LOCAL int	c_patch_facets;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_debugSurfaceUpdate;
+extern	cvar_t		*cm_cache;
 
 // cm_test.c
 
@@ -164,6 +198,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmThread_t	*thread;	// of the thread running the trace
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -174,6 +209,7 @@ typedef struct leafList_s {
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
+	cmThread_t	*thread;	// for CM_StoreBrushes
 } leafList_t;
 
 
@@ -184,6 +220,8 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
+cmThread_t	*CM_GetThread( void );
+void		CM_SetBrushSides4( cbrush_t *brush, cbrushsides4_t *groups );
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
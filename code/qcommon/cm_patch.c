@@ -84,8 +84,8 @@ int	c_totalPatchBlocks;
 int	c_totalPatchSurfaces;
 int	c_totalPatchEdges;
 
-static const patchCollide_t	*debugPatchCollide;
-static const facet_t		*debugFacet;
+static THREAD_LOCAL const patchCollide_t	*debugPatchCollide;
+static THREAD_LOCAL const facet_t		*debugFacet;
 static qboolean		debugBlock;
 static vec3_t		debugBlockPoints[4];
 
@@ -419,6 +419,10 @@ static	patchPlane_t	planes[MAX_PATCH_PLANES];
 
 static	int				numFacets;
 static	facet_t			facets[MAX_PATCH_PLANES]; //maybe MAX_FACETS ??
+static	vec3_t			facetBounds[MAX_FACETS][2];
+
+static	int				numNodes;
+static	patchNode_t		nodes[MAX_FACETS * 2];
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
@@ -751,13 +755,13 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 CM_ValidateFacet
 
 If the facet isn't bounded by its borders, we screwed up.
+Also returns the bounds of the facet winding.
 ==================
 */
-static qboolean CM_ValidateFacet( facet_t *facet ) {
+static qboolean CM_ValidateFacet( facet_t *facet, vec3_t bounds[2] ) {
 	float		plane[4];
 	int			j;
 	winding_t	*w;
-	vec3_t		bounds[2];
 
 	if ( facet->surfacePlane == -1 ) {
 		return qfalse;
@@ -973,6 +977,39 @@ typedef enum {
 	EN_LEFT
 } edgeName_t;
 
+/*
+==================
+CM_BuildPatchNodes
+
+Splits the facets in halves until PATCH_LEAF_FACETS are left, the
+facets come row by row from the grid so each half stays in one piece
+==================
+*/
+static void CM_BuildPatchNodes( int firstFacet, int count ) {
+	patchNode_t		*node;
+	int				i;
+
+	node = &nodes[numNodes++];
+	node->firstFacet = firstFacet;
+	node->numFacets = count;
+
+	ClearBounds( node->bounds[0], node->bounds[1] );
+	for ( i = firstFacet ; i < firstFacet + count ; i++ ) {
+		AddPointToBounds( facetBounds[i][0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( facetBounds[i][1], node->bounds[0], node->bounds[1] );
+	}
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->bounds[0][i] -= PATCH_NODE_EPSILON;
+		node->bounds[1][i] += PATCH_NODE_EPSILON;
+	}
+
+	if ( count > PATCH_LEAF_FACETS ) {
+		CM_BuildPatchNodes( firstFacet, count / 2 );
+		CM_BuildPatchNodes( firstFacet + count / 2, count - count / 2 );
+	}
+	node->skip = numNodes;
+}
+
 /*
 ==================
 CM_PatchCollideFromGrid
@@ -1073,7 +1110,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				facet->borderPlanes[3] = borders[EN_LEFT];
 				facet->borderNoAdjust[3] = noAdjust[EN_LEFT];
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, -1 );
-				if ( CM_ValidateFacet( facet ) ) {
+				if ( CM_ValidateFacet( facet, facetBounds[numFacets] ) ) {
 					CM_AddFacetBevels( facet );
 					numFacets++;
 				}
@@ -1093,7 +1130,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 					}
 				}
  				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 0 );
-				if ( CM_ValidateFacet( facet ) ) {
+				if ( CM_ValidateFacet( facet, facetBounds[numFacets] ) ) {
 					CM_AddFacetBevels( facet );
 					numFacets++;
 				}
@@ -1118,7 +1155,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 					}
 				}
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 1 );
-				if ( CM_ValidateFacet( facet ) ) {
+				if ( CM_ValidateFacet( facet, facetBounds[numFacets] ) ) {
 					CM_AddFacetBevels( facet );
 					numFacets++;
 				}
@@ -1133,6 +1170,14 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
 	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
 	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+	// a tree over the facets, so traces only test the ones they get near
+	numNodes = 0;
+	if ( numFacets > PATCH_LEAF_FACETS ) {
+		CM_BuildPatchNodes( 0, numFacets );
+	}
+	pf->numNodes = numNodes;
+	pf->nodes = Hunk_Alloc( numNodes * sizeof( *pf->nodes ), h_high );
+	Com_Memcpy( pf->nodes, nodes, numNodes * sizeof( *pf->nodes ) );
 }
 
 
@@ -1222,6 +1267,48 @@ TRACE TESTING
 ================================================================================
 */
 
+/*
+====================
+CM_NextPatchFacets
+
+Walks the facet tree to the next run of facets the trace bounds touch,
+start with *node = 0.  Returns qfalse when there are no more.
+====================
+*/
+static qboolean CM_NextPatchFacets( const traceWork_t *tw, const patchCollide_t *pc,
+									int *node, int *firstFacet, int *lastFacet ) {
+	const patchNode_t	*n;
+
+	if ( !pc->numNodes ) {
+		if ( *node ) {
+			return qfalse;
+		}
+		*node = 1;
+		*firstFacet = 0;
+		*lastFacet = pc->numFacets;
+		c_patch_facets += pc->numFacets;
+		return qtrue;
+	}
+
+	while ( *node < pc->numNodes ) {
+		n = &pc->nodes[*node];
+		if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1], n->bounds[0], n->bounds[1] ) ) {
+			*node = n->skip;
+			continue;
+		}
+		if ( n->numFacets > PATCH_LEAF_FACETS ) {
+			(*node)++;		// into the children
+			continue;
+		}
+		*node = n->skip;
+		*firstFacet = n->firstFacet;
+		*lastFacet = n->firstFacet + n->numFacets;
+		c_patch_facets += n->numFacets;
+		return qtrue;
+	}
+	return qfalse;
+}
+
 /*
 ====================
 CM_TracePointThroughPatchCollide
@@ -1236,11 +1323,9 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 	const patchPlane_t	*planes;
 	const facet_t	*facet;
 	int			i, j, k;
+	int			node, firstFacet, lastFacet;
 	float		offset;
 	float		d1, d2;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
 #ifndef BSPC
 	if ( !cm_playerCurveClip->integer || !tw->isPoint ) {
@@ -1271,55 +1356,55 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 
 
 	// see if any of the surface planes are intersected
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		if ( !frontFacing[facet->surfacePlane] ) {
-			continue;
-		}
-		intersect = intersection[facet->surfacePlane];
-		if ( intersect < 0 ) {
-			continue;		// surface is behind the starting point
-		}
-		if ( intersect > tw->trace.fraction ) {
-			continue;		// already hit something closer
-		}
-		for ( j = 0 ; j < facet->numBorders ; j++ ) {
-			k = facet->borderPlanes[j];
-			if ( frontFacing[k] ^ facet->borderInward[j] ) {
-				if ( intersection[k] > intersect ) {
-					break;
-				}
-			} else {
-				if ( intersection[k] < intersect ) {
-					break;
-				}
+	node = 0;
+	while ( CM_NextPatchFacets( tw, pc, &node, &firstFacet, &lastFacet ) ) {
+		facet = pc->facets + firstFacet;
+		for ( i = firstFacet ; i < lastFacet ; i++, facet++ ) {
+			if ( !frontFacing[facet->surfacePlane] ) {
+				continue;
 			}
-		}
-		if ( j == facet->numBorders ) {
-			// we hit this facet
-#ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+			intersect = intersection[facet->surfacePlane];
+			if ( intersect < 0 ) {
+				continue;		// surface is behind the starting point
 			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
+			if ( intersect > tw->trace.fraction ) {
+				continue;		// already hit something closer
 			}
-#endif //BSPC
-			planes = &pc->planes[facet->surfacePlane];
+			for ( j = 0 ; j < facet->numBorders ; j++ ) {
+				k = facet->borderPlanes[j];
+				if ( frontFacing[k] ^ facet->borderInward[j] ) {
+					if ( intersection[k] > intersect ) {
+						break;
+					}
+				} else {
+					if ( intersection[k] < intersect ) {
+						break;
+					}
+				}
+			}
+			if ( j == facet->numBorders ) {
+				// we hit this facet
+	#ifndef BSPC
+				if (cm_debugSurfaceUpdate->integer) {
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
+	#endif //BSPC
+				planes = &pc->planes[facet->surfacePlane];
 
-			// calculate intersection with a slight pushoff
-			offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
-			d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
-			d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
-			tw->trace.fraction = ( d1 - SURFACE_CLIP_EPSILON ) / ( d1 - d2 );
+				// calculate intersection with a slight pushoff
+				offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane );
+				d1 = DotProduct( tw->start, planes->plane ) - planes->plane[3] + offset;
+				d2 = DotProduct( tw->end, planes->plane ) - planes->plane[3] + offset;
+				tw->trace.fraction = ( d1 - SURFACE_CLIP_EPSILON ) / ( d1 - d2 );
 
-			if ( tw->trace.fraction < 0 ) {
-				tw->trace.fraction = 0;
-			}
+				if ( tw->trace.fraction < 0 ) {
+					tw->trace.fraction = 0;
+				}
 
-			VectorCopy( planes->plane,  tw->trace.plane.normal );
-			tw->trace.plane.dist = planes->plane[3];
+				VectorCopy( planes->plane,  tw->trace.plane.normal );
+				tw->trace.plane.dist = planes->plane[3];
+			}
 		}
 	}
 }
@@ -1377,14 +1462,12 @@ CM_TraceThroughPatchCollide
 */
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
 	int i, j, hit, hitnum;
+	int node, firstFacet, lastFacet;
 	float offset, enterFrac, leaveFrac, t;
 	patchPlane_t *planes;
 	facet_t	*facet;
 	float plane[4] = {0, 0, 0, 0}, bestplane[4] = {0, 0, 0, 0};
 	vec3_t startp, endp;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
 	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
 				pc->bounds[0], pc->bounds[1] ) ) {
@@ -1396,54 +1479,17 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 		return;
 	}
 
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		enterFrac = -1.0;
-		leaveFrac = 1.0;
-		hitnum = -1;
-		//
-		planes = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(planes->plane, plane);
-		plane[3] = planes->plane[3];
-		if ( tw->sphere.use ) {
-			// adjust the plane distance apropriately for radius
-			plane[3] += tw->sphere.radius;
-
-			// find the closest point on the capsule to the plane
-			t = DotProduct( plane, tw->sphere.offset );
-			if ( t > 0.0f ) {
-				VectorSubtract( tw->start, tw->sphere.offset, startp );
-				VectorSubtract( tw->end, tw->sphere.offset, endp );
-			}
-			else {
-				VectorAdd( tw->start, tw->sphere.offset, startp );
-				VectorAdd( tw->end, tw->sphere.offset, endp );
-			}
-		}
-		else {
-			offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-			plane[3] -= offset;
-			VectorCopy( tw->start, startp );
-			VectorCopy( tw->end, endp );
-		}
-
-		if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-			continue;
-		}
-		if (hit) {
-			Vector4Copy(plane, bestplane);
-		}
-
-		for ( j = 0; j < facet->numBorders; j++ ) {
-			planes = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(planes->plane, plane);
-				plane[3] = -planes->plane[3];
-			}
-			else {
-				VectorCopy(planes->plane, plane);
-				plane[3] = planes->plane[3];
-			}
+	node = 0;
+	while ( CM_NextPatchFacets( tw, pc, &node, &firstFacet, &lastFacet ) ) {
+		facet = pc->facets + firstFacet;
+		for ( i = firstFacet ; i < lastFacet ; i++, facet++ ) {
+			enterFrac = -1.0;
+			leaveFrac = 1.0;
+			hitnum = -1;
+			//
+			planes = &pc->planes[ facet->surfacePlane ];
+			VectorCopy(planes->plane, plane);
+			plane[3] = planes->plane[3];
 			if ( tw->sphere.use ) {
 				// adjust the plane distance apropriately for radius
 				plane[3] += tw->sphere.radius;
@@ -1460,43 +1506,80 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 				}
 			}
 			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
 				offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-				plane[3] += fabs(offset);
+				plane[3] -= offset;
 				VectorCopy( tw->start, startp );
 				VectorCopy( tw->end, endp );
 			}
 
 			if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-				break;
+				continue;
 			}
 			if (hit) {
-				hitnum = j;
 				Vector4Copy(plane, bestplane);
 			}
-		}
-		if (j < facet->numBorders) continue;
-		//never clip against the back side
-		if (hitnum == facet->numBorders - 1) continue;
-
-		if (enterFrac < leaveFrac && enterFrac >= 0) {
-			if (enterFrac < tw->trace.fraction) {
-				if (enterFrac < 0) {
-					enterFrac = 0;
+
+			for ( j = 0; j < facet->numBorders; j++ ) {
+				planes = &pc->planes[ facet->borderPlanes[j] ];
+				if (facet->borderInward[j]) {
+					VectorNegate(planes->plane, plane);
+					plane[3] = -planes->plane[3];
 				}
-#ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+				else {
+					VectorCopy(planes->plane, plane);
+					plane[3] = planes->plane[3];
 				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
+				if ( tw->sphere.use ) {
+					// adjust the plane distance apropriately for radius
+					plane[3] += tw->sphere.radius;
+
+					// find the closest point on the capsule to the plane
+					t = DotProduct( plane, tw->sphere.offset );
+					if ( t > 0.0f ) {
+						VectorSubtract( tw->start, tw->sphere.offset, startp );
+						VectorSubtract( tw->end, tw->sphere.offset, endp );
+					}
+					else {
+						VectorAdd( tw->start, tw->sphere.offset, startp );
+						VectorAdd( tw->end, tw->sphere.offset, endp );
+					}
 				}
-#endif //BSPC
+				else {
+					// NOTE: this works even though the plane might be flipped because the bbox is centered
+					offset = DotProduct( tw->offsets[ planes->signbits ], plane);
+					plane[3] += fabs(offset);
+					VectorCopy( tw->start, startp );
+					VectorCopy( tw->end, endp );
+				}
+
+				if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
+					break;
+				}
+				if (hit) {
+					hitnum = j;
+					Vector4Copy(plane, bestplane);
+				}
+			}
+			if (j < facet->numBorders) continue;
+			//never clip against the back side
+			if (hitnum == facet->numBorders - 1) continue;
+
+			if (enterFrac < leaveFrac && enterFrac >= 0) {
+				if (enterFrac < tw->trace.fraction) {
+					if (enterFrac < 0) {
+						enterFrac = 0;
+					}
+	#ifndef BSPC
+					if (cm_debugSurfaceUpdate->integer) {
+						debugPatchCollide = pc;
+						debugFacet = facet;
+					}
+	#endif //BSPC
 
-				tw->trace.fraction = enterFrac;
-				VectorCopy( bestplane, tw->trace.plane.normal );
-				tw->trace.plane.dist = bestplane[3];
+					tw->trace.fraction = enterFrac;
+					VectorCopy( bestplane, tw->trace.plane.normal );
+					tw->trace.plane.dist = bestplane[3];
+				}
 			}
 		}
 	}
@@ -1518,6 +1601,7 @@ CM_PositionTestInPatchCollide
 */
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
 	int i, j;
+	int node, firstFacet, lastFacet;
 	float offset, t;
 	patchPlane_t *planes;
 	facet_t	*facet;
@@ -1528,51 +1612,20 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 		return qfalse;
 	}
 	//
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		planes = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(planes->plane, plane);
-		plane[3] = planes->plane[3];
-		if ( tw->sphere.use ) {
-			// adjust the plane distance apropriately for radius
-			plane[3] += tw->sphere.radius;
-
-			// find the closest point on the capsule to the plane
-			t = DotProduct( plane, tw->sphere.offset );
-			if ( t > 0 ) {
-				VectorSubtract( tw->start, tw->sphere.offset, startp );
-			}
-			else {
-				VectorAdd( tw->start, tw->sphere.offset, startp );
-			}
-		}
-		else {
-			offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-			plane[3] -= offset;
-			VectorCopy( tw->start, startp );
-		}
-
-		if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
-			continue;
-		}
-
-		for ( j = 0; j < facet->numBorders; j++ ) {
-			planes = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(planes->plane, plane);
-				plane[3] = -planes->plane[3];
-			}
-			else {
-				VectorCopy(planes->plane, plane);
-				plane[3] = planes->plane[3];
-			}
+	node = 0;
+	while ( CM_NextPatchFacets( tw, pc, &node, &firstFacet, &lastFacet ) ) {
+		facet = pc->facets + firstFacet;
+		for ( i = firstFacet ; i < lastFacet ; i++, facet++ ) {
+			planes = &pc->planes[ facet->surfacePlane ];
+			VectorCopy(planes->plane, plane);
+			plane[3] = planes->plane[3];
 			if ( tw->sphere.use ) {
 				// adjust the plane distance apropriately for radius
 				plane[3] += tw->sphere.radius;
 
 				// find the closest point on the capsule to the plane
 				t = DotProduct( plane, tw->sphere.offset );
-				if ( t > 0.0f ) {
+				if ( t > 0 ) {
 					VectorSubtract( tw->start, tw->sphere.offset, startp );
 				}
 				else {
@@ -1580,21 +1633,55 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 				}
 			}
 			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
 				offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-				plane[3] += fabs(offset);
+				plane[3] -= offset;
 				VectorCopy( tw->start, startp );
 			}
 
 			if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
-				break;
+				continue;
 			}
+
+			for ( j = 0; j < facet->numBorders; j++ ) {
+				planes = &pc->planes[ facet->borderPlanes[j] ];
+				if (facet->borderInward[j]) {
+					VectorNegate(planes->plane, plane);
+					plane[3] = -planes->plane[3];
+				}
+				else {
+					VectorCopy(planes->plane, plane);
+					plane[3] = planes->plane[3];
+				}
+				if ( tw->sphere.use ) {
+					// adjust the plane distance apropriately for radius
+					plane[3] += tw->sphere.radius;
+
+					// find the closest point on the capsule to the plane
+					t = DotProduct( plane, tw->sphere.offset );
+					if ( t > 0.0f ) {
+						VectorSubtract( tw->start, tw->sphere.offset, startp );
+					}
+					else {
+						VectorAdd( tw->start, tw->sphere.offset, startp );
+					}
+				}
+				else {
+					// NOTE: this works even though the plane might be flipped because the bbox is centered
+					offset = DotProduct( tw->offsets[ planes->signbits ], plane);
+					plane[3] += fabs(offset);
+					VectorCopy( tw->start, startp );
+				}
+
+				if ( DotProduct( plane, startp ) - plane[3] > 0.0f ) {
+					break;
+				}
+			}
+			if (j < facet->numBorders) {
+				continue;
+			}
+			// inside this patch facet
+			return qtrue;
 		}
-		if (j < facet->numBorders) {
-			continue;
-		}
-		// inside this patch facet
-		return qtrue;
 	}
 	return qfalse;
 }
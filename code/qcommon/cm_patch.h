@@ -76,12 +76,27 @@ typedef struct {
 	qboolean	borderNoAdjust[4+6+16];
 } facet_t;
 
+// Bounding boxes over runs of facets, depth first: the first child of a
+// node is the one after it, skip is the node after all its children.
+// The facets keep their order, so the tree only changes how many get tested.
+#define	PATCH_LEAF_FACETS	4
+#define	PATCH_NODE_EPSILON	2		// more than the plane snapping can move a facet
+
+typedef struct {
+	vec3_t	bounds[2];
+	int		firstFacet;
+	int		numFacets;		// more than PATCH_LEAF_FACETS if it has children
+	int		skip;
+} patchNode_t;
+
 typedef struct patchCollide_s {
 	vec3_t	bounds[2];
 	int		numPlanes;			// surface planes plus edge planes
 	patchPlane_t	*planes;
 	int		numFacets;
 	facet_t	*facets;
+	int		numNodes;			// 0 if there are too few facets for a tree
+	patchNode_t	*nodes;
 } patchCollide_t;
 
 
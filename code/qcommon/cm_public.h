@@ -28,6 +28,13 @@ void		CM_ClearMap( void );
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
 
+// threads that trace in parallel with the main one call this before exiting
+void		CM_FreeThread( void );
+void		CM_Stress_f( void );
+void		CM_SidesTest_f( void );
+void		CM_PatchTest_f( void );
+void		CM_AreaTest_f( void );
+
 void		CM_ModelBounds( clipHandle_t model, vec3_t mins, vec3_t maxs );
 
 int			CM_NumClusters (void);
@@ -101,10 +101,10 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( ll->thread->brushChecks[brushnum] == ll->thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		ll->thread->brushChecks[brushnum] = ll->thread->checkcount;
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -172,8 +172,6 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -182,6 +180,7 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.thread = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -197,8 +196,6 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -207,6 +204,8 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.thread = CM_GetThread();
+	ll.thread->checkcount++;
 	
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -217,6 +216,32 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 //====================================================================
 
 
+/*
+==================
+CM_PointInBrush
+==================
+*/
+static qboolean CM_PointInBrush( const vec3_t p, const cbrush_t *b ) {
+	int			i;
+	float		d;
+
+	if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
+		return qfalse;
+	}
+
+	// see if the point is in the brush
+	for ( i = 0 ; i < b->numsides ; i++ ) {
+		d = DotProduct( p, b->sides[i].plane->normal );
+// FIXME test for Cash
+//		if ( d >= b->sides[i].plane->dist ) {
+		if ( d > b->sides[i].plane->dist ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
 /*
 ==================
 CM_PointContents
@@ -225,19 +250,22 @@ CM_PointContents
 */
 int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 	int			leafnum;
-	int			i, k;
+	int			k;
 	int			brushnum;
 	cLeaf_t		*leaf;
 	cbrush_t	*b;
 	int			contents;
-	float		d;
 	cmodel_t	*clipm;
 
 	if (!cm.numNodes) {	// map not loaded
 		return 0;
 	}
 
-	if ( model ) {
+	if ( model == BOX_MODEL_HANDLE ) {
+		// CM_TempBoxModel, the leaf holds no map brushes
+		b = &CM_GetThread()->boxBrush;
+		return CM_PointInBrush( p, b ) ? b->contents : 0;
+	} else if ( model ) {
 		clipm = CM_ClipHandleToModel( model );
 		leaf = &clipm->leaf;
 	} else {
@@ -250,21 +278,7 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
 
-		if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
-			continue;
-		}
-
-		// see if the point is in the brush
-		for ( i = 0 ; i < b->numsides ; i++ ) {
-			d = DotProduct( p, b->sides[i].plane->normal );
-// FIXME test for Cash
-//			if ( d >= b->sides[i].plane->dist ) {
-			if ( d > b->sides[i].plane->dist ) {
-				break;
-			}
-		}
-
-		if ( i == b->numsides ) {
+		if ( CM_PointInBrush( p, b ) ) {
 			contents |= b->contents;
 		}
 	}
@@ -346,10 +360,39 @@ void CM_FloodArea_r( int areaNum, int floodnum) {
 
 	area->floodnum = floodnum;
 	area->floodvalid = cm.floodvalid;
-	con = cm.areaPortals + areaNum * cm.numAreas;
-	for ( i=0 ; i < cm.numAreas  ; i++ ) {
-		if ( con[i] > 0 ) {
-			CM_FloodArea_r( i, floodnum );
+	con = cm.areaNeighbors + areaNum * cm.numAreas;
+	for ( i=0 ; i < cm.numAreaNeighbors[areaNum] ; i++ ) {
+		CM_FloodArea_r( con[i], floodnum );
+	}
+}
+
+/*
+====================
+CM_LinkAreas
+
+Keeps the open portals of every area in a list, so a flood only
+looks at the areas it can reach
+====================
+*/
+static void CM_LinkAreas( int area1, int area2 ) {
+	cm.areaNeighbors[ area1 * cm.numAreas + cm.numAreaNeighbors[area1]++ ] = area2;
+	cm.areaNeighbors[ area2 * cm.numAreas + cm.numAreaNeighbors[area2]++ ] = area1;
+}
+
+/*
+====================
+CM_UnlinkAreaNeighbor
+====================
+*/
+static void CM_UnlinkAreaNeighbor( int area, int neighbor ) {
+	int		*con;
+	int		i;
+
+	con = cm.areaNeighbors + area * cm.numAreas;
+	for ( i = 0 ; i < cm.numAreaNeighbors[area] ; i++ ) {
+		if ( con[i] == neighbor ) {
+			con[i] = con[--cm.numAreaNeighbors[area]];
+			return;
 		}
 	}
 }
@@ -378,15 +421,77 @@ void	CM_FloodAreaConnections( void ) {
 		CM_FloodArea_r (i, floodnum);
 	}
 
+	cm.floodnum = floodnum;
+	cm.floodChanges++;
+}
+
+/*
+====================
+CM_JoinAreaFloods
+
+A portal opened between two areas, the flood of area2 takes the floodnum
+of area1 without flooding anything
+====================
+*/
+static void CM_JoinAreaFloods( int area1, int area2 ) {
+	int		i;
+	int		floodnum1, floodnum2;
+
+	floodnum1 = cm.areas[area1].floodnum;
+	floodnum2 = cm.areas[area2].floodnum;
+	if ( floodnum1 == floodnum2 ) {
+		return;		// already connected some other way
+	}
+
+	for ( i = 0 ; i < cm.numAreas ; i++ ) {
+		if ( cm.areas[i].floodnum == floodnum2 ) {
+			cm.areas[i].floodnum = floodnum1;
+		}
+	}
+	cm.floodChanges++;
+}
+
+/*
+====================
+CM_SplitAreaFloods
+
+A portal closed between two areas.  Only their flood can come apart, so
+only it is flooded again from area1; if that doesn't reach area2, the
+part left behind gets a new floodnum.
+====================
+*/
+static void CM_SplitAreaFloods( int area1, int area2 ) {
+	int		i;
+	int		floodnum;
+
+	floodnum = cm.areas[area1].floodnum;
+
+	cm.floodvalid++;
+	CM_FloodArea_r( area1, floodnum );
+	if ( cm.areas[area2].floodvalid == cm.floodvalid ) {
+		return;		// still connected some other way
+	}
+
+	cm.floodnum++;
+	for ( i = 0 ; i < cm.numAreas ; i++ ) {
+		if ( cm.areas[i].floodnum == floodnum && cm.areas[i].floodvalid != cm.floodvalid ) {
+			cm.areas[i].floodnum = cm.floodnum;
+		}
+	}
+	cm.floodChanges++;
 }
 
 /*
 ====================
 CM_AdjustAreaPortalState
 
+Only the first reference opening a portal and the last one closing it
+change which areas are connected
 ====================
 */
 void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
+	int		count;
+
 	if ( area1 < 0 || area2 < 0 ) {
 		return;
 	}
@@ -397,16 +502,151 @@ void	CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
 
 	if ( open ) {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]++;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]++;
+		count = ++cm.areaPortals[ area2 * cm.numAreas + area1 ];
 	} else {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]--;
-		cm.areaPortals[ area2 * cm.numAreas + area1 ]--;
-		if ( cm.areaPortals[ area2 * cm.numAreas + area1 ] < 0 ) {
+		count = --cm.areaPortals[ area2 * cm.numAreas + area1 ];
+		if ( count < 0 ) {
 			Com_Error (ERR_DROP, "CM_AdjustAreaPortalState: negative reference count");
 		}
 	}
 
-	CM_FloodAreaConnections ();
+	if ( area1 == area2 ) {
+		return;
+	}
+	if ( open && count == 1 ) {
+		CM_LinkAreas( area1, area2 );
+		CM_JoinAreaFloods( area1, area2 );
+	} else if ( !open && count == 0 ) {
+		CM_UnlinkAreaNeighbor( area1, area2 );
+		CM_UnlinkAreaNeighbor( area2, area1 );
+		CM_SplitAreaFloods( area1, area2 );
+	}
+}
+
+/*
+====================
+CM_AreaTestDiffers
+
+qtrue unless both floodnum arrays split the areas the same way
+====================
+*/
+static qboolean CM_AreaTestDiffers( const int *floods1, const int *floods2 ) {
+	int		i, j;
+
+	for ( i = 0 ; i < cm.numAreas ; i++ ) {
+		for ( j = i + 1 ; j < cm.numAreas ; j++ ) {
+			if ( ( floods1[i] == floods1[j] ) != ( floods2[i] == floods2[j] ) ) {
+				return qtrue;
+			}
+		}
+	}
+	return qfalse;
+}
+
+/*
+====================
+CM_AreaTest_f
+
+cmareatest [changes]
+
+Opens and closes random area portals through CM_AdjustAreaPortalState
+and after every change compares the areas it left connected with a full
+CM_FloodAreaConnections.  The portals are put back afterwards.
+====================
+*/
+void CM_AreaTest_f( void ) {
+	int		*savedPortals, *savedNeighbors, *savedNumNeighbors;
+	int		*opened, *floods, *expected;
+	int		numChanges, numOpened, seed, differ, floodnum;
+	int		i, j, area1, area2, size;
+	int64_t	start, adjustUsec, floodUsec;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	numChanges = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 10000;
+	if ( numChanges <= 0 ) {
+		Com_Printf( "Usage: cmareatest [changes]\n" );
+		return;
+	}
+
+	size = cm.numAreas * cm.numAreas * sizeof( int );
+	savedPortals = Z_Malloc( size );
+	savedNeighbors = Z_Malloc( size );
+	savedNumNeighbors = Z_Malloc( cm.numAreas * sizeof( int ) );
+	opened = Z_Malloc( numChanges * 2 * sizeof( int ) );
+	floods = Z_Malloc( cm.numAreas * sizeof( int ) );
+	expected = Z_Malloc( cm.numAreas * sizeof( int ) );
+	Com_Memcpy( savedPortals, cm.areaPortals, size );
+	Com_Memcpy( savedNeighbors, cm.areaNeighbors, size );
+	Com_Memcpy( savedNumNeighbors, cm.numAreaNeighbors, cm.numAreas * sizeof( int ) );
+
+	// about as many open portals as areas, so floods keep joining and splitting
+	seed = 1;
+	numOpened = 0;
+	differ = 0;
+	adjustUsec = floodUsec = 0;
+	for ( i = 0 ; i < numChanges ; i++ ) {
+		start = Sys_Microseconds();
+		if ( numOpened && ( numOpened >= cm.numAreas || Q_random( &seed ) < 0.5f ) ) {
+			j = (int)( Q_random( &seed ) * numOpened ) % numOpened;
+			area1 = opened[j * 2];
+			area2 = opened[j * 2 + 1];
+			numOpened--;
+			opened[j * 2] = opened[numOpened * 2];
+			opened[j * 2 + 1] = opened[numOpened * 2 + 1];
+			CM_AdjustAreaPortalState( area1, area2, qfalse );
+		} else {
+			area1 = (int)( Q_random( &seed ) * cm.numAreas ) % cm.numAreas;
+			area2 = (int)( Q_random( &seed ) * cm.numAreas ) % cm.numAreas;
+			opened[numOpened * 2] = area1;
+			opened[numOpened * 2 + 1] = area2;
+			numOpened++;
+			CM_AdjustAreaPortalState( area1, area2, qtrue );
+		}
+		adjustUsec += Sys_Microseconds() - start;
+
+		for ( j = 0 ; j < cm.numAreas ; j++ ) {
+			floods[j] = cm.areas[j].floodnum;
+		}
+		floodnum = cm.floodnum;
+
+		start = Sys_Microseconds();
+		CM_FloodAreaConnections();
+		floodUsec += Sys_Microseconds() - start;
+
+		for ( j = 0 ; j < cm.numAreas ; j++ ) {
+			expected[j] = cm.areas[j].floodnum;
+		}
+		if ( CM_AreaTestDiffers( floods, expected ) ) {
+			differ++;
+		}
+
+		// carry on from the incremental floods
+		for ( j = 0 ; j < cm.numAreas ; j++ ) {
+			cm.areas[j].floodnum = floods[j];
+		}
+		cm.floodnum = floodnum;
+	}
+
+	Com_Memcpy( cm.areaPortals, savedPortals, size );
+	Com_Memcpy( cm.areaNeighbors, savedNeighbors, size );
+	Com_Memcpy( cm.numAreaNeighbors, savedNumNeighbors, cm.numAreas * sizeof( int ) );
+	CM_FloodAreaConnections();
+
+	Z_Free( savedPortals );
+	Z_Free( savedNeighbors );
+	Z_Free( savedNumNeighbors );
+	Z_Free( opened );
+	Z_Free( floods );
+	Z_Free( expected );
+
+	Com_Printf( "%i areas, %i usec in CM_AdjustAreaPortalState, %i usec in full floods\n",
+		cm.numAreas, (int)adjustUsec, (int)floodUsec );
+	Com_Printf( "%i changes checked, %i differ\n", numChanges, differ );
 }
 
 /*
@@ -456,6 +696,7 @@ int CM_WriteAreaBits (byte *buffer, int area)
 	int		i;
 	int		floodnum;
 	int		bytes;
+	byte	*bits;
 
 	bytes = (cm.numAreas+7)>>3;
 
@@ -469,11 +710,22 @@ int CM_WriteAreaBits (byte *buffer, int area)
 	}
 	else
 	{
-		floodnum = cm.areas[area].floodnum;
-		for (i=0 ; i<cm.numAreas ; i++)
+		// every client in the same area wants the same bits, they
+		// only change with the floods
+		bits = cm.areaBits + area * cm.areaBytes;
+		if ( cm.areaBitsFlood[area] != cm.floodChanges ) {
+			cm.areaBitsFlood[area] = cm.floodChanges;
+			Com_Memset( bits, 0, bytes );
+			floodnum = cm.areas[area].floodnum;
+			for (i=0 ; i<cm.numAreas ; i++)
+			{
+				if (cm.areas[i].floodnum == floodnum)
+					bits[i>>3] |= 1<<(i&7);
+			}
+		}
+		for (i=0 ; i<bytes ; i++)
 		{
-			if (cm.areas[i].floodnum == floodnum || area == -1)
-				buffer[i>>3] |= 1<<(i&7);
+			buffer[i] |= bits[i];
 		}
 	}
 
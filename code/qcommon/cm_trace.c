@@ -20,6 +20,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 #include "cm_local.h"
+#include "cm_patch.h"
+
+#if idsse2
+#include <xmmintrin.h>
+#endif
 
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
@@ -148,6 +153,194 @@ float SquareRootFloat(float number) {
 }
 
 
+#if idsse2
+/*
+===============================================================================
+
+SSE BRUSH CLIPPING
+
+The planes of four brush sides are expanded for the box or capsule and
+measured against the start and end in one go, with the same operations
+in the same order as the scalar loops, so the distances are bit for bit
+the same.  Only the sides that the trace crosses go on to the scalar
+enter / leave bookkeeping, in their original order.
+
+===============================================================================
+*/
+
+/*
+================
+CM_Select4
+
+mask ? a : b
+================
+*/
+static ID_INLINE __m128 CM_Select4( __m128 mask, __m128 a, __m128 b ) {
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+/*
+================
+CM_Dot4
+================
+*/
+static ID_INLINE __m128 CM_Dot4( __m128 x, __m128 y, __m128 z, __m128 nx, __m128 ny, __m128 nz ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, nx ), _mm_mul_ps( y, ny ) ), _mm_mul_ps( z, nz ) );
+}
+
+/*
+================
+CM_Sides4Distances
+
+Distances of the trace start and end in front of four sides
+================
+*/
+static ID_INLINE void CM_Sides4Distances( const traceWork_t *tw, const cbrushsides4_t *g,
+										 __m128 *d1, __m128 *d2 ) {
+	__m128		nx, ny, nz, dist, mask, zero;
+	__m128		sx, sy, sz, ex, ey, ez;
+
+	nx = _mm_loadu_ps( g->normal[0] );
+	ny = _mm_loadu_ps( g->normal[1] );
+	nz = _mm_loadu_ps( g->normal[2] );
+	zero = _mm_setzero_ps();
+
+	if ( tw->sphere.use ) {
+		// adjust the plane distance apropriately for radius
+		dist = _mm_add_ps( _mm_loadu_ps( g->dist ), _mm_set1_ps( tw->sphere.radius ) );
+
+		// find the closest point on the capsule to the plane
+		mask = _mm_cmpgt_ps( CM_Dot4( nx, ny, nz, _mm_set1_ps( tw->sphere.offset[0] ),
+			_mm_set1_ps( tw->sphere.offset[1] ), _mm_set1_ps( tw->sphere.offset[2] ) ), zero );
+		sx = CM_Select4( mask, _mm_set1_ps( tw->start[0] - tw->sphere.offset[0] ), _mm_set1_ps( tw->start[0] + tw->sphere.offset[0] ) );
+		sy = CM_Select4( mask, _mm_set1_ps( tw->start[1] - tw->sphere.offset[1] ), _mm_set1_ps( tw->start[1] + tw->sphere.offset[1] ) );
+		sz = CM_Select4( mask, _mm_set1_ps( tw->start[2] - tw->sphere.offset[2] ), _mm_set1_ps( tw->start[2] + tw->sphere.offset[2] ) );
+		if ( d2 ) {
+			ex = CM_Select4( mask, _mm_set1_ps( tw->end[0] - tw->sphere.offset[0] ), _mm_set1_ps( tw->end[0] + tw->sphere.offset[0] ) );
+			ey = CM_Select4( mask, _mm_set1_ps( tw->end[1] - tw->sphere.offset[1] ), _mm_set1_ps( tw->end[1] + tw->sphere.offset[1] ) );
+			ez = CM_Select4( mask, _mm_set1_ps( tw->end[2] - tw->sphere.offset[2] ), _mm_set1_ps( tw->end[2] + tw->sphere.offset[2] ) );
+		}
+	} else {
+		// adjust the plane distance apropriately for mins/maxs,
+		// the corner is picked by the signbits of the normal
+		dist = CM_Dot4(
+			CM_Select4( _mm_cmplt_ps( nx, zero ), _mm_set1_ps( tw->size[1][0] ), _mm_set1_ps( tw->size[0][0] ) ),
+			CM_Select4( _mm_cmplt_ps( ny, zero ), _mm_set1_ps( tw->size[1][1] ), _mm_set1_ps( tw->size[0][1] ) ),
+			CM_Select4( _mm_cmplt_ps( nz, zero ), _mm_set1_ps( tw->size[1][2] ), _mm_set1_ps( tw->size[0][2] ) ),
+			nx, ny, nz );
+		dist = _mm_sub_ps( _mm_loadu_ps( g->dist ), dist );
+
+		sx = _mm_set1_ps( tw->start[0] );
+		sy = _mm_set1_ps( tw->start[1] );
+		sz = _mm_set1_ps( tw->start[2] );
+		ex = _mm_set1_ps( tw->end[0] );
+		ey = _mm_set1_ps( tw->end[1] );
+		ez = _mm_set1_ps( tw->end[2] );
+	}
+
+	*d1 = _mm_sub_ps( CM_Dot4( sx, sy, sz, nx, ny, nz ), dist );
+	if ( d2 ) {
+		*d2 = _mm_sub_ps( CM_Dot4( ex, ey, ez, nx, ny, nz ), dist );
+	}
+}
+
+/*
+================
+CM_TestBoxInSides4
+
+qtrue if the start is in front of one of the non axial sides
+================
+*/
+static qboolean CM_TestBoxInSides4( const traceWork_t *tw, const cbrush_t *brush ) {
+	const cbrushsides4_t	*g;
+	__m128		d1;
+	int			i, groups, lanes;
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder
+	groups = ( brush->numsides + 3 ) >> 2;
+	lanes = 12;		// sides 6 and 7
+	for ( i = 1, g = brush->sides4 + 1 ; i < groups ; i++, g++ ) {
+		CM_Sides4Distances( tw, g, &d1, NULL );
+		if ( _mm_movemask_ps( _mm_cmpgt_ps( d1, _mm_setzero_ps() ) ) & lanes ) {
+			return qtrue;
+		}
+		lanes = 15;
+	}
+	return qfalse;
+}
+
+/*
+================
+CM_TraceThroughSides4
+
+Returns qfalse if the trace is completely in front of one of the sides
+================
+*/
+static qboolean CM_TraceThroughSides4( const traceWork_t *tw, const cbrush_t *brush,
+	float *enterFrac, float *leaveFrac, cbrushside_t **leadside, qboolean *getout, qboolean *startout ) {
+	const cbrushsides4_t	*g;
+	__m128		d1, d2, zero;
+	int			i, j, groups, crosses;
+	float		d1s[4], d2s[4];
+	float		f;
+
+	zero = _mm_setzero_ps();
+	groups = ( brush->numsides + 3 ) >> 2;
+	for ( i = 0, g = brush->sides4 ; i < groups ; i++, g++ ) {
+		CM_Sides4Distances( tw, g, &d1, &d2 );
+
+		// if completely in front of face, no intersection with the entire brush
+		if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( d1, zero ),
+			_mm_or_ps( _mm_cmpge_ps( d2, _mm_set1_ps( SURFACE_CLIP_EPSILON ) ), _mm_cmpge_ps( d2, d1 ) ) ) ) ) {
+			return qfalse;
+		}
+
+		if ( _mm_movemask_ps( _mm_cmpgt_ps( d2, zero ) ) ) {
+			*getout = qtrue;	// endpoint is not in solid
+		}
+		if ( _mm_movemask_ps( _mm_cmpgt_ps( d1, zero ) ) ) {
+			*startout = qtrue;
+		}
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		crosses = _mm_movemask_ps( _mm_or_ps( _mm_cmpgt_ps( d1, zero ), _mm_cmpgt_ps( d2, zero ) ) );
+		if ( !crosses ) {
+			continue;
+		}
+
+		_mm_storeu_ps( d1s, d1 );
+		_mm_storeu_ps( d2s, d2 );
+		for ( j = 0 ; j < 4 ; j++ ) {
+			if ( !( crosses & ( 1 << j ) ) ) {
+				continue;
+			}
+
+			// crosses face
+			if (d1s[j] > d2s[j]) {	// enter
+				f = (d1s[j]-SURFACE_CLIP_EPSILON) / (d1s[j]-d2s[j]);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if (f > *enterFrac) {
+					*enterFrac = f;
+					*leadside = brush->sides + i * 4 + j;
+				}
+			} else {	// leave
+				f = (d1s[j]+SURFACE_CLIP_EPSILON) / (d1s[j]-d2s[j]);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if (f < *leaveFrac) {
+					*leaveFrac = f;
+				}
+			}
+		}
+	}
+	return qtrue;
+}
+#endif
+
 /*
 ===============================================================================
 
@@ -185,6 +378,13 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
+#if idsse2
+	if ( brush->sides4 ) {
+		if ( CM_TestBoxInSides4( tw, brush ) ) {
+			return;
+		}
+	} else
+#endif
    if ( tw->sphere.use ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -245,17 +445,28 @@ CM_TestInLeaf
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	cmThread_t	*thread;
+
+	thread = tw->thread;
+	if ( leaf == &thread->boxModel.leaf ) {
+		// CM_TempBoxModel
+		if ( thread->boxBrush.contents & tw->contents ) {
+			CM_TestBoxInBrush( tw, &thread->boxBrush );
+		}
+		return;
+	}
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if (thread->brushChecks[brushnum] == thread->checkcount) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		thread->brushChecks[brushnum] = thread->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -274,14 +485,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( thread->patchChecks[surfnum] == thread->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			thread->patchChecks[surfnum] = thread->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -431,12 +643,10 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
 
-	cm.checkcount++;
+	tw->thread->checkcount++;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -510,6 +720,16 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 	leadside = NULL;
 
+#if idsse2
+	if ( brush->sides4 ) {
+		if ( !CM_TraceThroughSides4( tw, brush, &enterFrac, &leaveFrac, &leadside, &getout, &startout ) ) {
+			return;
+		}
+		if ( leadside ) {
+			clipplane = leadside->plane;
+		}
+	} else
+#endif
 	if ( tw->sphere.use ) {
 		//
 		// compare the trace against all planes of the brush
@@ -668,18 +888,31 @@ CM_TraceThroughLeaf
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	cmThread_t	*thread;
+
+	thread = tw->thread;
+	if ( leaf == &thread->boxModel.leaf ) {
+		// CM_TempBoxModel
+		b = &thread->boxBrush;
+		if ( ( b->contents & tw->contents ) && CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+					b->bounds[0], b->bounds[1] ) ) {
+			CM_TraceThroughBrush( tw, b );
+		}
+		return;
+	}
 
 	// trace line against all brushes in the leaf
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( thread->brushChecks[brushnum] == thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		thread->brushChecks[brushnum] = thread->checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -703,14 +936,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( thread->patchChecks[surfnum] == thread->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			thread->patchChecks[surfnum] = thread->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1151,12 +1385,12 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
+	tw.thread = CM_GetThread();
+	tw.thread->checkcount++;	// for multi-check avoidance
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
 
@@ -1465,3 +1699,429 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+#ifndef BSPC
+/*
+===============================================================================
+
+STRESS TEST
+
+===============================================================================
+*/
+
+#define	MAX_STRESS_THREADS	16
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		boxMins, boxMaxs;	// CM_TempBoxModel when model is BOX_MODEL_HANDLE
+	vec3_t		origin;
+	clipHandle_t	model;
+	int			capsule;
+} cmStressTrace_t;
+
+typedef struct {
+	const cmStressTrace_t	*traces;
+	const trace_t	*expected;
+	int			numTraces;
+	int			first;				// every thread starts somewhere else
+	int			mismatches;
+} cmStressThread_t;
+
+/*
+==================
+CM_StressRandom
+==================
+*/
+static float CM_StressRandom( unsigned *seed, float min, float max ) {
+	*seed = *seed * 1103515245 + 12345;
+	return min + ( max - min ) * ( ( *seed >> 8 ) & 0xffff ) / 65535.0f;
+}
+
+/*
+==================
+CM_StressRun
+==================
+*/
+static void CM_StressRun( const cmStressTrace_t *t, trace_t *trace ) {
+	clipHandle_t	model;
+
+	model = t->model;
+	if ( model == BOX_MODEL_HANDLE ) {
+		model = CM_TempBoxModel( t->boxMins, t->boxMaxs, qfalse );
+	}
+	CM_TransformedBoxTrace( trace, t->start, t->end, (float *)t->mins, (float *)t->maxs,
+		model, CONTENTS_SOLID | CONTENTS_PLAYERCLIP | CONTENTS_BODY, t->origin, vec3_origin, t->capsule );
+}
+
+/*
+==================
+CM_StressSame
+==================
+*/
+static qboolean CM_StressSame( const trace_t *a, const trace_t *b ) {
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->fraction == b->fraction && VectorCompare( a->endpos, b->endpos )
+		&& VectorCompare( a->plane.normal, b->plane.normal )
+		&& a->plane.dist == b->plane.dist && a->surfaceFlags == b->surfaceFlags
+		&& a->contents == b->contents;
+}
+
+/*
+==================
+CM_StressThread
+==================
+*/
+static void CM_StressThread( void *arg ) {
+	cmStressThread_t	*st;
+	trace_t		trace;
+	int			i, n;
+
+	st = arg;
+	for ( i = 0 ; i < st->numTraces ; i++ ) {
+		n = ( st->first + i ) % st->numTraces;
+		CM_StressRun( &st->traces[n], &trace );
+		if ( !CM_StressSame( &trace, &st->expected[n] ) ) {
+			st->mismatches++;
+		}
+	}
+
+	CM_FreeThread();
+}
+
+/*
+==================
+CM_Stress_f
+
+cmstress [threads] [traces]
+
+Runs the same random traces through the loaded map serially and then
+on every thread at once, and counts the parallel results that differ.
+==================
+*/
+void CM_Stress_f( void ) {
+	cmStressThread_t	threads[MAX_STRESS_THREADS];
+	void		*handles[MAX_STRESS_THREADS];
+	cmStressTrace_t	*traces, *t;
+	trace_t		*expected;
+	int			numThreads, numTraces, numStarted;
+	int			i, j, mismatches, submodels;
+	unsigned	seed;
+	int64_t		start, serial, parallel;
+	vec3_t		mins, maxs;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	numThreads = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 4;
+	numThreads = Com_Clamp( 1, MAX_STRESS_THREADS, numThreads );
+	numTraces = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 20000;
+	if ( numTraces < 1 ) {
+		numTraces = 1;
+	}
+
+	traces = Z_Malloc( numTraces * sizeof( *traces ) );
+	expected = Z_Malloc( numTraces * sizeof( *expected ) );
+
+	// a quarter each of point traces, player boxes, capsules and
+	// boxes against a temporary box or an inline model
+	CM_ModelBounds( 0, mins, maxs );
+	submodels = CM_NumInlineModels();
+	seed = 1;
+	for ( i = 0, t = traces ; i < numTraces ; i++, t++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			t->start[j] = CM_StressRandom( &seed, mins[j], maxs[j] );
+			t->end[j] = t->start[j] + CM_StressRandom( &seed, -512, 512 );
+		}
+		if ( i & 1 ) {
+			VectorSet( t->mins, -15, -15, -24 );
+			VectorSet( t->maxs, 15, 15, 32 );
+		}
+		t->capsule = ( i & 3 ) == 2;
+		if ( ( i & 3 ) == 3 ) {
+			if ( submodels > 1 && ( i & 4 ) ) {
+				t->model = CM_InlineModel( 1 + ( i >> 3 ) % ( submodels - 1 ) );
+			} else {
+				t->model = BOX_MODEL_HANDLE;
+				VectorSet( t->boxMins, -15, -15, -24 );
+				VectorSet( t->boxMaxs, 15, 15, 32 );
+				for ( j = 0 ; j < 3 ; j++ ) {
+					t->origin[j] = t->start[j] + CM_StressRandom( &seed, -64, 64 );
+				}
+			}
+		}
+	}
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		CM_StressRun( &traces[i], &expected[i] );
+	}
+	serial = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	numStarted = 0;
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		threads[i].traces = traces;
+		threads[i].expected = expected;
+		threads[i].numTraces = numTraces;
+		threads[i].first = i * numTraces / numThreads;
+		threads[i].mismatches = 0;
+		handles[i] = Sys_CreateThread( CM_StressThread, &threads[i] );
+		if ( !handles[i] ) {
+			break;
+		}
+		numStarted++;
+	}
+	mismatches = 0;
+	for ( i = 0 ; i < numStarted ; i++ ) {
+		Sys_JoinThread( handles[i] );
+		mismatches += threads[i].mismatches;
+	}
+	parallel = Sys_Microseconds() - start;
+
+	Z_Free( traces );
+	Z_Free( expected );
+
+	if ( !numStarted ) {
+		Com_Printf( "Couldn't start a thread.\n" );
+		return;
+	}
+
+	Com_Printf( "%i traces serial: %i msec\n", numTraces, (int)( serial / 1000 ) );
+	Com_Printf( "%i traces on %i threads: %i msec, %i mismatches\n",
+		numTraces * numStarted, numStarted, (int)( parallel / 1000 ), mismatches );
+}
+
+#define	SIDES_TEST_SIDES		20
+#define	SIDES_TEST_BATCH		64		// traces per random brush
+
+/*
+==================
+CM_SidesTest_f
+
+cmsidestest [traces]
+
+Clips random traces against random convex brushes one side at a time
+and four sides at a time, and counts the results that differ.  The
+brushes are the thread's temporary box with extra sides, so this needs
+a map for CM_Trace but doesn't depend on it.
+==================
+*/
+void CM_SidesTest_f( void ) {
+#if idsse2
+	cbrushside_t	sides[SIDES_TEST_SIDES];
+	cplane_t	planes[SIDES_TEST_SIDES];
+	cbrushsides4_t	groups[( SIDES_TEST_SIDES + 3 ) / 4];
+	trace_t		expected[SIDES_TEST_BATCH], trace;
+	vec3_t		starts[SIDES_TEST_BATCH], ends[SIDES_TEST_BATCH];
+	vec3_t		mins[SIDES_TEST_BATCH], maxs[SIDES_TEST_BATCH];
+	vec3_t		boxMins, boxMaxs, center;
+	cbrush_t	*brush, saved;
+	cplane_t	*plane;
+	int			numTraces, numSides, mismatches, count;
+	int			i, j, k;
+	float		radius;
+	unsigned	seed;
+	int64_t		start, scalar, simd;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	numTraces = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+
+	brush = &CM_GetThread()->boxBrush;
+	saved = *brush;
+
+	seed = 1;
+	mismatches = 0;
+	scalar = simd = 0;
+	for ( count = 0 ; count < numTraces ; count += SIDES_TEST_BATCH ) {
+		// a box cut by random planes that pass somewhere between
+		// its center and its smallest extent
+		radius = 1024;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			center[j] = CM_StressRandom( &seed, -1024, 1024 );
+			boxMins[j] = center[j] - CM_StressRandom( &seed, 8, 256 );
+			boxMaxs[j] = center[j] + CM_StressRandom( &seed, 8, 256 );
+			if ( center[j] - boxMins[j] < radius ) {
+				radius = center[j] - boxMins[j];
+			}
+			if ( boxMaxs[j] - center[j] < radius ) {
+				radius = boxMaxs[j] - center[j];
+			}
+		}
+		CM_TempBoxModel( boxMins, boxMaxs, qfalse );
+
+		numSides = 6 + (int)CM_StressRandom( &seed, 0, SIDES_TEST_SIDES - 6 );
+		Com_Memcpy( sides, saved.sides, 6 * sizeof( sides[0] ) );
+		for ( k = 6 ; k < numSides ; k++ ) {
+			plane = &planes[k];
+			for ( j = 0 ; j < 3 ; j++ ) {
+				plane->normal[j] = CM_StressRandom( &seed, -1, 1 );
+			}
+			if ( k & 1 ) {
+				plane->normal[k % 3] = 0;
+			}
+			if ( VectorNormalize( plane->normal ) == 0 ) {
+				VectorSet( plane->normal, 0, 0, -1 );
+			}
+			plane->dist = DotProduct( plane->normal, center ) + radius * CM_StressRandom( &seed, 0.2f, 1.0f );
+			plane->type = PLANE_NON_AXIAL;
+			SetPlaneSignbits( plane );
+			sides[k].plane = plane;
+			sides[k].surfaceFlags = k;
+			sides[k].shaderNum = 0;
+		}
+
+		// points, boxes and capsules from all around it, a few of
+		// them position tests
+		for ( i = 0 ; i < SIDES_TEST_BATCH ; i++ ) {
+			for ( j = 0 ; j < 3 ; j++ ) {
+				starts[i][j] = CM_StressRandom( &seed, boxMins[j] - 64, boxMaxs[j] + 64 );
+				ends[i][j] = ( i & 7 ) ? CM_StressRandom( &seed, boxMins[j] - 64, boxMaxs[j] + 64 ) : starts[i][j];
+				maxs[i][j] = ( i & 3 ) ? CM_StressRandom( &seed, 0, 32 ) : 0;
+				mins[i][j] = -maxs[i][j];
+			}
+		}
+
+		brush->sides = sides;
+		brush->numsides = numSides;
+
+		brush->sides4 = NULL;
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < SIDES_TEST_BATCH ; i++ ) {
+			CM_BoxTrace( &expected[i], starts[i], ends[i], mins[i], maxs[i], BOX_MODEL_HANDLE, CONTENTS_BODY, i & 2 );
+		}
+		scalar += Sys_Microseconds() - start;
+
+		CM_SetBrushSides4( brush, groups );
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < SIDES_TEST_BATCH ; i++ ) {
+			CM_BoxTrace( &trace, starts[i], ends[i], mins[i], maxs[i], BOX_MODEL_HANDLE, CONTENTS_BODY, i & 2 );
+			if ( !CM_StressSame( &trace, &expected[i] ) ) {
+				mismatches++;
+			}
+		}
+		simd += Sys_Microseconds() - start;
+
+		*brush = saved;
+	}
+
+	Com_Printf( "%i traces: %i usec one side at a time, %i usec four at a time, %i mismatches\n",
+		count, (int)scalar, (int)simd, mismatches );
+#else
+	Com_Printf( "Not built with SSE2.\n" );
+#endif
+}
+
+/*
+==================
+CM_PatchTest_f
+
+cmpatchtest [traces]
+
+Traces boxes, points and capsules near the patches of the loaded map
+with and without the facet trees, and counts the results that differ.
+==================
+*/
+void CM_PatchTest_f( void ) {
+	cmStressTrace_t	*traces, *t;
+	trace_t		*expected, trace;
+	cPatch_t	**patches;
+	int			*numNodes;
+	int			numTraces, numPatches, mismatches;
+	int			i, j, facets[2];
+	unsigned	seed;
+	int64_t		start, times[2];
+	const patchCollide_t	*pc;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	numPatches = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			numPatches++;
+		}
+	}
+	if ( !numPatches ) {
+		Com_Printf( "No patches in this map.\n" );
+		return;
+	}
+
+	numTraces = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20000;
+	if ( numTraces < 1 ) {
+		numTraces = 1;
+	}
+
+	patches = Z_Malloc( numPatches * sizeof( *patches ) );
+	numNodes = Z_Malloc( numPatches * sizeof( *numNodes ) );
+	traces = Z_Malloc( numTraces * sizeof( *traces ) );
+	expected = Z_Malloc( numTraces * sizeof( *expected ) );
+
+	numPatches = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			patches[numPatches++] = cm.surfaces[i];
+		}
+	}
+
+	// from somewhere around a random patch to somewhere else around it
+	seed = 1;
+	for ( i = 0, t = traces ; i < numTraces ; i++, t++ ) {
+		pc = patches[(int)CM_StressRandom( &seed, 0, numPatches - 0.01f )]->pc;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			t->start[j] = CM_StressRandom( &seed, pc->bounds[0][j] - 64, pc->bounds[1][j] + 64 );
+			t->end[j] = ( i & 7 ) ? CM_StressRandom( &seed, pc->bounds[0][j] - 64, pc->bounds[1][j] + 64 ) : t->start[j];
+		}
+		if ( i & 1 ) {
+			VectorSet( t->mins, -15, -15, -24 );
+			VectorSet( t->maxs, 15, 15, 32 );
+		}
+		t->capsule = ( i & 3 ) == 3;
+	}
+
+	for ( j = 0 ; j < 2 ; j++ ) {
+		for ( i = 0 ; i < numPatches ; i++ ) {
+			if ( !j ) {
+				numNodes[i] = patches[i]->pc->numNodes;
+				patches[i]->pc->numNodes = 0;
+			} else {
+				patches[i]->pc->numNodes = numNodes[i];
+			}
+		}
+
+		mismatches = 0;
+		facets[j] = c_patch_facets;
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < numTraces ; i++ ) {
+			if ( !j ) {
+				CM_StressRun( &traces[i], &expected[i] );
+			} else {
+				CM_StressRun( &traces[i], &trace );
+				if ( !CM_StressSame( &trace, &expected[i] ) ) {
+					mismatches++;
+				}
+			}
+		}
+		times[j] = Sys_Microseconds() - start;
+		facets[j] = c_patch_facets - facets[j];
+	}
+
+	Z_Free( patches );
+	Z_Free( numNodes );
+	Z_Free( traces );
+	Z_Free( expected );
+
+	Com_Printf( "%i traces near %i patches, facet tests per trace and total usec:\n", numTraces, numPatches );
+	Com_Printf( "without facet trees: %6.1f %8i\n", (float)facets[0] / numTraces, (int)times[0] );
+	Com_Printf( "with facet trees:    %6.1f %8i\n", (float)facets[1] / numTraces, (int)times[1] );
+	Com_Printf( "%i mismatches\n", mismatches );
+}
+#endif //BSPC
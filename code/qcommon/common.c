@@ -82,6 +82,8 @@ cvar_t	*com_cameraMode;
 cvar_t	*com_ansiColor;
 cvar_t	*com_unfocused;
 cvar_t	*com_minimized;
+cvar_t	*com_instances;
+cvar_t	*com_instance;
 
 // com_speeds times
 int		time_game;
@@ -180,7 +182,11 @@ void QDECL Com_Printf( const char *fmt, ... ) {
 			time( &aclock );
 			newtime = localtime( &aclock );
 
-			logfile = FS_FOpenFileWrite( "qconsole.log" );
+			if ( com_instance && com_instance->integer ) {
+				logfile = FS_FOpenFileWrite( va( "qconsole%i.log", com_instance->integer ) );
+			} else {
+				logfile = FS_FOpenFileWrite( "qconsole.log" );
+			}
 			
 			if(logfile)
 			{
@@ -192,6 +198,8 @@ void QDECL Com_Printf( const char *fmt, ... ) {
 					// data even if we are crashing
 					FS_ForceFlush(logfile);
 				}
+
+				FS_AsyncLog(logfile);
 			}
 			else
 			{
@@ -2567,6 +2575,7 @@ void Com_Init( char *commandLine ) {
 
 	com_developer = Cvar_Get ("developer", "0", CVAR_TEMP );
 	com_logfile = Cvar_Get ("logfile", "0", CVAR_TEMP );
+	AsyncLog_Init();
 
 	com_timescale = Cvar_Get ("timescale", "1", CVAR_CHEAT | CVAR_SYSTEMINFO );
 	com_fixedtime = Cvar_Get ("fixedtime", "0", CVAR_CHEAT);
@@ -2590,6 +2599,9 @@ void Com_Init( char *commandLine ) {
 
 	com_introPlayed = Cvar_Get( "com_introplayed", "0", CVAR_ARCHIVE);
 
+	com_instances = Cvar_Get( "com_instances", "1", CVAR_INIT );
+	com_instance = Cvar_Get( "com_instance", "0", CVAR_ROM );
+
 	if ( com_developer && com_developer->integer ) {
 		Cmd_AddCommand ("error", Com_Error_f);
 		Cmd_AddCommand ("crash", Com_Crash_f );
@@ -2688,6 +2700,12 @@ void Com_WriteConfiguration( void ) {
 	}
 	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
 
+	// forked server instances share the home path, only the first
+	// one owns q3config.cfg
+	if ( com_instance && com_instance->integer ) {
+		return;
+	}
+
 	Com_WriteConfigToFile( "q3config.cfg" );
 
 	// not needed for dedicated
@@ -2920,14 +2938,16 @@ void Com_Frame( void ) {
 	//
 	if ( com_showtrace->integer ) {
 	
-		extern	int c_traces, c_brush_traces, c_patch_traces;
-		extern	int	c_pointcontents;
+		extern	THREAD_LOCAL int c_traces, c_brush_traces, c_patch_traces;
+		extern	THREAD_LOCAL int	c_patch_facets;
+		extern	THREAD_LOCAL int	c_pointcontents;
 
-		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
-			c_brush_traces, c_patch_traces, c_pointcontents);
+		Com_Printf ("%4i traces  (%ib %ip %if) %4i points\n", c_traces,
+			c_brush_traces, c_patch_traces, c_patch_facets, c_pointcontents);
 		c_traces = 0;
 		c_brush_traces = 0;
 		c_patch_traces = 0;
+		c_patch_facets = 0;
 		c_pointcontents = 0;
 	}
 
@@ -2953,6 +2973,49 @@ void Com_Shutdown (void) {
 		com_journalFile = 0;
 	}
 
+	AsyncLog_Shutdown();
+
+}
+
+/*
+=================
+Com_SetInstance
+
+Called in a dedicated server forked by Sys_SpawnInstances, before the
+network is opened.  The instance gets its own port and qconsole<n>.log,
+and instance<n>.cfg runs now, ahead of the command line commands.
+=================
+*/
+void Com_SetInstance( int instance, int port ) {
+	int		i;
+
+	// the parent flushed before forking, so closing our copy
+	// doesn't write anything twice
+	if ( logfile ) {
+		FS_FCloseFile( logfile );
+		logfile = 0;
+	}
+
+	// the command line's net_port is the base port and was applied before
+	// the fork, queueing it again would latch it over the instance's own
+	for ( i = 0 ; i < com_numConsoleLines ; i++ ) {
+		Cmd_TokenizeString( com_consoleLines[i] );
+		if ( !Q_stricmpn( Cmd_Argv(0), "set", 3 )
+			&& !Q_stricmp( Cmd_Argv(1), "net_port" ) ) {
+			com_consoleLines[i][0] = 0;
+		}
+	}
+
+	// both are ROM or LATCH, the network isn't open yet so take them now
+	Cvar_Set2( "com_instance", va( "%i", instance ), qtrue );
+	Cvar_Set2( "net_port", va( "%i", port ), qtrue );
+
+	// drop the startup commands Com_Init queued and run instance<n>.cfg
+	// ahead of them, latched net cvars it sets are picked up by NET_Init
+	Cbuf_Init();
+	Cbuf_AddText( va( "exec instance%i.cfg\n", instance ) );
+	Cbuf_Execute();
+	Com_AddStartupCommands();
 }
 
 //------------------------------------------------------------------------
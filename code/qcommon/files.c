@@ -32,6 +32,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 #include "unzip.h"
+#ifndef _WIN32
+#include <unistd.h>	// getpid
+#else
+#include <process.h>
+#endif
 
 /*
 =============================================================================
@@ -223,6 +228,9 @@ typedef struct {
 	int				hashSize;					// hash table size (power of 2)
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	const byte		*map;						// whole pk3 mapped read only, or NULL
+	int				mapLength;
+	int				mapRefs;					// FS_MapFile buffers pointing into map
 } pack_t;
 
 typedef struct {
@@ -235,10 +243,13 @@ typedef struct searchpath_s {
 
 	pack_t		*pack;		// only one of pack / dir will be non NULL
 	directory_t	*dir;
+	int			order;		// place in fs_searchpaths, for the file index
 } searchpath_t;
 
 static	char		fs_gamedir[MAX_OSPATH];	// this will be a single file name with no separators
 static	cvar_t		*fs_debug;
+static	cvar_t		*fs_mmap;
+static	cvar_t		*fs_pk3cache;
 static	cvar_t		*fs_homepath;
 
 #ifdef MACOS_X
@@ -255,6 +266,18 @@ static	int			fs_loadCount;			// total files read
 static	int			fs_loadStack;			// total files in memory
 static	int			fs_packFiles;			// total number of files in packs
 
+// buffers handed out by FS_MapFile that point into a pk3 mapping
+#define	MAX_MAPPED_FILES	64
+
+typedef struct {
+	const void	*data;
+	pack_t		*pak;		// NULL once the pak is gone
+	const byte	*map;		// the pak mapping, the last buffer out unmaps it
+	int			mapLength;
+} fsMappedFile_t;
+
+static	fsMappedFile_t	fs_mappedFiles[MAX_MAPPED_FILES];
+
 static int fs_fakeChkSum;
 static int fs_checksumFeed;
 
@@ -276,6 +299,8 @@ typedef struct {
 	int			zipFilePos;
 	qboolean	zipFile;
 	qboolean	streamed;
+	int			asyncLog;		// AsyncLog channel, the FILE belongs to the log thread
+	pack_t		*pak;			// mapped pk3 the zip file is read from, or NULL
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
 
@@ -373,6 +398,364 @@ static long FS_HashFileName( const char *fname, int hashSize ) {
 	return hash;
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+Every file of every pk3 goes in one hash table once the search path is
+in its final order.  A name leads to all the paks that hold it, best
+first, so a lookup hashes it once instead of once per pak.  Directories
+can't be listed ahead of time, they are still probed with fopen in their
+place in the search order.
+
+On a pure server, names that are in no pak and no directory are kept
+in a miss cache, so looking for them again costs nothing.  It is emptied
+by FS_Restart and whenever the engine writes or renames a file.  The
+files a pure server still reads from directories (configs, demos) are
+never kept there, those are the ones someone may drop in while the
+server runs.  Unpure servers read any loose file, so nothing is kept.
+
+=============================================================================
+*/
+
+#define	FS_MISS_HASH		1024
+#define	FS_MAX_MISSES		4096
+
+typedef struct fsIndexFile_s {
+	fileInPack_t			*file;
+	searchpath_t			*search;
+	unsigned				hash;
+	struct fsIndexFile_s	*nextPak;		// the same name in a later pak
+	struct fsIndexFile_s	*next;			// hash chain, first pak of every name
+} fsIndexFile_t;
+
+typedef struct fsMiss_s {
+	struct fsMiss_s			*next;
+	unsigned				hash;
+	char					name[1];		// variable sized
+} fsMiss_t;
+
+typedef struct {
+	fsIndexFile_t	*pak;			// next pak holding the name
+	int				dir;			// next one in fs_index.dirs
+	qboolean		held;			// some pak holds the name
+	qboolean		missing;		// answered by the miss cache
+	unsigned		hash;
+} fsIndexCursor_t;
+
+static struct {
+	int				numFiles;
+	fsIndexFile_t	*files;
+	int				hashSize;		// power of 2
+	fsIndexFile_t	**hashTable;
+
+	int				numDirs;
+	searchpath_t	**dirs;			// in search order
+
+	int				numMisses;
+	fsMiss_t		*misses[FS_MISS_HASH];
+
+	// kept across restarts
+	int				lookups;
+	int				pakHits;
+	int				dirHits;
+	int				notFound;
+	int				missHits;		// answered by the miss cache
+	int				dirProbes;		// fopen calls
+} fs_index;
+
+/*
+================
+FS_IndexHash
+
+Case and separator insensitive like FS_FilenameCompare, and unlike
+FS_HashFileName it doesn't stop at the extension
+================
+*/
+static unsigned FS_IndexHash( const char *name ) {
+	unsigned	hash;
+	int			c;
+
+	hash = 2166136261u;
+	while ( ( c = *name++ ) != 0 ) {
+		if ( c >= 'a' && c <= 'z' ) {
+			c -= ( 'a' - 'A' );
+		}
+		if ( c == '\\' || c == ':' ) {
+			c = '/';
+		}
+		hash = ( hash ^ c ) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+================
+FS_ForgetMisses
+
+Something may exist now that didn't before
+================
+*/
+static void FS_ForgetMisses( void ) {
+	fsMiss_t	*miss, *next;
+	int			i;
+
+	if ( !fs_index.numMisses ) {
+		return;
+	}
+	for ( i = 0 ; i < FS_MISS_HASH ; i++ ) {
+		for ( miss = fs_index.misses[i] ; miss ; miss = next ) {
+			next = miss->next;
+			Z_Free( miss );
+		}
+		fs_index.misses[i] = NULL;
+	}
+	fs_index.numMisses = 0;
+}
+
+/*
+================
+FS_LooseFileAllowed
+
+The files that still come from directories on a pure server
+================
+*/
+static qboolean FS_LooseFileAllowed( const char *filename ) {
+	char	demoExt[16];
+	int		l;
+
+	Com_sprintf( demoExt, sizeof( demoExt ), ".dm_%d", PROTOCOL_VERSION );
+	l = strlen( filename );
+
+	return !Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+		|| !Q_stricmp( filename + l - 5, ".menu" )		// menu files
+		|| !Q_stricmp( filename + l - 5, ".game" )		// menu files
+		|| !Q_stricmp( filename + l - strlen( demoExt ), demoExt )	// menu files
+		|| !Q_stricmp( filename + l - 4, ".dat" );		// for journal files
+}
+
+/*
+================
+FS_IsMissing
+================
+*/
+static qboolean FS_IsMissing( const char *filename, unsigned hash ) {
+	fsMiss_t	*miss;
+
+	for ( miss = fs_index.misses[hash & ( FS_MISS_HASH - 1 )] ; miss ; miss = miss->next ) {
+		if ( miss->hash == hash && !FS_FilenameCompare( miss->name, filename ) ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+/*
+================
+FS_AddMiss
+================
+*/
+static void FS_AddMiss( const char *filename, unsigned hash ) {
+	fsMiss_t	*miss;
+	int			bucket;
+
+	if ( !fs_numServerPaks || FS_LooseFileAllowed( filename ) ) {
+		return;
+	}
+	if ( fs_index.numMisses >= FS_MAX_MISSES ) {
+		FS_ForgetMisses();
+	}
+
+	miss = Z_Malloc( sizeof( *miss ) + strlen( filename ) );
+	strcpy( miss->name, filename );
+	miss->hash = hash;
+	bucket = hash & ( FS_MISS_HASH - 1 );
+	miss->next = fs_index.misses[bucket];
+	fs_index.misses[bucket] = miss;
+	fs_index.numMisses++;
+}
+
+/*
+================
+FS_IndexPak
+
+Walks the hash chains of the pak, so if it holds a name twice the
+entry that FS_FOpenFileRead used to find is the one indexed
+================
+*/
+static void FS_IndexPak( searchpath_t *search ) {
+	pack_t			*pak;
+	fileInPack_t	*pakFile;
+	fsIndexFile_t	*file, *other;
+	int				i;
+
+	pak = search->pack;
+	for ( i = 0 ; i < pak->hashSize ; i++ ) {
+		for ( pakFile = pak->hashTable[i] ; pakFile ; pakFile = pakFile->next ) {
+			file = &fs_index.files[fs_index.numFiles++];
+			file->file = pakFile;
+			file->search = search;
+			file->hash = FS_IndexHash( pakFile->name );
+
+			for ( other = fs_index.hashTable[file->hash & ( fs_index.hashSize - 1 )] ; other ; other = other->next ) {
+				if ( other->hash == file->hash && !FS_FilenameCompare( other->file->name, pakFile->name ) ) {
+					break;
+				}
+			}
+			if ( other ) {
+				while ( other->search != search && other->nextPak ) {
+					other = other->nextPak;
+				}
+				if ( other->search == search ) {
+					// only the first copy in a pak was ever opened
+					fs_index.numFiles--;
+					continue;
+				}
+				other->nextPak = file;
+			} else {
+				file->next = fs_index.hashTable[file->hash & ( fs_index.hashSize - 1 )];
+				fs_index.hashTable[file->hash & ( fs_index.hashSize - 1 )] = file;
+			}
+		}
+	}
+}
+
+/*
+================
+FS_BuildIndex
+
+Called once fs_searchpaths won't change anymore
+================
+*/
+static void FS_BuildIndex( void ) {
+	searchpath_t	*search;
+	int				numFiles, order;
+
+	numFiles = 0;
+	fs_index.numDirs = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		} else {
+			fs_index.numDirs++;
+		}
+	}
+
+	for ( fs_index.hashSize = 1 ; fs_index.hashSize < numFiles ; fs_index.hashSize <<= 1 ) {
+	}
+	fs_index.files = Z_Malloc( ( numFiles ? numFiles : 1 ) * sizeof( *fs_index.files ) );
+	fs_index.hashTable = Z_Malloc( fs_index.hashSize * sizeof( *fs_index.hashTable ) );
+	fs_index.dirs = Z_Malloc( ( fs_index.numDirs ? fs_index.numDirs : 1 ) * sizeof( *fs_index.dirs ) );
+	fs_index.numFiles = 0;
+	fs_index.numDirs = 0;
+
+	order = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		search->order = order++;
+		if ( search->pack ) {
+			FS_IndexPak( search );
+		} else {
+			fs_index.dirs[fs_index.numDirs++] = search;
+		}
+	}
+}
+
+/*
+================
+FS_FreeIndex
+================
+*/
+static void FS_FreeIndex( void ) {
+	FS_ForgetMisses();
+	if ( fs_index.files ) {
+		Z_Free( fs_index.files );
+		Z_Free( fs_index.hashTable );
+		Z_Free( fs_index.dirs );
+	}
+	fs_index.files = NULL;
+	fs_index.hashTable = NULL;
+	fs_index.dirs = NULL;
+	fs_index.numFiles = 0;
+	fs_index.numDirs = 0;
+}
+
+/*
+================
+FS_IndexNext
+
+Merges the paks holding the name with the directories, in search order
+================
+*/
+static searchpath_t *FS_IndexNext( fsIndexCursor_t *cursor, fileInPack_t **pakFile ) {
+	searchpath_t	*dir;
+	searchpath_t	*search;
+
+	dir = cursor->dir < fs_index.numDirs ? fs_index.dirs[cursor->dir] : NULL;
+	if ( cursor->pak && ( !dir || cursor->pak->search->order < dir->order ) ) {
+		*pakFile = cursor->pak->file;
+		search = cursor->pak->search;
+		cursor->pak = cursor->pak->nextPak;
+		return search;
+	}
+	if ( dir ) {
+		*pakFile = NULL;
+		cursor->dir++;
+		return dir;
+	}
+	return NULL;
+}
+
+/*
+================
+FS_IndexFirst
+
+Returns the first search path that may have the file, the pak entry
+is in *pakFile for paks.  NULL when the miss cache knows it is nowhere.
+================
+*/
+static searchpath_t *FS_IndexFirst( const char *filename, fsIndexCursor_t *cursor, fileInPack_t **pakFile ) {
+	fsIndexFile_t	*file;
+	unsigned		hash;
+
+	fs_index.lookups++;
+
+	hash = FS_IndexHash( filename );
+	cursor->hash = hash;
+	cursor->pak = NULL;
+	cursor->dir = fs_index.numDirs;
+	cursor->held = qfalse;
+	cursor->missing = FS_IsMissing( filename, hash );
+	if ( cursor->missing ) {
+		fs_index.missHits++;
+		return NULL;
+	}
+
+	for ( file = fs_index.hashTable[hash & ( fs_index.hashSize - 1 )] ; file ; file = file->next ) {
+		if ( file->hash == hash && !FS_FilenameCompare( file->file->name, filename ) ) {
+			break;
+		}
+	}
+	cursor->pak = file;
+	cursor->dir = 0;
+	cursor->held = ( file != NULL );
+	return FS_IndexNext( cursor, pakFile );
+}
+
+/*
+================
+FS_IndexNotFound
+
+probed is qfalse if some directory was skipped
+================
+*/
+static void FS_IndexNotFound( const char *filename, fsIndexCursor_t *cursor, qboolean probed ) {
+	fs_index.notFound++;
+	if ( probed && !cursor->missing && !cursor->held ) {
+		FS_AddMiss( filename, cursor->hash );
+	}
+}
+
 static fileHandle_t	FS_HandleForFile(void) {
 	int		i;
 
@@ -402,10 +785,31 @@ static FILE	*FS_FileForHandle( fileHandle_t f ) {
 void	FS_ForceFlush( fileHandle_t f ) {
 	FILE *file;
 
+	if ( fsh[f].asyncLog ) {
+		AsyncLog_SetSync( fsh[f].asyncLog, qtrue );
+		return;
+	}
+
 	file = FS_FileForHandle(f);
 	setvbuf( file, NULL, _IONBF, 0 );
 }
 
+/*
+================
+FS_AsyncLog
+================
+*/
+void	FS_AsyncLog( fileHandle_t f ) {
+	char	*ospath;
+
+	if ( !f || fsh[f].zipFile || fsh[f].asyncLog ) {
+		return;
+	}
+
+	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, fsh[f].name );
+	fsh[f].asyncLog = AsyncLog_Open( FS_FileForHandle( f ), ospath, fsh[f].handleSync );
+}
+
 /*
 ================
 FS_filelength
@@ -646,6 +1050,8 @@ fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
 		return 0;
 	}
 
+	FS_ForgetMisses();
+
 	Com_DPrintf( "writing to: %s\n", ospath );
 	fsh[f].handleFiles.file.o = fopen( ospath, "wb" );
 
@@ -750,6 +1156,8 @@ void FS_SV_Rename( const char *from, const char *to ) {
 		Com_Printf( "FS_SV_Rename: %s --> %s\n", from_ospath, to_ospath );
 	}
 
+	FS_ForgetMisses();
+
 	if (rename( from_ospath, to_ospath )) {
 		// Failed, try copying it and deleting the original
 		FS_CopyFile ( from_ospath, to_ospath );
@@ -782,6 +1190,8 @@ void FS_Rename( const char *from, const char *to ) {
 		Com_Printf( "FS_Rename: %s --> %s\n", from_ospath, to_ospath );
 	}
 
+	FS_ForgetMisses();
+
 	if (rename( from_ospath, to_ospath )) {
 		// Failed, try copying it and deleting the original
 		FS_CopyFile ( from_ospath, to_ospath );
@@ -813,6 +1223,12 @@ void FS_FCloseFile( fileHandle_t f ) {
 		return;
 	}
 
+	if ( fsh[f].asyncLog ) {
+		AsyncLog_Close( fsh[f].asyncLog );
+		Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+		return;
+	}
+
 	// we didn't find it as a pak, so close it as a unique file
 	if (fsh[f].handleFiles.file.o) {
 		fclose (fsh[f].handleFiles.file.o);
@@ -847,6 +1263,8 @@ fileHandle_t FS_FOpenFileWrite( const char *filename ) {
 		return 0;
 	}
 
+	FS_ForgetMisses();
+
 	// enabling the following line causes a recursive function call loop
 	// when running with +set logfile 1 +set developer 1
 	//Com_DPrintf( "writing to: %s\n", ospath );
@@ -893,6 +1311,8 @@ fileHandle_t FS_FOpenFileAppend( const char *filename ) {
 		return 0;
 	}
 
+	FS_ForgetMisses();
+
 	fsh[f].handleFiles.file.o = fopen( ospath, "ab" );
 	fsh[f].handleSync = qfalse;
 	if (!fsh[f].handleFiles.file.o) {
@@ -951,17 +1371,15 @@ extern qboolean		com_fullyInitialized;
 
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
 	searchpath_t	*search;
+	fsIndexCursor_t	cursor;
 	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
 	directory_t		*dir;
-	long			hash;
 	unz_s			*zfi;
 	FILE			*temp;
 	int				l;
-	char demoExt[16];
-
-	hash = 0;
+	qboolean		probed;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -969,36 +1387,27 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 
 	if ( file == NULL ) {
 		// just wants to see if file is there
-		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			//
-			if ( search->pack ) {
-				hash = FS_HashFileName(filename, search->pack->hashSize);
-			}
+		for ( search = FS_IndexFirst( filename, &cursor, &pakFile ) ; search ; search = FS_IndexNext( &cursor, &pakFile ) ) {
 			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[hash] ) {
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while(pakFile != NULL);
+			if ( pakFile ) {
+				// found it!
+				fs_index.pakHits++;
+				return qtrue;
 			} else if ( search->dir ) {
 				dir = search->dir;
 			
 				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+				fs_index.dirProbes++;
 				temp = fopen (netpath, "rb");
 				if ( !temp ) {
 					continue;
 				}
 				fclose(temp);
+				fs_index.dirHits++;
 				return qtrue;
 			}
 		}
+		FS_IndexNotFound( filename, &cursor, qtrue );
 		return qfalse;
 	}
 
@@ -1006,7 +1415,6 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
 	}
 
-	Com_sprintf (demoExt, sizeof(demoExt), ".dm_%d",PROTOCOL_VERSION );
 	// qpaths are not supposed to have a leading slash
 	if ( filename[0] == '/' || filename[0] == '\\' ) {
 		filename++;
@@ -1034,123 +1442,105 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 	*file = FS_HandleForFile();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
+	probed = qtrue;
+	for ( search = FS_IndexFirst( filename, &cursor, &pakFile ) ; search ; search = FS_IndexNext( &cursor, &pakFile ) ) {
 		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
+		if ( pakFile ) {
 			// disregard if it doesn't match one of the allowed pure pak files
 			if ( !FS_PakIsPure(search->pack) ) {
 				continue;
 			}
 
-			// look through all the pak file elements
+			// found it!
 			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as 
-					// these are loaded from all pk3s 
-					// from every pk3 file.. 
-					l = strlen( filename );
-					if ( !(pak->referenced & FS_GENERAL_REF)) {
-						if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
-							Q_stricmp(filename + l - 4, ".txt") != 0 &&
-							Q_stricmp(filename + l - 4, ".cfg") != 0 &&
-							Q_stricmp(filename + l - 7, ".config") != 0 &&
-							strstr(filename, "levelshots") == NULL &&
-							Q_stricmp(filename + l - 4, ".bot") != 0 &&
-							Q_stricmp(filename + l - 6, ".arena") != 0 &&
-							Q_stricmp(filename + l - 5, ".menu") != 0) {
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
+			fs_index.pakHits++;
 
-					if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "qagame.qvm")) {
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
-						pak->referenced |= FS_UI_REF;
-					}
+			// mark the pak as having been referenced and mark specifics on cgame and ui
+			// shaders, txt, arena files  by themselves do not count as a reference as 
+			// these are loaded from all pk3s 
+			// from every pk3 file.. 
+			l = strlen( filename );
+			if ( !(pak->referenced & FS_GENERAL_REF)) {
+				if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
+					Q_stricmp(filename + l - 4, ".txt") != 0 &&
+					Q_stricmp(filename + l - 4, ".cfg") != 0 &&
+					Q_stricmp(filename + l - 7, ".config") != 0 &&
+					strstr(filename, "levelshots") == NULL &&
+					Q_stricmp(filename + l - 4, ".bot") != 0 &&
+					Q_stricmp(filename + l - 6, ".arena") != 0 &&
+					Q_stricmp(filename + l - 5, ".menu") != 0) {
+					pak->referenced |= FS_GENERAL_REF;
+				}
+			}
 
-					if ( uniqueFILE ) {
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
-						if (fsh[*file].handleFiles.file.z == NULL) {
-							Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
-						}
-					} else {
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-					fsh[*file].zipFile = qtrue;
-					zfi = (unz_s *)fsh[*file].handleFiles.file.z;
-					// in case the file was new
-					temp = zfi->file;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
-					// copy the file info into the unzip structure
-					Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
-					// we copy this back into the structure
-					zfi->file = temp;
-					// open the file in the zip
-					unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if ( fs_debug->integer ) {
-						Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
-							filename, pak->pakFilename );
-					}
-					return zfi->cur_file_info.uncompressed_size;
+			if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "qagame.qvm")) {
+				pak->referenced |= FS_QAGAME_REF;
+			}
+			if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
+				pak->referenced |= FS_CGAME_REF;
+			}
+			if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
+				pak->referenced |= FS_UI_REF;
+			}
+
+			if ( uniqueFILE ) {
+				// open a new file on the pakfile
+				fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
+				if (fsh[*file].handleFiles.file.z == NULL) {
+					Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
 				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+			} else {
+				fsh[*file].handleFiles.file.z = pak->handle;
+			}
+			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+			fsh[*file].zipFile = qtrue;
+			fsh[*file].pak = pak->map ? pak : NULL;
+			zfi = (unz_s *)fsh[*file].handleFiles.file.z;
+			// in case the file was new
+			temp = zfi->file;
+			// set the file position in the zip file (also sets the current file info)
+			unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
+			// copy the file info into the unzip structure
+			Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
+			// we copy this back into the structure
+			zfi->file = temp;
+			// open the file in the zip
+			unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
+			fsh[*file].zipFilePos = pakFile->pos;
+
+			if ( fs_debug->integer ) {
+				Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
+					filename, pak->pakFilename );
+			}
+			return zfi->cur_file_info.uncompressed_size;
 		} else if ( search->dir ) {
 			// check a file in the directory tree
 
 			// if we are running restricted, the only files we
 			// will allow to come from the directory are .cfg files
-			l = strlen( filename );
 			// FIXME TTimo I'm not sure about the fs_numServerPaks test
 			// if you are using FS_ReadFile to find out if a file exists,
 			//   this test can make the search fail although the file is in the directory
 			// I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
 			// turned out I used FS_FileExists instead
-			if ( fs_numServerPaks ) {
-
-				if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-					&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-					&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-					&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-					&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
-					continue;
-				}
+			if ( fs_numServerPaks && !FS_LooseFileAllowed( filename ) ) {
+				probed = qfalse;
+				continue;
 			}
 
 			dir = search->dir;
 			
 			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+			fs_index.dirProbes++;
 			fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
 			if ( !fsh[*file].handleFiles.file.o ) {
 				continue;
 			}
 
-			if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-				&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-				&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-				&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-				&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+			if ( !FS_LooseFileAllowed( filename ) ) {
 				fs_fakeChkSum = random();
 			}
+			fs_index.dirHits++;
 
 			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
 			fsh[*file].zipFile = qfalse;
@@ -1163,6 +1553,8 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 		}		
 	}
 	
+	FS_IndexNotFound( filename, &cursor, probed );
+
 #ifdef FS_MISSING
 	if (missingFiles) {
 		fprintf(missingFiles, "%s\n", filename);
@@ -1240,6 +1632,10 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 			buf += read;
 		}
 		return len;
+	} else if (fsh[f].pak) {
+		// inflate or copy straight out of the mapped pk3
+		return unzReadCurrentFileFromMemory(fsh[f].handleFiles.file.z,
+			fsh[f].pak->map, fsh[f].pak->mapLength, buffer, len);
 	} else {
 		return unzReadCurrentFile(fsh[f].handleFiles.file.z, buffer, len);
 	}
@@ -1267,6 +1663,11 @@ int FS_Write( const void *buffer, int len, fileHandle_t h ) {
 		return 0;
 	}
 
+	if ( fsh[h].asyncLog ) {
+		AsyncLog_Write( fsh[h].asyncLog, buffer, len );
+		return len;
+	}
+
 	f = FS_FileForHandle(h);
 	buf = (byte *)buffer;
 
@@ -1363,6 +1764,9 @@ int FS_Seek( fileHandle_t f, long offset, int origin ) {
 				return -1;
 				break;
 		}
+	} else if ( fsh[f].asyncLog ) {
+		// only the log thread knows where the file ends
+		return -1;
 	} else {
 		FILE *file;
 		file = FS_FileForHandle(f);
@@ -1397,9 +1801,8 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 
 int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	searchpath_t	*search;
-	pack_t			*pak;
+	fsIndexCursor_t	cursor;
 	fileInPack_t	*pakFile;
-	long			hash = 0;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -1425,33 +1828,22 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	// search through the path, one element at a time
 	//
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if (search->pack) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
+	for ( search = FS_IndexFirst( filename, &cursor, &pakFile ) ; search ; search = FS_IndexNext( &cursor, &pakFile ) ) {
 		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
+		if ( pakFile ) {
 			// disregard if it doesn't match one of the allowed pure pak files
 			if ( !FS_PakIsPure(search->pack) ) {
 				continue;
 			}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if (pChecksum) {
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+			if (pChecksum) {
+				*pChecksum = search->pack->pure_checksum;
+			}
+			fs_index.pakHits++;
+			return 1;
 		}
 	}
+	fs_index.notFound++;
 	return -1;
 }
 
@@ -1573,30 +1965,130 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 }
 
 /*
-=============
-FS_FreeFile
-=============
+============
+FS_MapFile
+
+FS_ReadFile for callers that only read the data.  A file stored without
+compression in a mapped pk3 is handed out as a pointer into the mapping,
+there is no copy and no trailing 0.  Everything else is loaded like
+FS_ReadFile does.  Either way the buffer goes back through FS_FreeFile.
+============
 */
-void FS_FreeFile( void *buffer ) {
+int FS_MapFile( const char *qpath, const void **buffer ) {
+	file_in_zip_read_info_s	*info;
+	fileHandle_t	h;
+	pack_t			*pak;
+	unsigned long	pos;
+	byte			*buf;
+	int				len, i;
+
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
 	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name\n" );
 	}
-	fs_loadStack--;
 
-	Hunk_FreeTempMemory( buffer );
+	// config files may come from the journal
+	if ( strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
 	}
-}
 
-/*
-============
-FS_WriteFile
+	fs_loadCount++;
+	fs_loadStack++;
+
+	pak = fsh[h].pak;
+	if ( pak ) {
+		info = ((unz_s *)fsh[h].handleFiles.file.z)->pfile_in_zip_read;
+		pos = info ? info->pos_in_zipfile + info->byte_before_the_zipfile : 0;
+		if ( info && info->compression_method == 0 && len > 0
+			&& pos <= (unsigned long)pak->mapLength && (unsigned long)len <= pak->mapLength - pos ) {
+			for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+				if ( !fs_mappedFiles[i].data ) {
+					break;
+				}
+			}
+			if ( i < MAX_MAPPED_FILES ) {
+				fs_mappedFiles[i].data = pak->map + pos;
+				fs_mappedFiles[i].pak = pak;
+				fs_mappedFiles[i].map = pak->map;
+				fs_mappedFiles[i].mapLength = pak->mapLength;
+				pak->mapRefs++;
+				FS_FCloseFile( h );
+				*buffer = pak->map + pos;
+				return len;
+			}
+		}
+	}
+
+	buf = Hunk_AllocateTempMemory( len + 1 );
+	FS_Read( buf, len, h );
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	*buffer = buf;
+	return len;
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	fsMappedFile_t	*mapped;
+	int				i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
+
+	for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( fs_mappedFiles[i].data == buffer ) {
+			break;
+		}
+	}
+	if ( i < MAX_MAPPED_FILES ) {
+		mapped = &fs_mappedFiles[i];
+		if ( mapped->pak ) {
+			// the mapping stays, it belongs to the pak
+			mapped->pak->mapRefs--;
+		} else {
+			// the pak is gone, unmap after its last buffer
+			for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+				if ( &fs_mappedFiles[i] != mapped && fs_mappedFiles[i].map == mapped->map ) {
+					break;
+				}
+			}
+			if ( i == MAX_MAPPED_FILES ) {
+				Sys_UnmapFile( mapped->map, mapped->mapLength );
+			}
+		}
+		Com_Memset( mapped, 0, sizeof( *mapped ) );
+	} else {
+		Hunk_FreeTempMemory( buffer );
+	}
+
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
+
+/*
+============
+FS_WriteFile
 
 Filename are reletive to the quake search path
 ============
@@ -1630,9 +2122,521 @@ void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
 
 ZIP FILE LOADING
 
+Loading a pk3 takes the name, central directory position and CRC of every
+file in it.  They are kept in <fs_homepath>/fscache/pk3dirs.dat, one record
+per pk3 keyed by its path, size and modification time, so a restart reads
+one file instead of every central directory.  The pk3s that aren't in there
+are read FS_PK3_THREADS at a time, the threads only use the C library, and
+the cache is written again at the end of FS_Startup.
+
 ==========================================================================
 */
 
+#define	FS_PK3_CACHE			"fscache/pk3dirs.dat"
+#define	FS_PK3_CACHE_IDENT		(('D'<<24)+('3'<<16)+('K'<<8)+'P')
+#define	FS_PK3_CACHE_VERSION	1
+#define	FS_PK3_CACHE_ALIGN(x)	( ( (x) + 7 ) & ~7 )
+#define	FS_PK3_THREADS			4
+#define	FS_PK3_MIN_THREADED		8		// fewer missing pk3s are read in place
+
+#define	ZIP_END_OF_DIR_SIZE		22
+#define	ZIP_DIR_ENTRY_SIZE		46
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			numRecords;
+	int			length;				// of the records after the header
+} fsPk3CacheHeader_t;
+
+// followed by the path, the names, the positions and the CRCs
+typedef struct {
+	int64_t		size;
+	int64_t		mtime;
+	int			pathLength;			// with the 0, padded to 8
+	int			namesLength;		// padded to 8
+	int			numEntries;
+	int			numCrcs;
+} fsPk3CacheRecord_t;
+
+// the central directory of one pk3
+typedef struct {
+	char			path[MAX_OSPATH];
+	int64_t			size;
+	int64_t			mtime;
+	qboolean		valid;
+	qboolean		cached;			// came from the cache file
+	int				numEntries;
+	int				namesLength;
+	const char		*names;			// numEntries strings, lower case
+	const unsigned	*positions;		// in the central directory, see unzSetCurrentFileInfoPosition
+	int				numCrcs;
+	const unsigned	*crcs;			// of the files that aren't empty, for the checksums
+	void			*scanned;		// malloc block holding the above when read from the pk3
+} fsZipDir_t;
+
+typedef struct {
+	fsZipDir_t	*dirs;
+	int			numDirs;
+	int			first;
+} fsScanJob_t;
+
+static struct {
+	const byte		*map;
+	int				mapLength;
+	int				numRecords;
+	fsZipDir_t		*records;		// pointing into map
+	qboolean		*seen;			// a pk3 with the path was loaded
+
+	byte			*out;			// the new cache file, malloc
+	int				outLength;
+	int				outSize;
+	qboolean		changed;
+
+	int				hits;
+	int				scanned;
+} fs_zipCache;
+
+/*
+=================
+FS_ZipShort / FS_ZipLong
+=================
+*/
+static unsigned FS_ZipShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+static unsigned FS_ZipLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned)p[3] << 24 );
+}
+
+/*
+=================
+FS_ScanZipFile
+
+Reads the central directory of a pk3 the way unzOpen and
+unzGetCurrentFileInfo do.  Runs on the scan threads, so nothing
+but the C library is used here.
+=================
+*/
+static void FS_ScanZipFile( fsZipDir_t *zip ) {
+	FILE			*f;
+	byte			*tail, *dir, *p, *block;
+	unsigned		*positions, *crcs;
+	char			*names;
+	long			fileLength, back, i;
+	unsigned		entries, dirSize, dirOffset, nameLength, skip, offset;
+	unsigned long	centralPos, before;
+	int				n, numCrcs, namesLength;
+
+	f = fopen( zip->path, "rb" );
+	if ( !f ) {
+		return;
+	}
+
+	tail = dir = NULL;
+	if ( fseek( f, 0, SEEK_END ) || ( fileLength = ftell( f ) ) < ZIP_END_OF_DIR_SIZE ) {
+		goto done;
+	}
+
+	// the end of central directory record, behind a comment of up to 64k
+	back = fileLength < 0xffff + ZIP_END_OF_DIR_SIZE ? fileLength : 0xffff + ZIP_END_OF_DIR_SIZE;
+	tail = malloc( back );
+	if ( !tail || fseek( f, fileLength - back, SEEK_SET ) || fread( tail, back, 1, f ) != 1 ) {
+		goto done;
+	}
+	for ( i = back - ZIP_END_OF_DIR_SIZE ; i >= 0 ; i-- ) {
+		if ( FS_ZipLong( tail + i ) == 0x06054b50 ) {
+			break;
+		}
+	}
+	if ( i < 0 ) {
+		goto done;
+	}
+	p = tail + i;
+	centralPos = fileLength - back + i;
+	entries = FS_ZipShort( p + 8 );
+	dirSize = FS_ZipLong( p + 12 );
+	dirOffset = FS_ZipLong( p + 16 );
+	if ( FS_ZipShort( p + 4 ) || FS_ZipShort( p + 6 ) || entries != FS_ZipShort( p + 10 )
+		|| centralPos < (unsigned long)dirOffset + dirSize ) {
+		goto done;
+	}
+	before = centralPos - ( dirOffset + dirSize );
+
+	dir = malloc( dirSize + 1 );
+	if ( !dir || fseek( f, dirOffset + before, SEEK_SET ) || ( dirSize && fread( dir, dirSize, 1, f ) != 1 ) ) {
+		goto done;
+	}
+
+	// the names are never longer than the directory
+	block = malloc( entries * 2 * sizeof( unsigned ) + dirSize + 1 );
+	if ( !block ) {
+		goto done;
+	}
+	positions = (unsigned *)block;
+	crcs = positions + entries;
+	names = (char *)( crcs + entries );
+
+	// like the unz_s walk, a broken entry ends the directory
+	numCrcs = namesLength = 0;
+	offset = 0;
+	for ( n = 0 ; n < entries ; n++ ) {
+		p = dir + offset;
+		if ( offset + ZIP_DIR_ENTRY_SIZE > dirSize || FS_ZipLong( p ) != 0x02014b50 ) {
+			break;
+		}
+		nameLength = FS_ZipShort( p + 28 );
+		skip = ZIP_DIR_ENTRY_SIZE + nameLength + FS_ZipShort( p + 30 ) + FS_ZipShort( p + 32 );
+		if ( offset + skip > dirSize ) {
+			break;
+		}
+		if ( nameLength > MAX_ZPATH - 1 ) {
+			nameLength = MAX_ZPATH - 1;
+		}
+
+		positions[n] = dirOffset + offset;
+		if ( FS_ZipLong( p + 24 ) > 0 ) {
+			crcs[numCrcs++] = FS_ZipLong( p + 16 );
+		}
+		memcpy( names + namesLength, p + ZIP_DIR_ENTRY_SIZE, nameLength );
+		names[namesLength + nameLength] = 0;
+		Q_strlwr( names + namesLength );
+		namesLength += strlen( names + namesLength ) + 1;
+
+		offset += skip;
+	}
+
+	zip->scanned = block;
+	zip->numEntries = n;
+	zip->positions = positions;
+	zip->numCrcs = numCrcs;
+	zip->crcs = crcs;
+	zip->names = names;
+	zip->namesLength = namesLength;
+	zip->valid = qtrue;
+
+done:
+	free( dir );
+	free( tail );
+	fclose( f );
+}
+
+/*
+=================
+FS_ScanThread
+=================
+*/
+static void FS_ScanThread( void *arg ) {
+	fsScanJob_t	*job = arg;
+	int			i;
+
+	for ( i = job->first ; i < job->numDirs ; i += FS_PK3_THREADS ) {
+		if ( !job->dirs[i].cached ) {
+			FS_ScanZipFile( &job->dirs[i] );
+		}
+	}
+}
+
+/*
+=================
+FS_ScanZipFiles
+
+Reads the central directories that weren't in the cache
+=================
+*/
+static void FS_ScanZipFiles( fsZipDir_t *dirs, int numDirs ) {
+	fsScanJob_t	jobs[FS_PK3_THREADS];
+	void		*threads[FS_PK3_THREADS];
+	int			i, missing;
+
+	missing = 0;
+	for ( i = 0 ; i < numDirs ; i++ ) {
+		if ( !dirs[i].cached ) {
+			missing++;
+		}
+	}
+	if ( !missing ) {
+		return;
+	}
+	fs_zipCache.scanned += missing;
+
+	for ( i = 0 ; i < FS_PK3_THREADS ; i++ ) {
+		jobs[i].dirs = dirs;
+		jobs[i].numDirs = numDirs;
+		jobs[i].first = i;
+		threads[i] = NULL;
+		if ( i && missing >= FS_PK3_MIN_THREADED ) {
+			threads[i] = Sys_CreateThread( FS_ScanThread, &jobs[i] );
+		}
+	}
+
+	// this thread does its own share and that of any thread that didn't start
+	for ( i = 0 ; i < FS_PK3_THREADS ; i++ ) {
+		if ( !threads[i] ) {
+			FS_ScanThread( &jobs[i] );
+		}
+	}
+	for ( i = 0 ; i < FS_PK3_THREADS ; i++ ) {
+		if ( threads[i] ) {
+			Sys_JoinThread( threads[i] );
+		}
+	}
+}
+
+/*
+=================
+FS_ParsePk3Cache
+
+Fills in the records of the mapped cache file, qfalse if it is damaged
+=================
+*/
+static qboolean FS_ParsePk3Cache( void ) {
+	fsPk3CacheHeader_t	header;
+	fsPk3CacheRecord_t	record;
+	fsZipDir_t			*zip;
+	const byte			*p, *end;
+	const char			*name;
+	int					i, j, length;
+
+	if ( fs_zipCache.mapLength < sizeof( header ) ) {
+		return qfalse;
+	}
+	Com_Memcpy( &header, fs_zipCache.map, sizeof( header ) );
+	if ( header.ident != FS_PK3_CACHE_IDENT || header.version != FS_PK3_CACHE_VERSION
+		|| header.length != fs_zipCache.mapLength - sizeof( header )
+		|| header.numRecords < 0 || header.numRecords > MAX_SEARCH_PATHS ) {
+		return qfalse;
+	}
+
+	fs_zipCache.records = Z_Malloc( header.numRecords * ( sizeof( *fs_zipCache.records ) + sizeof( qboolean ) ) );
+	fs_zipCache.seen = (qboolean *)( fs_zipCache.records + header.numRecords );
+	fs_zipCache.numRecords = header.numRecords;
+
+	p = fs_zipCache.map + sizeof( header );
+	end = fs_zipCache.map + fs_zipCache.mapLength;
+	for ( i = 0, zip = fs_zipCache.records ; i < header.numRecords ; i++, zip++ ) {
+		if ( end - p < sizeof( record ) ) {
+			return qfalse;
+		}
+		Com_Memcpy( &record, p, sizeof( record ) );
+		p += sizeof( record );
+
+		if ( record.pathLength <= 0 || record.pathLength > MAX_OSPATH
+			|| record.namesLength < 0 || record.numEntries < 0 || record.numCrcs < 0
+			|| record.numCrcs > record.numEntries || record.namesLength < record.numEntries ) {
+			return qfalse;
+		}
+		length = record.pathLength + record.namesLength
+			+ FS_PK3_CACHE_ALIGN( ( record.numEntries + record.numCrcs ) * sizeof( unsigned ) );
+		if ( length < 0 || end - p < length || p[record.pathLength - 1] ) {
+			return qfalse;
+		}
+
+		Q_strncpyz( zip->path, (const char *)p, sizeof( zip->path ) );
+		zip->size = record.size;
+		zip->mtime = record.mtime;
+		zip->names = (const char *)p + record.pathLength;
+		zip->namesLength = record.namesLength;
+		zip->numEntries = record.numEntries;
+		zip->positions = (const unsigned *)( zip->names + record.namesLength );
+		zip->numCrcs = record.numCrcs;
+		zip->crcs = zip->positions + record.numEntries;
+		zip->cached = qtrue;
+		zip->valid = qtrue;
+
+		// every name has to end inside the names
+		for ( j = 0, name = zip->names ; j < zip->numEntries ; j++ ) {
+			name = memchr( name, 0, zip->names + zip->namesLength - name );
+			if ( !name ) {
+				return qfalse;
+			}
+			name++;
+		}
+
+		p += length;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_OpenPk3Cache
+=================
+*/
+static void FS_OpenPk3Cache( void ) {
+	char	*path;
+
+	Com_Memset( &fs_zipCache, 0, sizeof( fs_zipCache ) );
+	if ( !fs_pk3cache->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+
+	path = FS_BuildOSPath( fs_homepath->string, FS_PK3_CACHE, "" );
+	path[strlen( path ) - 1] = 0;
+	fs_zipCache.map = Sys_MapFile( path, &fs_zipCache.mapLength );
+	if ( !fs_zipCache.map ) {
+		return;
+	}
+
+	if ( !FS_ParsePk3Cache() ) {
+		Com_Printf( "%s is damaged, reading every pk3\n", FS_PK3_CACHE );
+		fs_zipCache.numRecords = 0;
+		fs_zipCache.changed = qtrue;
+	}
+}
+
+/*
+=================
+FS_FindZipDir
+
+Takes the directory of the pk3 from the cache when the file didn't change
+=================
+*/
+static void FS_FindZipDir( fsZipDir_t *zip, const char *path ) {
+	fsZipDir_t	*record;
+	int			i;
+
+	Com_Memset( zip, 0, sizeof( *zip ) );
+	Q_strncpyz( zip->path, path, sizeof( zip->path ) );
+	if ( !fs_pk3cache->integer || !Sys_FileInfo( path, &zip->size, &zip->mtime ) ) {
+		return;
+	}
+
+	for ( i = 0, record = fs_zipCache.records ; i < fs_zipCache.numRecords ; i++, record++ ) {
+		if ( fs_zipCache.seen[i] || strcmp( record->path, path ) ) {
+			continue;
+		}
+		fs_zipCache.seen[i] = qtrue;
+		if ( record->size == zip->size && record->mtime == zip->mtime ) {
+			*zip = *record;
+			fs_zipCache.hits++;
+		}
+		return;
+	}
+}
+
+/*
+=================
+FS_AddPk3CacheRecord
+=================
+*/
+static void FS_AddPk3CacheRecord( const fsZipDir_t *zip ) {
+	fsPk3CacheRecord_t	record;
+	int					pathLength, length, offset;
+	byte				*p;
+
+	if ( !fs_pk3cache->integer || !zip->valid || !zip->size ) {
+		return;
+	}
+
+	pathLength = FS_PK3_CACHE_ALIGN( strlen( zip->path ) + 1 );
+	record.size = zip->size;
+	record.mtime = zip->mtime;
+	record.pathLength = pathLength;
+	record.namesLength = FS_PK3_CACHE_ALIGN( zip->namesLength );
+	record.numEntries = zip->numEntries;
+	record.numCrcs = zip->numCrcs;
+	length = sizeof( record ) + record.pathLength + record.namesLength
+		+ FS_PK3_CACHE_ALIGN( ( record.numEntries + record.numCrcs ) * sizeof( unsigned ) );
+
+	offset = fs_zipCache.outLength ? fs_zipCache.outLength : sizeof( fsPk3CacheHeader_t );
+	if ( offset + length > fs_zipCache.outSize ) {
+		fs_zipCache.outSize = ( offset + length ) * 2;
+		fs_zipCache.out = realloc( fs_zipCache.out, fs_zipCache.outSize );
+		if ( !fs_zipCache.out ) {
+			Com_Error( ERR_FATAL, "FS_AddPk3CacheRecord: failed on allocation of %i bytes", fs_zipCache.outSize );
+		}
+	}
+	if ( !fs_zipCache.outLength ) {
+		Com_Memset( fs_zipCache.out, 0, sizeof( fsPk3CacheHeader_t ) );
+	}
+
+	p = fs_zipCache.out + offset;
+	Com_Memset( p, 0, length );
+	Com_Memcpy( p, &record, sizeof( record ) );
+	p += sizeof( record );
+	strcpy( (char *)p, zip->path );
+	p += record.pathLength;
+	Com_Memcpy( p, zip->names, zip->namesLength );
+	p += record.namesLength;
+	Com_Memcpy( p, zip->positions, zip->numEntries * sizeof( unsigned ) );
+	p += zip->numEntries * sizeof( unsigned );
+	Com_Memcpy( p, zip->crcs, zip->numCrcs * sizeof( unsigned ) );
+
+	fs_zipCache.outLength = offset + length;
+	( (fsPk3CacheHeader_t *)fs_zipCache.out )->numRecords++;
+}
+
+/*
+=================
+FS_ClosePk3Cache
+
+Writes the cache again if a pk3 had to be read.  Records of pk3s
+that weren't loaded this time are kept as long as the file is
+unchanged, another fs_game may want them.
+=================
+*/
+static void FS_ClosePk3Cache( void ) {
+	fsPk3CacheHeader_t	*header;
+	fsZipDir_t			*record;
+	char				temp[MAX_QPATH];
+	fileHandle_t		f;
+	int64_t				size, mtime;
+	qboolean			ok;
+	int					i;
+
+	for ( i = 0, record = fs_zipCache.records ; i < fs_zipCache.numRecords ; i++, record++ ) {
+		if ( fs_zipCache.seen[i] ) {
+			continue;
+		}
+		if ( Sys_FileInfo( record->path, &size, &mtime ) && size == record->size && mtime == record->mtime ) {
+			FS_AddPk3CacheRecord( record );
+		} else {
+			fs_zipCache.changed = qtrue;
+		}
+	}
+
+	// the cache file may not be replaced while it is mapped
+	if ( fs_zipCache.map ) {
+		Sys_UnmapFile( fs_zipCache.map, fs_zipCache.mapLength );
+	}
+	if ( fs_zipCache.records ) {
+		Z_Free( fs_zipCache.records );
+	}
+
+	if ( fs_pk3cache->integer && ( fs_zipCache.scanned || fs_zipCache.changed ) && fs_zipCache.out ) {
+		header = (fsPk3CacheHeader_t *)fs_zipCache.out;
+		header->ident = FS_PK3_CACHE_IDENT;
+		header->version = FS_PK3_CACHE_VERSION;
+		header->length = fs_zipCache.outLength - sizeof( *header );
+
+		// named after the pid, servers on the same homepath may get here together
+		Com_sprintf( temp, sizeof( temp ), "%s.%i", FS_PK3_CACHE, (int)getpid() );
+		f = FS_SV_FOpenFileWrite( temp );
+		ok = f && FS_Write( fs_zipCache.out, fs_zipCache.outLength, f ) == fs_zipCache.outLength;
+		if ( f ) {
+			FS_FCloseFile( f );
+		}
+		if ( ok ) {
+			FS_SV_Rename( temp, FS_PK3_CACHE );
+		} else {
+			Com_Printf( "Couldn't write %s\n", FS_PK3_CACHE );
+			if ( f ) {
+				remove( FS_BuildOSPath( fs_homepath->string, "fscache", COM_SkipPath( temp ) ) );
+			}
+		}
+	}
+	free( fs_zipCache.out );
+
+	if ( fs_zipCache.scanned ) {
+		Com_Printf( "%i pk3 files read, %i from %s\n", fs_zipCache.scanned + fs_zipCache.hits,
+			fs_zipCache.hits, FS_PK3_CACHE );
+	}
+	Com_Memset( &fs_zipCache, 0, sizeof( fs_zipCache ) );
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -1641,52 +2645,41 @@ Creates a new pak_t in the search chain for the contents
 of a zip file.
 =================
 */
-static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
+static pack_t *FS_LoadZipFile( const fsZipDir_t *zip, const char *basename )
 {
 	fileInPack_t	*buildBuffer;
 	pack_t			*pack;
 	unzFile			uf;
-	int				err;
-	unz_global_info gi;
-	char			filename_inzip[MAX_ZPATH];
-	unz_file_info	file_info;
-	int				i, len;
+	int				i;
 	long			hash;
-	int				fs_numHeaderLongs;
 	int				*fs_headerLongs;
 	char			*namePtr;
 
-	fs_numHeaderLongs = 0;
-
-	uf = unzOpen(zipfile);
-	err = unzGetGlobalInfo (uf,&gi);
+	if ( !zip->valid ) {
+		return NULL;
+	}
 
-	if (err != UNZ_OK)
+	uf = unzOpen( (char *)zip->path );
+	if ( !uf ) {
 		return NULL;
+	}
 
-	fs_packFiles += gi.number_entry;
+	fs_packFiles += zip->numEntries;
 
-	len = 0;
-	unzGoToFirstFile(uf);
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
-		}
-		len += strlen(filename_inzip) + 1;
-		unzGoToNextFile(uf);
-	}
+	buildBuffer = Z_Malloc( ( zip->numEntries * sizeof( fileInPack_t ) ) + zip->namesLength );
+	namePtr = ((char *) buildBuffer) + zip->numEntries * sizeof( fileInPack_t );
+	Com_Memcpy( namePtr, zip->names, zip->namesLength );
 
-	buildBuffer = Z_Malloc( (gi.number_entry * sizeof( fileInPack_t )) + len );
-	namePtr = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
-	fs_headerLongs = Z_Malloc( ( gi.number_entry + 1 ) * sizeof(int) );
-	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
+	fs_headerLongs = Z_Malloc( ( zip->numCrcs + 1 ) * sizeof(int) );
+	fs_headerLongs[0] = LittleLong( fs_checksumFeed );
+	for ( i = 0 ; i < zip->numCrcs ; i++ ) {
+		fs_headerLongs[i + 1] = LittleLong( zip->crcs[i] );
+	}
 
 	// get the hash table size from the number of files in the zip
 	// because lots of custom pk3 files have less than 32 or 64 files
 	for (i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1) {
-		if (i > gi.number_entry) {
+		if (i > zip->numEntries) {
 			break;
 		}
 	}
@@ -1698,7 +2691,7 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 		pack->hashTable[i] = NULL;
 	}
 
-	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
+	Q_strncpyz( pack->pakFilename, zip->path, sizeof( pack->pakFilename ) );
 	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
 
 	// strip .pk3 if needed
@@ -1707,33 +2700,25 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	}
 
 	pack->handle = uf;
-	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile(uf);
+	pack->numfiles = zip->numEntries;
+	if ( fs_mmap->integer ) {
+		pack->map = Sys_MapFile( zip->path, &pack->mapLength );
+	}
 
-	for (i = 0; i < gi.number_entry; i++)
+	for (i = 0; i < zip->numEntries; i++)
 	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
-		}
-		if (file_info.uncompressed_size > 0) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
-		}
-		Q_strlwr( filename_inzip );
-		hash = FS_HashFileName(filename_inzip, pack->hashSize);
+		hash = FS_HashFileName(namePtr, pack->hashSize);
 		buildBuffer[i].name = namePtr;
-		strcpy( buildBuffer[i].name, filename_inzip );
-		namePtr += strlen(filename_inzip) + 1;
+		namePtr += strlen(namePtr) + 1;
 		// store the file position in the zip
-		unzGetCurrentFileInfoPosition(uf, &buildBuffer[i].pos);
+		buildBuffer[i].pos = zip->positions[i];
 		//
 		buildBuffer[i].next = pack->hashTable[hash];
 		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile(uf);
 	}
 
-	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], 4 * ( fs_numHeaderLongs - 1 ) );
-	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, 4 * fs_numHeaderLongs );
+	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], 4 * zip->numCrcs );
+	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, 4 * ( zip->numCrcs + 1 ) );
 	pack->checksum = LittleLong( pack->checksum );
 	pack->pure_checksum = LittleLong( pack->pure_checksum );
 
@@ -2357,6 +3342,11 @@ void FS_Path_f( void ) {
 	}
 
 
+	Com_Printf( "\n%i files in the pk3 index, %i lookups: %i found in pk3 files, %i in directories, "
+		"%i not found (%i from the miss cache), %i directory probes\n",
+		fs_index.numFiles, fs_index.lookups, fs_index.pakHits, fs_index.dirHits,
+		fs_index.notFound, fs_index.missHits, fs_index.dirProbes );
+
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
 		if ( fsh[i].handleFiles.file.o ) {
@@ -2384,6 +3374,243 @@ void FS_TouchFile_f( void ) {
 	}
 }
 
+/*
+============
+FS_IndexTestPak
+
+The entry of the pak for the name, the way FS_FOpenFileRead looked it up
+before there was an index
+============
+*/
+static fileInPack_t *FS_IndexTestPak( pack_t *pak, const char *filename ) {
+	fileInPack_t	*pakFile;
+
+	for ( pakFile = pak->hashTable[FS_HashFileName( filename, pak->hashSize )] ; pakFile ; pakFile = pakFile->next ) {
+		if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+			return pakFile;
+		}
+	}
+	return NULL;
+}
+
+/*
+============
+FS_IndexTest_f
+
+fsindextest [names]
+
+Looks names from the paks up in the index and by walking the search
+path, and counts the names for which the two don't give the same paks
+and directories in the same order.  A quarter of the names are upper
+cased, a quarter use backslashes and a quarter are in no pak.
+============
+*/
+void FS_IndexTest_f( void ) {
+	fsIndexCursor_t	cursor;
+	searchpath_t	*search, *found;
+	fileInPack_t	*pakFile;
+	char			(*names)[MAX_QPATH];
+	char			*s;
+	int				numNames, i, differ, candidates, walked, lookups;
+	int64_t			start, indexUsec, walkUsec;
+
+	if ( !fs_index.numFiles ) {
+		Com_Printf( "No pk3 files in the search path.\n" );
+		return;
+	}
+
+	numNames = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20000;
+	if ( numNames <= 0 ) {
+		Com_Printf( "Usage: fsindextest [names]\n" );
+		return;
+	}
+
+	names = Hunk_AllocateTempMemory( numNames * sizeof( *names ) );
+	for ( i = 0 ; i < numNames ; i++ ) {
+		Q_strncpyz( names[i], fs_index.files[(int)( (int64_t)i * fs_index.numFiles / numNames )].file->name,
+			sizeof( names[i] ) - 1 );
+		switch ( i & 3 ) {
+		case 1:
+			Q_strupr( names[i] );
+			break;
+		case 2:
+			for ( s = names[i] ; *s ; s++ ) {
+				if ( *s == '/' ) {
+					*s = '\\';
+				}
+			}
+			break;
+		case 3:
+			Q_strcat( names[i], sizeof( names[i] ), "x" );
+			break;
+		}
+	}
+
+	// lookups that find nothing in a pak stay out of the miss cache here
+	FS_ForgetMisses();
+	lookups = fs_index.lookups;
+
+	candidates = walked = 0;
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < numNames ; i++ ) {
+		for ( found = FS_IndexFirst( names[i], &cursor, &pakFile ) ; found ; found = FS_IndexNext( &cursor, &pakFile ) ) {
+			candidates++;
+		}
+	}
+	indexUsec = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < numNames ; i++ ) {
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			if ( !search->pack || FS_IndexTestPak( search->pack, names[i] ) ) {
+				walked++;
+			}
+		}
+	}
+	walkUsec = Sys_Microseconds() - start;
+
+	differ = 0;
+	for ( i = 0 ; i < numNames ; i++ ) {
+		found = FS_IndexFirst( names[i], &cursor, &pakFile );
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			if ( search->pack && !FS_IndexTestPak( search->pack, names[i] ) ) {
+				continue;
+			}
+			if ( found != search || ( search->pack && pakFile != FS_IndexTestPak( search->pack, names[i] ) ) ) {
+				break;
+			}
+			found = FS_IndexNext( &cursor, &pakFile );
+		}
+		if ( search || found ) {
+			differ++;
+		}
+	}
+
+	fs_index.lookups = lookups;
+	Hunk_FreeTempMemory( names );
+
+	Com_Printf( "index %i usec for %i paths, search path walk %i usec for %i paths\n",
+		(int)indexUsec, candidates, (int)walkUsec, walked );
+	Com_Printf( "%i names checked, %i differ\n", numNames, differ );
+}
+
+/*
+============
+FS_Pk3Check_f
+
+pk3check [bench | test]
+
+Reads every file of every pk3 in the search path and compares its
+CRC-32 with the one in the zip directory.  With "bench" every CRC-32
+implementation sums the data again, they must all agree, and the
+throughput of each one is printed next to the one of inflate.  "test"
+runs inflate on streams built in memory instead, see unzInflateTest.
+============
+*/
+void FS_Pk3Check_f( void ) {
+	searchpath_t	*search;
+	pack_t			*pak;
+	unzFile			zip;
+	unz_file_info	*info;
+	byte			*buf;
+	unsigned long	crc, sum;
+	int64_t			start, inflateTime, crcTime[UNZ_CRC32_NUM];
+	int64_t			inflateBytes, crcBytes;
+	qboolean		bench;
+	int				i, impl, len, files, paks, damaged;
+
+	if ( Cmd_Argc() == 2 && !Q_stricmp( Cmd_Argv( 1 ), "test" ) ) {
+		Com_Printf( "%i inflate test streams wrong\n", unzInflateTest() );
+		return;
+	}
+
+	bench = !Q_stricmp( Cmd_Argv( 1 ), "bench" );
+	if ( Cmd_Argc() > 2 || ( Cmd_Argc() == 2 && !bench ) ) {
+		Com_Printf( "Usage: pk3check [bench | test]\n" );
+		return;
+	}
+
+	files = paks = damaged = 0;
+	inflateTime = inflateBytes = crcBytes = 0;
+	Com_Memset( crcTime, 0, sizeof( crcTime ) );
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		pak = search->pack;
+		if ( !pak ) {
+			continue;
+		}
+		// a private handle, open files may share pak->handle
+		zip = unzReOpen( pak->pakFilename, pak->handle );
+		if ( !zip ) {
+			Com_Printf( "Couldn't reopen %s\n", pak->pakFilename );
+			continue;
+		}
+		((unz_s *)zip)->pfile_in_zip_read = NULL;
+		paks++;
+
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			unzSetCurrentFileInfoPosition( zip, pak->buildBuffer[i].pos );
+			info = &((unz_s *)zip)->cur_file_info;
+			if ( unzOpenCurrentFile( zip ) != UNZ_OK ) {
+				Com_Printf( "%s in %s: can't open\n", pak->buildBuffer[i].name, pak->pakFilename );
+				damaged++;
+				continue;
+			}
+
+			buf = Hunk_AllocateTempMemory( info->uncompressed_size + 1 );
+			start = Sys_Microseconds();
+			if ( pak->map ) {
+				len = unzReadCurrentFileFromMemory( zip, pak->map, pak->mapLength, buf, info->uncompressed_size );
+			} else {
+				len = unzReadCurrentFile( zip, buf, info->uncompressed_size );
+			}
+			if ( info->compression_method ) {
+				inflateTime += Sys_Microseconds() - start;
+				inflateBytes += info->uncompressed_size;
+			}
+			unzCloseCurrentFile( zip );
+			files++;
+
+			crc = 0;
+			if ( len == (int)info->uncompressed_size ) {
+				start = Sys_Microseconds();
+				crc = unzCrc32( UNZ_CRC32_BEST, 0, buf, len );
+				crcTime[UNZ_CRC32_BEST] += Sys_Microseconds() - start;
+				crcBytes += len;
+			}
+			// unzip sign extends the stored value with a 64 bit long
+			if ( len != (int)info->uncompressed_size || crc != ( info->crc & 0xffffffffUL ) ) {
+				Com_Printf( "%s in %s: crc %08lx, expected %08lx\n", pak->buildBuffer[i].name,
+					pak->pakFilename, crc, info->crc & 0xffffffffUL );
+				damaged++;
+			} else if ( bench ) {
+				for ( impl = UNZ_CRC32_BEST + 1 ; impl < UNZ_CRC32_NUM && unzCrc32Name( impl ) ; impl++ ) {
+					start = Sys_Microseconds();
+					sum = unzCrc32( impl, 0, buf, len );
+					crcTime[impl] += Sys_Microseconds() - start;
+					if ( sum != crc ) {
+						Com_Printf( "%s in %s: %s crc %08lx, expected %08lx\n", pak->buildBuffer[i].name,
+							pak->pakFilename, unzCrc32Name( impl ), sum, crc );
+						damaged++;
+					}
+				}
+			}
+			Hunk_FreeTempMemory( buf );
+		}
+		unzClose( zip );
+	}
+
+	Com_Printf( "%i files in %i pk3 files checked, %i damaged\n", files, paks, damaged );
+	if ( !bench ) {
+		return;
+	}
+	Com_Printf( "inflate: %i MB/s\n", inflateTime ? (int)( inflateBytes / inflateTime ) : 0 );
+	for ( impl = UNZ_CRC32_BEST ; impl < UNZ_CRC32_NUM && unzCrc32Name( impl ) ; impl++ ) {
+		Com_Printf( "crc32 %s%s: %i MB/s\n", impl == UNZ_CRC32_BEST ? "in use, " : "", unzCrc32Name( impl ),
+			crcTime[impl] ? (int)( crcBytes / crcTime[impl] ) : 0 );
+	}
+}
+
 //===========================================================================
 
 
@@ -2412,6 +3639,7 @@ void FS_AddGameDirectory( const char *path, const char *dir ) {
 	char			*pakfile;
 	int				numfiles;
 	char			**pakfiles;
+	fsZipDir_t		*zipDirs;
 
 	// Unique
 	for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
@@ -2441,9 +3669,17 @@ void FS_AddGameDirectory( const char *path, const char *dir ) {
 
 	qsort( pakfiles, numfiles, sizeof(char*), paksort );
 
+	zipDirs = Z_Malloc( numfiles * sizeof( *zipDirs ) );
+	for ( i = 0 ; i < numfiles ; i++ ) {
+		FS_FindZipDir( &zipDirs[i], FS_BuildOSPath( path, dir, pakfiles[i] ) );
+	}
+	FS_ScanZipFiles( zipDirs, numfiles );
+
 	for ( i = 0 ; i < numfiles ; i++ ) {
-		pakfile = FS_BuildOSPath( path, dir, pakfiles[i] );
-		if ( ( pak = FS_LoadZipFile( pakfile, pakfiles[i] ) ) == 0 )
+		pak = FS_LoadZipFile( &zipDirs[i], pakfiles[i] );
+		FS_AddPk3CacheRecord( &zipDirs[i] );
+		free( zipDirs[i].scanned );
+		if ( !pak )
 			continue;
 		// store the game name for downloading
 		strcpy(pak->pakGamename, dir);
@@ -2455,6 +3691,7 @@ void FS_AddGameDirectory( const char *path, const char *dir ) {
 	}
 
 	// done
+	Z_Free( zipDirs );
 	Sys_FreeFileList( pakfiles );
 }
 
@@ -2618,6 +3855,30 @@ qboolean FS_ComparePaks( char *neededpaks, int len, qboolean dlstring ) {
 	return qfalse; // We have them all
 }
 
+/*
+================
+FS_UnmapPak
+
+A pak that still has FS_MapFile buffers out keeps its mapping until
+FS_FreeFile gets the last of them
+================
+*/
+static void FS_UnmapPak( pack_t *pak ) {
+	int		i;
+
+	if ( !pak->mapRefs ) {
+		Sys_UnmapFile( pak->map, pak->mapLength );
+		return;
+	}
+
+	Com_DPrintf( "FS_Shutdown: %s still has %i mapped files\n", pak->pakFilename, pak->mapRefs );
+	for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( fs_mappedFiles[i].pak == pak ) {
+			fs_mappedFiles[i].pak = NULL;
+		}
+	}
+}
+
 /*
 ================
 FS_Shutdown
@@ -2640,6 +3901,9 @@ void FS_Shutdown( qboolean closemfp ) {
 		next = p->next;
 
 		if ( p->pack ) {
+			if ( p->pack->map ) {
+				FS_UnmapPak( p->pack );
+			}
 			unzClose(p->pack->handle);
 			Z_Free( p->pack->buildBuffer );
 			Z_Free( p->pack );
@@ -2650,6 +3914,8 @@ void FS_Shutdown( qboolean closemfp ) {
 		Z_Free( p );
 	}
 
+	FS_FreeIndex();
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 
@@ -2657,6 +3923,8 @@ void FS_Shutdown( qboolean closemfp ) {
 	Cmd_RemoveCommand( "dir" );
 	Cmd_RemoveCommand( "fdir" );
 	Cmd_RemoveCommand( "touchFile" );
+	Cmd_RemoveCommand( "pk3check" );
+	Cmd_RemoveCommand( "fsindextest" );
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -2721,6 +3989,14 @@ static void FS_Startup( const char *gameName )
 	Com_Printf( "----- FS_Startup -----\n" );
 
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
+	// mapping every pk3 is cheap with a 64 bit address space, but a pk3
+	// truncated or rewritten in place under a mapping raises SIGBUS instead
+	// of a short read, and servers often get their maps updated that way
+#ifdef DEDICATED
+	fs_mmap = Cvar_Get( "fs_mmap", "0", CVAR_LATCH );
+#else
+	fs_mmap = Cvar_Get( "fs_mmap", sizeof( void * ) > 4 && !Cvar_VariableIntegerValue( "dedicated" ) ? "1" : "0", CVAR_LATCH );
+#endif
 	fs_basepath = Cvar_Get ("fs_basepath", Sys_DefaultInstallPath(), CVAR_INIT );
 	fs_basegame = Cvar_Get ("fs_basegame", "", CVAR_INIT );
 	homePath = Sys_DefaultHomePath();
@@ -2729,6 +4005,9 @@ static void FS_Startup( const char *gameName )
 	}
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT );
 	fs_gamedirvar = Cvar_Get ("fs_game", "q3ut4", CVAR_INIT|CVAR_SYSTEMINFO );
+	fs_pk3cache = Cvar_Get( "fs_pk3cache", "1", CVAR_ARCHIVE );
+
+	FS_OpenPk3Cache();
 
 	// add search path elements in reverse priority order
 	if (fs_basepath->string[0]) {
@@ -2768,6 +4047,8 @@ static void FS_Startup( const char *gameName )
 		}
 	}
 
+	FS_ClosePk3Cache();
+
 	Com_ReadCDKey(BASEGAME);
 	fs = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
 	if (fs && fs->string[0] != 0) {
@@ -2779,11 +4060,15 @@ static void FS_Startup( const char *gameName )
 	Cmd_AddCommand ("dir", FS_Dir_f );
 	Cmd_AddCommand ("fdir", FS_NewDir_f );
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f );
+	Cmd_AddCommand ("pk3check", FS_Pk3Check_f );
+	Cmd_AddCommand ("fsindextest", FS_IndexTest_f );
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	FS_BuildIndex();
+
 	// print the current search paths
 	FS_Path_f();
 
@@ -51,6 +51,7 @@ static qboolean	winsockInitialized = qfalse;
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #ifdef MACOS_X
@@ -92,6 +93,18 @@ static SOCKET	socks_socket;
 static	int		numIP;
 static	byte	localIP[MAX_IPS][4];
 
+static SOCKET	metrics_socket;
+static char		metrics_target[MAX_OSPATH];
+static union {
+	struct sockaddr		sa;
+	struct sockaddr_in	in;
+#ifndef _WIN32
+	struct sockaddr_un	un;
+#endif
+} metrics_addr;
+static int		metrics_addrLength;
+static SOCKET	metrics_reader;
+
 //=============================================================================
 
 
@@ -842,6 +855,7 @@ NET_OpenIP
 void NET_OpenIP( void ) {
 	cvar_t	*ip;
 	int		port;
+	int		scan;
 	int		i;
 
 	ip = Cvar_Get( "net_ip", "localhost", CVAR_LATCH );
@@ -849,8 +863,10 @@ void NET_OpenIP( void ) {
 
 	// automatically scan for a valid port, so multiple
 	// dedicated servers can be started without requiring
-	// a different net_port for each one
-	for( i = 0 ; i < 10 ; i++ ) {
+	// a different net_port for each one.  Forked instances
+	// already have one each, scanning would take a sibling's
+	scan = ( com_instances->integer > 1 ) ? 1 : 10;
+	for( i = 0 ; i < scan ; i++ ) {
 		ip_socket = NET_IPSocket( ip->string, port + i );
 		if ( ip_socket ) {
 			Cvar_SetValue( "net_port", port + i );
@@ -861,6 +877,10 @@ void NET_OpenIP( void ) {
 			return;
 		}
 	}
+	if ( com_instances->integer > 1 ) {
+		Com_Error( ERR_FATAL, "Couldn't allocate IP port %i for instance %i",
+			port, com_instance->integer );
+	}
 	Com_Printf( "WARNING: Couldn't allocate IP port\n");
 }
 
@@ -1004,6 +1024,163 @@ void NET_Init( void ) {
 }
 
 
+/*
+====================
+NET_OpenMetrics
+
+"unix:<path>" is a unix domain datagram socket, anything else has to be
+a loopback address with a port
+====================
+*/
+static void NET_OpenMetrics( const char *target ) {
+	netadr_t	adr;
+	qboolean	_true = qtrue;
+	SOCKET		s;
+
+	if( !Q_stricmpn( target, "unix:", 5 ) ) {
+#ifdef _WIN32
+		Com_Printf( "WARNING: sv_metrics: unix domain sockets are not supported, use 127.0.0.1:<port>\n" );
+		return;
+#else
+		if( strlen( target + 5 ) >= sizeof( metrics_addr.un.sun_path ) ) {
+			Com_Printf( "WARNING: sv_metrics: socket path too long\n" );
+			return;
+		}
+		memset( &metrics_addr, 0, sizeof( metrics_addr ) );
+		metrics_addr.un.sun_family = AF_UNIX;
+		strcpy( metrics_addr.un.sun_path, target + 5 );
+		metrics_addrLength = sizeof( metrics_addr.un );
+		s = socket( AF_UNIX, SOCK_DGRAM, 0 );
+#endif
+	}
+	else {
+		if( !NET_StringToAdr( target, &adr ) || adr.type != NA_IP || !adr.port ) {
+			Com_Printf( "WARNING: sv_metrics: bad address %s\n", target );
+			return;
+		}
+		if( adr.ip[0] != 127 ) {
+			Com_Printf( "WARNING: sv_metrics: %s is not a loopback address\n", target );
+			return;
+		}
+		NetadrToSockadr( &adr, &metrics_addr.sa );
+		metrics_addrLength = sizeof( metrics_addr.in );
+		s = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	}
+
+	if( s == INVALID_SOCKET ) {
+		Com_Printf( "WARNING: sv_metrics: socket: %s\n", NET_ErrorString() );
+		return;
+	}
+
+	// never hold up the frame for the collector
+	if( ioctlsocket( s, FIONBIO, (u_long *)&_true ) == SOCKET_ERROR ) {
+		Com_Printf( "WARNING: sv_metrics: ioctl FIONBIO: %s\n", NET_ErrorString() );
+		closesocket( s );
+		return;
+	}
+
+	metrics_socket = s;
+}
+
+/*
+====================
+NET_SendMetrics
+
+Sends one datagram to the metrics collector, errors such as nobody
+listening are silent
+====================
+*/
+void NET_SendMetrics( const char *target, const char *data, int length ) {
+	if( strcmp( target, metrics_target ) ) {
+		if( metrics_socket ) {
+			closesocket( metrics_socket );
+			metrics_socket = 0;
+		}
+		Q_strncpyz( metrics_target, target, sizeof( metrics_target ) );
+		if( target[0] ) {
+			NET_OpenMetrics( target );
+		}
+	}
+
+	if( !metrics_socket || !length ) {
+		return;
+	}
+
+	sendto( metrics_socket, data, length, 0, &metrics_addr.sa, metrics_addrLength );
+}
+
+
+/*
+====================
+NET_OpenMetricsReader
+
+For metricstest: binds a loopback socket on any free port and writes
+its address to target, so it can be given to NET_SendMetrics
+====================
+*/
+qboolean NET_OpenMetricsReader( char *target, int size ) {
+	struct sockaddr_in	addr;
+	socklen_t			addrLength;
+	SOCKET				s;
+
+	s = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if( s == INVALID_SOCKET ) {
+		Com_Printf( "WARNING: metricstest: socket: %s\n", NET_ErrorString() );
+		return qfalse;
+	}
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	addrLength = sizeof( addr );
+	if( bind( s, (void *)&addr, sizeof( addr ) ) == SOCKET_ERROR
+		|| getsockname( s, (void *)&addr, &addrLength ) == SOCKET_ERROR ) {
+		Com_Printf( "WARNING: metricstest: bind: %s\n", NET_ErrorString() );
+		closesocket( s );
+		return qfalse;
+	}
+
+	metrics_reader = s;
+	Com_sprintf( target, size, "127.0.0.1:%i", ntohs( addr.sin_port ) );
+	return qtrue;
+}
+
+/*
+====================
+NET_ReadMetrics
+
+Waits up to msec for one datagram on the socket of NET_OpenMetricsReader
+and closes it.  Returns the length, -1 if nothing came.
+====================
+*/
+int NET_ReadMetrics( char *data, int size, int msec ) {
+	struct timeval	timeout;
+	fd_set			fdset;
+	int				length;
+
+	if( !metrics_reader ) {
+		return -1;
+	}
+
+	FD_ZERO( &fdset );
+	FD_SET( metrics_reader, &fdset );
+	timeout.tv_sec = msec / 1000;
+	timeout.tv_usec = ( msec % 1000 ) * 1000;
+
+	length = -1;
+	if( select( metrics_reader + 1, &fdset, NULL, NULL, &timeout ) > 0 ) {
+		length = recv( metrics_reader, data, size, 0 );
+		if( length == SOCKET_ERROR ) {
+			length = -1;
+		}
+	}
+
+	closesocket( metrics_reader );
+	metrics_reader = 0;
+	return length;
+}
+
+
 /*
 ====================
 NET_Shutdown
@@ -1015,6 +1192,7 @@ void NET_Shutdown( void ) {
 	}
 
 	NET_Config( qfalse );
+	NET_SendMetrics( "", NULL, 0 );
 
 #ifdef _WIN32
 	WSACleanup();
@@ -168,6 +168,9 @@ const char	*NET_AdrToString (netadr_t a);
 qboolean	NET_StringToAdr ( const char *s, netadr_t *a);
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void		NET_Sleep(int msec);
+void		NET_SendMetrics( const char *target, const char *data, int length );
+qboolean	NET_OpenMetricsReader( char *target, int size );
+int			NET_ReadMetrics( char *data, int size, int msec );
 
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
@@ -318,6 +321,12 @@ vm_t	*VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 				   vmInterpret_t interpret );
 // module should be bare: "cgame", not "cgame.dll" or "vm/cgame.qvm"
 
+// a trap that reads the module's own int arguments, args[1] is the first
+typedef intptr_t (*vmSyscall_t)( int *args );
+
+void	VM_SetSyscallTable( vm_t *vm, const vmSyscall_t *table, int count );
+// traps with an entry skip the systemCalls switch, NULL entries use it
+
 void	VM_Free( vm_t *vm );
 void	VM_Clear(void);
 vm_t	*VM_Restart( vm_t *vm );
@@ -328,6 +337,7 @@ void	VM_Debug( int level );
 
 void	*VM_ArgPtr( intptr_t intValue );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
+void	*VM_ArgArray( intptr_t intValue, int count, int size );
 
 #define	VMA(x) VM_ArgPtr(args[x])
 static ID_INLINE float _vmf(intptr_t x)
@@ -366,6 +376,9 @@ void Cbuf_Init (void);
 void Cbuf_AddText( const char *text );
 // Adds command text at the end of the buffer, does NOT add a final \n
 
+void Cbuf_InsertText( const char *text );
+// Adds command text immediately after the current command, adds a final \n
+
 void Cbuf_ExecuteText( int exec_when, const char *text );
 // this can be used in place of either Cbuf_AddText or Cbuf_InsertText
 
@@ -465,6 +478,9 @@ void	Cvar_Update( vmCvar_t *vmCvar );
 void 	Cvar_Set( const char *var_name, const char *value );
 // will create the variable with no flags if it doesn't exist
 
+cvar_t	*Cvar_Set2( const char *var_name, const char *value, qboolean force );
+// force also sets ROM, INIT and LATCH variables right away
+
 void Cvar_SetLatched( const char *var_name, const char *value);
 // don't set the cvar immediately
 
@@ -602,8 +618,16 @@ int		FS_ReadFile( const char *qpath, void **buffer );
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
+void	FS_AsyncLog( fileHandle_t f );
+// hands a file opened for writing to the log thread when com_logAsync is set,
+// FS_Write then only queues the data
+
+int		FS_MapFile( const char *qpath, const void **buffer );
+// FS_ReadFile for data that is only read, a file stored uncompressed
+// in a pk3 comes straight from the mapped pk3 without the trailing 0
+
 void	FS_FreeFile( void *buffer );
-// frees the memory returned by FS_ReadFile
+// frees the memory returned by FS_ReadFile or FS_MapFile
 
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
@@ -715,7 +739,9 @@ typedef enum
   CF_3DNOW_EXT  = 1 << 4,
   CF_SSE        = 1 << 5,
   CF_SSE2       = 1 << 6,
-  CF_ALTIVEC    = 1 << 7
+  CF_ALTIVEC    = 1 << 7,
+  CF_SSE41      = 1 << 8,
+  CF_PCLMUL     = 1 << 9
 } cpuFeatures_t;
 
 // centralized and cleaned, that's the max string you can send to a Com_Printf / Com_DPrintf (above gets truncated)
@@ -785,6 +811,8 @@ extern	cvar_t	*com_ansiColor;
 extern	cvar_t	*com_unfocused;
 extern	cvar_t	*com_minimized;
 extern	cvar_t	*com_altivec;
+extern	cvar_t	*com_instances;		// dedicated server instances forked at startup
+extern	cvar_t	*com_instance;		// index of this instance, 0 for the first one
 
 // both client and server must agree to pause
 extern	cvar_t	*cl_paused;
@@ -872,6 +900,22 @@ void Com_TouchMemory( void );
 void Com_Init( char *commandLine );
 void Com_Frame( void );
 void Com_Shutdown( void );
+void Com_SetInstance( int instance, int port );
+
+// asynclog.c
+extern	cvar_t	*com_logAsync;
+extern	cvar_t	*com_logFlushMsec;
+extern	cvar_t	*com_logMaxSize;
+
+void	AsyncLog_Init( void );
+void	AsyncLog_Shutdown( void );
+int		AsyncLog_Open( FILE *file, const char *ospath, qboolean sync );
+void	AsyncLog_Write( int channel, const void *data, int length );
+void	AsyncLog_Flush( int channel );
+void	AsyncLog_SetSync( int channel, qboolean sync );
+void	AsyncLog_Close( int channel );
+void	AsyncLog_Drain( void );
+void	AsyncLog_AfterFork( void );
 
 
 /*
@@ -1006,6 +1050,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Microseconds( void );	// high resolution, for profiling only
 
 void	Sys_SnapVector( float *v );
 
@@ -1044,10 +1089,33 @@ char *Sys_ConsoleInput(void);
 
 char **Sys_ListFiles( const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs );
 void	Sys_FreeFileList( char **list );
+
+// size and modification time of a file, qfalse if there is none
+qboolean Sys_FileInfo( const char *path, int64_t *size, int64_t *mtime );
+
+// read only view of a whole file, NULL if it can't be mapped
+const void *Sys_MapFile( const char *path, int *length );
+void	Sys_UnmapFile( const void *data, int length );
+
 void	Sys_Sleep(int msec);
 
+// threads for background work that never calls back into the engine
+void	*Sys_CreateThread( void (*function)( void *arg ), void *arg );
+void	Sys_JoinThread( void *thread );
+void	Sys_ThreadSleep( int msec );
+
+// one instance of the variable for each thread
+#ifdef _MSC_VER
+#define	THREAD_LOCAL	__declspec(thread)
+#else
+#define	THREAD_LOCAL	__thread
+#endif
+
 qboolean Sys_LowPhysicalMemory( void );
 
+// forks com_instances - 1 additional dedicated servers, call before NET_Init
+void	Sys_SpawnInstances( void );
+
 /* This is based on the Adaptive Huffman algorithm described in Sayood's Data
  * Compression book.  The ranks are not actually stored, but implicitly defined
  * by the location of a node within a doubly-linked list */
@@ -10,6 +10,13 @@
 #include "../client/client.h"
 #include "unzip.h"
 
+#if ( defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) ) ) \
+	|| ( defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) ) )
+#define UNZ_HAVE_PCLMUL
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
 /* unzip.h -- IO for uncompress .zip files using zlib 
    Version 0.15 beta, Mar 19th, 1998,
 
@@ -2216,6 +2223,88 @@ extern int unzCloseCurrentFile (unzFile file)
 }
 
 
+/*
+  Read unsigned chars from the current file like unzReadCurrentFile, but
+  take the compressed data from zip, zipLen unsigned chars holding the whole
+  zipfile (a mapped pk3), instead of the FILE. Deflated data is inflated
+  straight from zip into buf, stored data is copied in one go.
+  return the number of unsigned char copied, or <0 with an error code
+*/
+extern int unzReadCurrentFileFromMemory (unzFile file, const void *zip, uLong zipLen, void *buf, unsigned len)
+{
+	int err=UNZ_OK;
+	uLong pos;
+	uInt iRead;
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	if (len>pfile_in_zip_read_info->rest_read_uncompressed)
+		len = (uInt)pfile_in_zip_read_info->rest_read_uncompressed;
+	if (len==0)
+		return 0;
+
+	/* hand the rest of the compressed data over at once */
+	if ((pfile_in_zip_read_info->stream.avail_in==0) &&
+        (pfile_in_zip_read_info->rest_read_compressed>0))
+	{
+		pos = pfile_in_zip_read_info->pos_in_zipfile +
+				pfile_in_zip_read_info->byte_before_the_zipfile;
+		if ((pos>zipLen) ||
+            (pfile_in_zip_read_info->rest_read_compressed>zipLen-pos))
+			return UNZ_BADZIPFILE;
+
+		pfile_in_zip_read_info->stream.next_in = (Byte*)zip + pos;
+		pfile_in_zip_read_info->stream.avail_in =
+            (uInt)pfile_in_zip_read_info->rest_read_compressed;
+		pfile_in_zip_read_info->pos_in_zipfile +=
+            pfile_in_zip_read_info->rest_read_compressed;
+		pfile_in_zip_read_info->rest_read_compressed = 0;
+	}
+
+	pfile_in_zip_read_info->stream.next_out = (Byte*)buf;
+	pfile_in_zip_read_info->stream.avail_out = (uInt)len;
+
+	if (pfile_in_zip_read_info->compression_method==0)
+	{
+		if (pfile_in_zip_read_info->stream.avail_in < len)
+			return UNZ_BADZIPFILE;
+		zmemcpy(buf, pfile_in_zip_read_info->stream.next_in, len);
+		pfile_in_zip_read_info->stream.avail_in -= len;
+		pfile_in_zip_read_info->stream.avail_out = 0;
+		pfile_in_zip_read_info->stream.next_in += len;
+		pfile_in_zip_read_info->stream.total_out += len;
+	}
+	else
+	{
+		while (pfile_in_zip_read_info->stream.avail_out>0)
+		{
+			uInt uAvailInBefore = pfile_in_zip_read_info->stream.avail_in;
+			uLong uTotalOutBefore = pfile_in_zip_read_info->stream.total_out;
+
+			err=inflate(&pfile_in_zip_read_info->stream,Z_SYNC_FLUSH);
+			if (err==Z_STREAM_END)
+				break;
+			if (err!=Z_OK)
+				return err;
+			if ((pfile_in_zip_read_info->stream.avail_in == uAvailInBefore) &&
+                (pfile_in_zip_read_info->stream.total_out == uTotalOutBefore))
+				return UNZ_BADZIPFILE;
+		}
+	}
+
+	iRead = len - pfile_in_zip_read_info->stream.avail_out;
+	pfile_in_zip_read_info->rest_read_uncompressed -= iRead;
+	return iRead;
+}
+
+
 /*
   Get the global comment string of the ZipFile, in the szComment buffer.
   uSizeBuf is the size of the szComment buffer.
@@ -3463,25 +3552,49 @@ int inflate_trees_fixed(uInt *bl, uInt *bd, inflate_huft * *tl, inflate_huft * *
 #define exop word.what.Exop
 #define bits word.what.Bits
 
-/* macros for bit input with no checking and for returning unused bytes */
-#define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
+/* macros for bit input with no checking and for returning unused bytes.
+   The fast loop keeps a 64 bit buffer and tops it up with one eight byte
+   load, which leaves at least 56 bits: enough for a whole length/distance
+   pair, so there is at most one refill per symbol.  Bits above k are the
+   next stream bits already, so loading them again is harmless. */
+#define GRABBITS(j) {if(k<(j)){b|=inflate_load64(p)<<k;a=(63-k)>>3;n-=a;p+=a;k+=a<<3;}}
 #define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;}
 
+/* copy chunk for matches */
+#define INFLATE_CHUNK 8
+
+static uint64_t inflate_load64(const Byte *p)
+{
+#ifdef Q3_BIG_ENDIAN
+  return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+         (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+         (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+#else
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+#endif
+}
+
 /* Called with number of bytes left to write in window at least 258
    (the maximum string length) and number of input bytes available
    at least ten.  The ten bytes are six bytes for the longest length/
-   distance pair plus four bytes for overloading the bit buffer. */
+   distance pair plus four bytes for overloading the bit buffer, and
+   cover the eight byte load of a refill. */
 
 static int inflate_fast(uInt bl, uInt bd, inflate_huft *tl, inflate_huft *td, inflate_blocks_statef *s, z_streamp z)
 {
   inflate_huft *t;      /* temporary pointer */
   uInt e;               /* extra bits or operation */
-  uLong b;              /* bit buffer */
+  uint64_t b;           /* bit buffer */
   uInt k;               /* bits in bit buffer */
   Byte *p;             /* input data pointer */
   uInt n;               /* bytes available there */
+  uInt a;               /* bytes taken by a refill */
   Byte *q;             /* output window write pointer */
   uInt m;               /* bytes to end of window or read pointer */
+  Byte *end;           /* end of a chunked copy */
   uInt ml;              /* mask for literal/length tree */
   uInt md;              /* mask for distance tree */
   uInt c;               /* bytes to copy */
@@ -3538,6 +3651,27 @@ static int inflate_fast(uInt bl, uInt bd, inflate_huft *tl, inflate_huft *td, in
             if ((uInt)(q - s->window) >= d)     /* offset before dest */
             {                                   /*  just copy */
               r = q - d;
+              if (d >= INFLATE_CHUNK)   /* no overlap within a chunk */
+              {
+                /* nothing may be written past the match: after a wrap the
+                   bytes beyond q are the oldest history, still in use */
+                end = q + c;
+                while (end - q >= INFLATE_CHUNK)
+                {
+                  memcpy(q, r, INFLATE_CHUNK);
+                  q += INFLATE_CHUNK;
+                  r += INFLATE_CHUNK;
+                }
+                while (q < end)
+                  *q++ = *r++;
+                break;
+              }
+              if (d == 1)               /* run of one byte */
+              {
+                memset(q, *r, c);
+                q += c;
+                break;
+              }
               *q++ = *r++;  c--;        /* minimum count is three, */
               *q++ = *r++;  c--;        /*  so unroll loop a little */
             }
@@ -3900,6 +4034,210 @@ static uLong adler32(uLong adler, const Byte *buf, uInt len)
     return (s2 << 16) | s1;
 }
 
+/* crc32.c -- compute the CRC-32 of a data stream
+ * Copyright (C) 1995-1998 Mark Adler
+ * For conditions of distribution and use, see copyright notice in zlib.h 
+ *
+ * Three versions of the same sum: the classic table walk one byte at a
+ * time, slice-by-8 which looks up eight bytes at once in eight tables,
+ * and folding with carry-less multiplies for cpus with PCLMULQDQ.  The
+ * fastest one the cpu supports is picked on first use.
+ */
+
+static uint32_t crc_table[8][256];
+static int crc_best;
+
+static void crc32_make_tables(void)
+{
+  uint32_t c;
+  int n, k;
+
+  for (n = 0; n < 256; n++)
+  {
+    c = (uint32_t)n;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+    crc_table[0][n] = c;
+  }
+  for (n = 0; n < 256; n++)
+  {
+    c = crc_table[0][n];
+    for (k = 1; k < 8; k++)
+    {
+      c = crc_table[0][c & 0xff] ^ (c >> 8);
+      crc_table[k][n] = c;
+    }
+  }
+}
+
+static uint32_t crc32_bytewise(uint32_t c, const Byte *buf, uLong len)
+{
+  while (len--)
+    c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+  return c;
+}
+
+static uint32_t crc32_slice8(uint32_t c, const Byte *buf, uLong len)
+{
+  uint32_t lo, hi;
+
+  while (len >= 8)
+  {
+    lo = c ^ ((uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+              (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24);
+    hi = (uint32_t)buf[4] | (uint32_t)buf[5] << 8 |
+         (uint32_t)buf[6] << 16 | (uint32_t)buf[7] << 24;
+    c = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+        crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+        crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+        crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+    buf += 8;
+    len -= 8;
+  }
+  return crc32_bytewise(c, buf, len);
+}
+
+#ifdef UNZ_HAVE_PCLMUL
+/* Folds four 128 bit lanes 64 bytes at a time, then one lane, then a
+   Barrett reduction to 32 bits, as in "Fast CRC Computation for Generic
+   Polynomials Using PCLMULQDQ Instruction", Gopal et al., Intel 2009.
+   The constants are those of the bit reflected CRC-32 polynomial. */
+#ifdef __GNUC__
+__attribute__((target("pclmul,sse4.1")))
+#endif
+static uint32_t crc32_pclmul(uint32_t c, const Byte *buf, uLong len)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+  uLong tail;
+
+  if (len < 64)
+    return crc32_slice8(c, buf, len);
+  tail = len & 15;
+  len -= tail;
+
+  x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+  buf += 64;
+  len -= 64;
+
+  /* four lanes */
+  while (len >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+    buf += 64;
+    len -= 64;
+  }
+
+  /* fold the lanes into one */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* one lane */
+  while (len >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)buf)), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* 128 to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return crc32_slice8((uint32_t)_mm_extract_epi32(x1, 1), buf, tail);
+}
+#endif
+
+static const char *crc32_names[UNZ_CRC32_NUM] = {
+  NULL, "bytewise", "slice-by-8", "pclmul"
+};
+
+/* ========================================================================= */
+extern const char *unzCrc32Name (int impl)
+{
+  if (!crc_best)
+  {
+    crc32_make_tables();
+    crc_best = UNZ_CRC32_SLICE8;
+#ifdef UNZ_HAVE_PCLMUL
+    if ((Sys_GetProcessorFeatures() & (CF_PCLMUL | CF_SSE41)) == (CF_PCLMUL | CF_SSE41))
+      crc_best = UNZ_CRC32_PCLMUL;
+#endif
+  }
+  if (impl == UNZ_CRC32_BEST)
+    impl = crc_best;
+  if (impl <= UNZ_CRC32_BEST || impl > crc_best)
+    return NULL;
+  return crc32_names[impl];
+}
+
+/* ========================================================================= */
+extern unsigned long unzCrc32 (int impl, unsigned long crc, const void *buf, unsigned long len)
+{
+  uint32_t c;
+
+  if (!unzCrc32Name(impl))
+    impl = crc_best;
+  else if (impl == UNZ_CRC32_BEST)
+    impl = crc_best;
+
+  c = (uint32_t)crc ^ 0xffffffffUL;
+  switch (impl)
+  {
+  case UNZ_CRC32_BYTEWISE:
+    c = crc32_bytewise(c, (const Byte *)buf, len);
+    break;
+#ifdef UNZ_HAVE_PCLMUL
+  case UNZ_CRC32_PCLMUL:
+    c = crc32_pclmul(c, (const Byte *)buf, len);
+    break;
+#endif
+  default:
+    c = crc32_slice8(c, (const Byte *)buf, len);
+    break;
+  }
+  return c ^ 0xffffffffUL;
+}
+
 
 /* infblock.h -- header to use infblock.c
  * Copyright (C) 1995-1998 Mark Adler
@@ -4295,3 +4633,171 @@ void  zcfree (voidp opaque, voidp ptr)
 }
 
 
+
+/* inflate self test -- deflate streams made up here, with fixed Huffman
+   codes, and the output they must give.  Each one starts with more than
+   a window of literals so that it wraps, then a match of 9 at distance 8
+   straight before a match at distance 32768: the first one must not
+   write over the history the second one reads.  Random literals and
+   matches of every distance and length follow. */
+
+#define INFLATE_TEST_STREAMS  16
+#define INFLATE_TEST_WRAP     33000     /* literals before the matches */
+#define INFLATE_TEST_OPS      20000     /* literals and matches after them */
+
+typedef struct {
+  Byte *out;
+  uLong len;
+  uLong acc;            /* bits not written yet */
+  uInt count;           /* bits in acc */
+} inflate_test_writer;
+
+static void inflate_test_bits(inflate_test_writer *w, uLong value, uInt n)
+{
+  w->acc |= value << w->count;
+  w->count += n;
+  while (w->count >= 8)
+  {
+    w->out[w->len++] = (Byte)w->acc;
+    w->acc >>= 8;
+    w->count -= 8;
+  }
+}
+
+/* Huffman codes go out most significant bit first */
+static void inflate_test_code(inflate_test_writer *w, uInt code, uInt n)
+{
+  uInt reversed, i;
+
+  reversed = 0;
+  for (i = 0; i < n; i++)
+    reversed |= ((code >> i) & 1) << (n - 1 - i);
+  inflate_test_bits(w, reversed, n);
+}
+
+static void inflate_test_symbol(inflate_test_writer *w, uInt sym)
+{
+  if (sym < 144)
+    inflate_test_code(w, 0x30 + sym, 8);
+  else if (sym < 256)
+    inflate_test_code(w, 0x190 + sym - 144, 9);
+  else if (sym < 280)
+    inflate_test_code(w, sym - 256, 7);
+  else
+    inflate_test_code(w, 0xc0 + sym - 280, 8);
+}
+
+static void inflate_test_match(inflate_test_writer *w, Byte *expected, uLong *pos, uInt len, uInt dist)
+{
+  int i;
+
+  for (i = 28; cplens[i] > len; i--)
+    ;
+  inflate_test_symbol(w, 257 + i);
+  inflate_test_bits(w, len - cplens[i], cplext[i]);
+  for (i = 29; cpdist[i] > dist; i--)
+    ;
+  inflate_test_code(w, i, 5);
+  inflate_test_bits(w, dist - cpdist[i], cpdext[i]);
+
+  for (; len; len--, (*pos)++)
+    expected[*pos] = expected[*pos - dist];
+}
+
+static uInt inflate_test_random(uLong *seed)
+{
+  *seed = (*seed * 1103515245 + 12345) & 0xffffffffUL;
+  return (uInt)(*seed >> 16);
+}
+
+/* ========================================================================= */
+extern int unzInflateTest (void)
+{
+  inflate_test_writer w;
+  z_stream z;
+  Byte *expected, *output;
+  uLong pos, size, seed;
+  uInt len, dist, stream, i;
+  int err, failed;
+
+  /* every op is at most 258 bytes out and 6 bytes in */
+  size = INFLATE_TEST_WRAP + INFLATE_TEST_STREAMS * 3 + 19 + INFLATE_TEST_OPS * 258 + 300;
+  expected = (Byte *)ALLOC(size);
+  output = (Byte *)ALLOC(size);
+  w.out = (Byte *)ALLOC(size * 2);
+
+  failed = 0;
+  for (stream = 0; stream < INFLATE_TEST_STREAMS; stream++)
+  {
+    seed = stream + 1;
+    w.len = 0;
+    w.acc = 0;
+    w.count = 0;
+    pos = 0;
+
+    inflate_test_bits(&w, 1, 1);        /* last block */
+    inflate_test_bits(&w, 1, 2);        /* fixed codes */
+
+    /* a few extra literals each time to move where the window wraps */
+    len = INFLATE_TEST_WRAP + stream * 3;
+    while (pos < len)
+    {
+      expected[pos] = (Byte)inflate_test_random(&seed);
+      inflate_test_symbol(&w, expected[pos++]);
+    }
+    inflate_test_match(&w, expected, &pos, 9, 8);
+    inflate_test_match(&w, expected, &pos, 10, 32768);
+
+    for (i = 0; i < INFLATE_TEST_OPS; i++)
+    {
+      if (inflate_test_random(&seed) & 1)
+      {
+        expected[pos] = (Byte)inflate_test_random(&seed);
+        inflate_test_symbol(&w, expected[pos++]);
+        continue;
+      }
+      len = 3 + inflate_test_random(&seed) % 256;
+      switch (inflate_test_random(&seed) & 3)
+      {
+      case 0:                           /* runs and short overlaps */
+        dist = 1 + inflate_test_random(&seed) % 8;
+        break;
+      case 1:                           /* the far end of the window */
+        dist = 32768 - inflate_test_random(&seed) % 16;
+        break;
+      default:
+        dist = 1 + (inflate_test_random(&seed) << 8 | inflate_test_random(&seed)) % 32768;
+        break;
+      }
+      inflate_test_match(&w, expected, &pos, len, dist);
+    }
+
+    /* enough input after the last match for the fast loop */
+    for (i = 0; i < 300; i++)
+    {
+      expected[pos] = (Byte)inflate_test_random(&seed);
+      inflate_test_symbol(&w, expected[pos++]);
+    }
+    inflate_test_symbol(&w, 256);       /* end of block */
+    inflate_test_bits(&w, 0, 7);        /* flush the last byte */
+    w.out[w.len++] = 0;                 /* the dummy byte raw inflate needs */
+
+    zmemzero(&z, sizeof(z));
+    z.next_in = w.out;
+    z.avail_in = (uInt)w.len;
+    z.next_out = output;
+    z.avail_out = (uInt)size;          /* room to see the end of block */
+    err = inflateInit2(&z, -MAX_WBITS);
+    while (err == Z_OK)
+      err = inflate(&z, Z_SYNC_FLUSH);
+    inflateEnd(&z);
+
+    if (err != Z_STREAM_END || z.total_out != pos || zmemcmp(output, expected, pos))
+      failed++;
+  }
+
+  TRYFREE(expected);
+  TRYFREE(output);
+  TRYFREE(w.out);
+  return failed;
+}
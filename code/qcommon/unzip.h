@@ -308,6 +308,41 @@ extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
 
+extern int unzReadCurrentFileFromMemory (unzFile file, const void *zip, unsigned long zipLen, void *buf, unsigned len);
+
+/*
+  Same as unzReadCurrentFile, with the compressed data taken from zip, a
+  copy of the whole zipfile in memory (a mapped pk3) instead of the FILE
+*/
+
+/* CRC-32 implementations, UNZ_CRC32_BEST is the fastest one the cpu supports */
+#define UNZ_CRC32_BEST		0
+#define UNZ_CRC32_BYTEWISE	1
+#define UNZ_CRC32_SLICE8	2
+#define UNZ_CRC32_PCLMUL	3
+#define UNZ_CRC32_NUM		4
+
+extern const char *unzCrc32Name (int impl);
+
+/*
+  Name of the CRC-32 implementation impl, or NULL if this cpu or build
+  does not support it
+*/
+
+extern unsigned long unzCrc32 (int impl, unsigned long crc, const void *buf, unsigned long len);
+
+/*
+  Update the running CRC-32 crc with len bytes of buf, start with crc 0.
+  An unsupported impl falls back to UNZ_CRC32_BEST
+*/
+
+extern int unzInflateTest (void);
+
+/*
+  Inflate deflate streams built in memory, with matches at every distance
+  and across window wraps, and return the number whose output is wrong
+*/
+
 extern long unztell(unzFile file);
 
 /*
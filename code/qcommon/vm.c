@@ -35,6 +35,10 @@ and one exported function: Perform
 
 #include "vm_local.h"
 
+#ifdef VM_SAMPLER
+#include <unistd.h>
+#endif
+
 
 vm_t	*currentVM = NULL;
 vm_t	*lastVM    = NULL;
@@ -44,8 +48,20 @@ int		vm_debugLevel;
 vm_t	vmTable[MAX_VM];
 
 
+static cvar_t	*vm_syscallStats;
+cvar_t			*vm_sandbox;
+cvar_t			*vm_cache;
+cvar_t			*vm_threaded;
+
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+void VM_Syscalls_f( void );
+#ifdef VM_SAMPLER
+void VM_SampleProfile_f( void );
+static void VM_ProfileAttach( vm_t *vm );
+static void VM_ProfileDetach( vm_t *vm );
+static qboolean	vmProfiling;
+#endif
 
 
 
@@ -70,9 +86,17 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	vm_syscallStats = Cvar_Get( "vm_syscallStats", "0", 0 );
+	vm_sandbox = Cvar_Get( "vm_sandbox", "0", CVAR_ARCHIVE );
+	vm_cache = Cvar_Get( "vm_cache", "1", CVAR_ARCHIVE );
+	vm_threaded = Cvar_Get( "vm_threaded", "1", CVAR_ARCHIVE );
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vmsyscalls", VM_Syscalls_f );
+#ifdef VM_SAMPLER
+	Cmd_AddCommand ("vmprof", VM_SampleProfile_f );
+#endif
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -269,6 +293,14 @@ void VM_LoadSymbols( vm_t *vm ) {
 			Com_Printf( "WARNING: incomplete line at end of file\n" );
 			break;
 		}
+		// system calls aren't instructions, and q3asm writes the bss
+		// addresses of the stack into whatever segment came last, either
+		// would break the ascending order the lookups depend on
+		if ( value < 0 || value >= numInstructions
+			|| !strcmp( token, "_stackStart" ) || !strcmp( token, "_stackEnd" ) ) {
+			continue;
+		}
+
 		chars = strlen( token );
 		sym = Hunk_Alloc( sizeof( *sym ) + chars, h_high );
 		*prev = sym;
@@ -276,11 +308,7 @@ void VM_LoadSymbols( vm_t *vm ) {
 		sym->next = NULL;
 
 		// convert value from an instruction number to a code offset
-		if ( value >= 0 && value < numInstructions ) {
-			value = vm->instructionPointers[value];
-		}
-
-		sym->symValue = value;
+		sym->symValue = vm->instructionPointers[value];
 		Q_strncpyz( sym->symName, token, chars + 1 );
 
 		count++;
@@ -291,6 +319,68 @@ void VM_LoadSymbols( vm_t *vm ) {
 	FS_FreeFile( mapfile );
 }
 
+/*
+============
+VM_SetSyscallTable
+============
+*/
+void VM_SetSyscallTable( vm_t *vm, const vmSyscall_t *table, int count ) {
+	vm->syscallTable = table;
+	vm->numSyscalls = count;
+}
+
+/*
+============
+VM_SystemCall
+
+The interpreter and the x86_64 compiler come here with a pointer to the
+module's int arguments.  Traps in the syscall table read them directly,
+everything else goes through the systemCall switch with the arguments
+widened to intptr_t.
+============
+*/
+intptr_t VM_SystemCall( vm_t *vm, int *args, int callnum ) {
+	intptr_t		wide[16];
+	vmSyscallStat_t	*stat;
+	int64_t			start;
+	intptr_t		r;
+	int				i, count;
+
+	start = 0;
+	if ( vm_syscallStats->integer ) {
+		start = Sys_Microseconds();
+	}
+
+	if ( (unsigned)callnum < vm->numSyscalls && vm->syscallTable[callnum] ) {
+		r = vm->syscallTable[callnum]( args );
+	} else {
+		// don't read past the end of the data, it may be a guard page
+		count = ( vm->dataMask + 1 - ( (byte *)args - vm->dataBase ) ) >> 2;
+		if ( count > 16 ) {
+			count = 16;
+		}
+		wide[0] = callnum;
+		for ( i = 1 ; i < count ; i++ ) {
+			wide[i] = args[i];
+		}
+		for ( ; i < 16 ; i++ ) {
+			wide[i] = 0;
+		}
+		r = vm->systemCall( wide );
+	}
+
+	if ( start ) {
+		if ( !vm->syscallStats ) {
+			vm->syscallStats = Z_Malloc( VM_SYSCALL_STATS * sizeof( *vm->syscallStats ) );
+		}
+		stat = &vm->syscallStats[(unsigned)callnum < VM_SYSCALL_STATS ? callnum : VM_SYSCALL_STATS - 1];
+		stat->calls++;
+		stat->usec += Sys_Microseconds() - start;
+	}
+
+	return r;
+}
+
 /*
 ============
 VM_DllSyscall
@@ -513,6 +603,7 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	vm_t		*vm;
 	vmHeader_t	*header;
 	int			i, remaining;
+	int64_t		compileStart;
 
 	if ( !module || !module[0] || !systemCalls ) {
 		Com_Error( ERR_FATAL, "VM_Create: bad parms" );
@@ -578,7 +669,9 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 #else
 	if ( interpret >= VMI_COMPILED ) {
 		vm->compiled = qtrue;
+		compileStart = Sys_Microseconds();
 		VM_Compile( vm, header );
+		vm->compileTime = (int)( Sys_Microseconds() - compileStart );
 	}
 #endif
 	// VM_Compile may have reset vm->compiled if compilation failed
@@ -593,6 +686,12 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	// load the map file
 	VM_LoadSymbols( vm );
 
+#ifdef VM_SAMPLER
+	if ( vmProfiling ) {
+		VM_ProfileAttach( vm );
+	}
+#endif
+
 	// the stack is implicitly at the end of the image
 	vm->programStack = vm->dataMask + 1;
 	vm->stackBottom = vm->programStack - STACK_SIZE;
@@ -609,6 +708,14 @@ VM_Free
 */
 void VM_Free( vm_t *vm ) {
 
+	if ( vm->syscallStats ) {
+		Z_Free( vm->syscallStats );
+	}
+
+#ifdef VM_SAMPLER
+	VM_ProfileDetach( vm );
+#endif
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
@@ -680,6 +787,30 @@ void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 }
 
 
+/*
+============
+VM_ArgArray
+
+Like VM_ArgPtr for count elements of size bytes, NULL if any of
+them would fall outside the data segment of a bytecode module
+============
+*/
+void *VM_ArgArray( intptr_t intValue, int count, int size ) {
+	if ( !intValue || !currentVM || count <= 0 || size <= 0 ) {
+		return NULL;
+	}
+
+	if ( currentVM->entryPoint ) {
+		return (void *)(currentVM->dataBase + intValue);
+	}
+	if ( intValue < 0 || intValue > currentVM->dataMask
+		|| (int64_t)count * size > currentVM->dataMask + 1 - intValue ) {
+		return NULL;
+	}
+	return (void *)(currentVM->dataBase + intValue);
+}
+
+
 /*
 ==============
 VM_Call
@@ -836,6 +967,279 @@ void VM_VmProfile_f( void ) {
 	Z_Free( sorted );
 }
 
+#ifdef VM_SAMPLER
+/*
+=============================================================================
+
+vmprof
+
+Sampling works with compiled code, where VM_VmProfile_f has no counts.
+While it runs every compiled vm has a hit counter per instruction, and
+/tmp/perf-<pid>.map names the functions of the code for Linux perf.
+Function names need the .map file, which is only read with developer 1.
+The kernel checks the timer once per tick, which caps the real rate.
+
+=============================================================================
+*/
+
+#define	VM_PROFILE_HZ		1000
+#define	VM_PROFILE_LINES	25
+
+int				vmSamplesOther;
+static int		vmProfileHz;
+static int		vmProfileStart;
+static int		*vmProfileCounts;	// for VM_ProfileInstructionSort
+
+/*
+==============
+VM_WritePerfMap
+
+Appends "<start> <size> <name>" lines in hex for the code of a vm
+==============
+*/
+static void VM_WritePerfMap( vm_t *vm ) {
+	vmSymbol_t	*sym;
+	FILE		*f;
+	int			end;
+
+	f = fopen( va( "/tmp/perf-%i.map", (int)getpid() ), "a" );
+	if ( !f ) {
+		return;
+	}
+
+	if ( !vm->symbols ) {
+		fprintf( f, "%lx %x %s\n", (unsigned long)vm->codeBase, vm->codeLength, vm->name );
+	}
+	for ( sym = vm->symbols ; sym ; sym = sym->next ) {
+		end = sym->next ? sym->next->symValue : vm->codeLength;
+		if ( sym->symValue < 0 || end <= sym->symValue || end > vm->codeLength ) {
+			continue;
+		}
+		fprintf( f, "%lx %x %s:%s\n", (unsigned long)( vm->codeBase + sym->symValue ),
+			end - sym->symValue, vm->name, sym->symName );
+	}
+
+	fclose( f );
+}
+
+/*
+==============
+VM_ProfileAttach
+==============
+*/
+static void VM_ProfileAttach( vm_t *vm ) {
+	if ( !vm->compiled || vm->sampleCounts ) {
+		return;
+	}
+	vm->sampleSyscalls = 0;
+	vm->sampleCounts = Z_Malloc( vm->instructionPointersLength );
+	VM_WritePerfMap( vm );
+}
+
+/*
+==============
+VM_ProfileDetach
+==============
+*/
+static void VM_ProfileDetach( vm_t *vm ) {
+	int		*counts;
+
+	// the signal handler must never see freed memory
+	counts = vm->sampleCounts;
+	vm->sampleCounts = NULL;
+	if ( counts ) {
+		Z_Free( counts );
+	}
+}
+
+/*
+==============
+VM_ProfileCodeHits
+==============
+*/
+static int VM_ProfileCodeHits( vm_t *vm ) {
+	int		i, hits;
+
+	hits = 0;
+	for ( i = 0 ; i < vm->instructionPointersLength >> 2 ; i++ ) {
+		hits += vm->sampleCounts[i];
+	}
+	return hits;
+}
+
+/*
+==============
+VM_ProfileInstructionSort
+==============
+*/
+static int QDECL VM_ProfileInstructionSort( const void *a, const void *b ) {
+	return vmProfileCounts[*(const int *)a] - vmProfileCounts[*(const int *)b];
+}
+
+/*
+==============
+VM_ProfileReport
+
+Most frequent last, like vmprofile
+==============
+*/
+static void VM_ProfileReport( vm_t *vm, int total ) {
+	vmSymbol_t	**sorted, *sym;
+	int			*order;
+	int			i, count, numInstructions, inCode;
+
+	numInstructions = vm->instructionPointersLength >> 2;
+	inCode = VM_ProfileCodeHits( vm );
+	Com_Printf( "%s: %i in code, %i in system calls\n", vm->name, inCode, vm->sampleSyscalls );
+	if ( !inCode ) {
+		return;
+	}
+
+	if ( !vm->numSymbols ) {
+		// no .map, show instructions instead
+		order = Z_Malloc( numInstructions * sizeof( *order ) );
+		for ( i = 0 ; i < numInstructions ; i++ ) {
+			order[i] = i;
+		}
+		vmProfileCounts = vm->sampleCounts;
+		qsort( order, numInstructions, sizeof( *order ), VM_ProfileInstructionSort );
+
+		i = numInstructions > VM_PROFILE_LINES ? numInstructions - VM_PROFILE_LINES : 0;
+		for ( ; i < numInstructions ; i++ ) {
+			count = vm->sampleCounts[order[i]];
+			if ( count ) {
+				Com_Printf( "%5.1f%% %8i instruction %i\n", 100.0f * count / total, count, order[i] );
+			}
+		}
+		Z_Free( order );
+		return;
+	}
+
+	// symbols are ascending code offsets, so one pass assigns every instruction
+	sorted = Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
+	sym = vm->symbols;
+	for ( i = 0 ; i < vm->numSymbols ; i++, sym = sym->next ) {
+		sorted[i] = sym;
+		sym->profileCount = 0;
+	}
+	sym = vm->symbols;
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		while ( sym->next && sym->next->symValue <= vm->instructionPointers[i] ) {
+			sym = sym->next;
+		}
+		sym->profileCount += vm->sampleCounts[i];
+	}
+
+	qsort( sorted, vm->numSymbols, sizeof( *sorted ), VM_ProfileSort );
+
+	i = vm->numSymbols > VM_PROFILE_LINES ? vm->numSymbols - VM_PROFILE_LINES : 0;
+	for ( ; i < vm->numSymbols ; i++ ) {
+		sym = sorted[i];
+		if ( sym->profileCount ) {
+			Com_Printf( "%5.1f%% %8i %s\n", 100.0f * sym->profileCount / total, sym->profileCount, sym->symName );
+		}
+		sym->profileCount = 0;
+	}
+
+	Z_Free( sorted );
+}
+
+/*
+==============
+VM_SampleProfile_f
+
+vmprof [start [hz] | stop | reset]
+==============
+*/
+void VM_SampleProfile_f( void ) {
+	vm_t	*vm;
+	char	*cmd;
+	int		i, total;
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		vmProfileHz = VM_PROFILE_HZ;
+		if ( Cmd_Argc() > 2 ) {
+			vmProfileHz = atoi( Cmd_Argv( 2 ) );
+		}
+		if ( vmProfileHz < 10 ) {
+			vmProfileHz = 10;
+		} else if ( vmProfileHz > 10000 ) {
+			vmProfileHz = 10000;
+		}
+
+		// a new session starts with a new perf map
+		remove( va( "/tmp/perf-%i.map", (int)getpid() ) );
+		for ( i = 0 ; i < MAX_VM ; i++ ) {
+			VM_ProfileDetach( &vmTable[i] );
+			VM_ProfileAttach( &vmTable[i] );
+		}
+		vmSamplesOther = 0;
+		vmProfileStart = Sys_Milliseconds();
+
+		if ( !VM_SamplerStart( vmProfileHz ) ) {
+			Com_Printf( "vmprof: couldn't start the profiling timer\n" );
+			return;
+		}
+		vmProfiling = qtrue;
+		Com_Printf( "Sampling compiled vms at %i Hz, perf map in /tmp/perf-%i.map\n", vmProfileHz, (int)getpid() );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "stop" ) ) {
+		VM_SamplerStop();
+		vmProfiling = qfalse;
+		Com_Printf( "vmprof stopped\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "reset" ) ) {
+		for ( i = 0 ; i < MAX_VM ; i++ ) {
+			vm = &vmTable[i];
+			if ( vm->sampleCounts ) {
+				Com_Memset( vm->sampleCounts, 0, vm->instructionPointersLength );
+				vm->sampleSyscalls = 0;
+			}
+		}
+		vmSamplesOther = 0;
+		vmProfileStart = Sys_Milliseconds();
+		Com_Printf( "vmprof cleared\n" );
+		return;
+	}
+
+	if ( *cmd ) {
+		Com_Printf( "Usage: vmprof [start [hz] | stop | reset]\n" );
+		return;
+	}
+
+	total = vmSamplesOther;
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( vm->sampleCounts ) {
+			total += VM_ProfileCodeHits( vm ) + vm->sampleSyscalls;
+		}
+	}
+
+	if ( !vmProfiling ) {
+		Com_Printf( "vmprof isn't running, use \"vmprof start\"\n" );
+	}
+	if ( !total ) {
+		Com_Printf( "No samples.\n" );
+		return;
+	}
+
+	Com_Printf( "%i samples at %i Hz in %i sec, %i outside any vm\n", total, vmProfileHz,
+		( Sys_Milliseconds() - vmProfileStart ) / 1000, vmSamplesOther );
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( vm->sampleCounts ) {
+			VM_ProfileReport( vm, total );
+		}
+	}
+}
+#endif
+
 /*
 ==============
 VM_VmInfo_f
@@ -858,13 +1262,85 @@ void VM_VmInfo_f( void ) {
 			continue;
 		}
 		if ( vm->compiled ) {
-			Com_Printf( "compiled on load\n" );
+			Com_Printf( "compiled on load in %i.%03i msec%s\n", vm->compileTime / 1000, vm->compileTime % 1000,
+				vm->codeCached ? " (cached)" : "" );
 		} else {
-			Com_Printf( "interpreted\n" );
+			Com_Printf( "interpreted%s\n", vm->threaded ? " (threaded)" : "" );
 		}
 		Com_Printf( "    code length : %7i\n", vm->codeLength );
 		Com_Printf( "    table length: %7i\n", vm->instructionPointersLength );
-		Com_Printf( "    data length : %7i\n", vm->dataMask + 1 );
+		Com_Printf( "    data length : %7i%s\n", vm->dataMask + 1, vm->dataGuarded ? " (sandboxed)" : "" );
+	}
+}
+
+/*
+==============
+VM_SyscallSort
+==============
+*/
+static vmSyscallStat_t	*vmSortStats;
+
+static int QDECL VM_SyscallSort( const void *a, const void *b ) {
+	int64_t		ta, tb;
+
+	ta = vmSortStats[*(const int *)a].usec;
+	tb = vmSortStats[*(const int *)b].usec;
+	if ( ta < tb ) {
+		return -1;
+	}
+	return ta > tb;
+}
+
+/*
+==============
+VM_Syscalls_f
+
+vmsyscalls [reset], most time last like vmprofile
+==============
+*/
+void VM_Syscalls_f( void ) {
+	vm_t			*vm;
+	vmSyscallStat_t	*stat;
+	int				order[VM_SYSCALL_STATS];
+	int				i, j;
+
+	if ( !vm_syscallStats->integer ) {
+		Com_Printf( "vm_syscallStats is 0, no system calls are being counted.\n" );
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		for ( i = 0 ; i < MAX_VM ; i++ ) {
+			if ( vmTable[i].syscallStats ) {
+				Com_Memset( vmTable[i].syscallStats, 0, VM_SYSCALL_STATS * sizeof( vmSyscallStat_t ) );
+			}
+		}
+		Com_Printf( "System call counters cleared.\n" );
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( !vm->syscallStats ) {
+			continue;
+		}
+
+		for ( j = 0 ; j < VM_SYSCALL_STATS ; j++ ) {
+			order[j] = j;
+		}
+		vmSortStats = vm->syscallStats;
+		qsort( order, VM_SYSCALL_STATS, sizeof( order[0] ), VM_SyscallSort );
+
+		Com_Printf( "%s system calls:\n", vm->name );
+		Com_Printf( "call    calls      usec  usec/call\n" );
+		for ( j = 0 ; j < VM_SYSCALL_STATS ; j++ ) {
+			stat = &vm->syscallStats[order[j]];
+			if ( !stat->calls ) {
+				continue;
+			}
+			Com_Printf( "%4i %8i %9i %10.2f%s\n", order[j], stat->calls, (int)stat->usec,
+				(float)stat->usec / stat->calls, vm->syscallTable && order[j] < vm->numSyscalls
+				&& vm->syscallTable[order[j]] ? " (table)" : "" );
+		}
 	}
 }
 
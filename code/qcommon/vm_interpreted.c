@@ -22,6 +22,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "vm_local.h"
 
 //#define	DEBUG_VM
+
+// computed goto dispatch, see VM_RunThreaded
+#if defined(__GNUC__) && !defined(DEBUG_VM)
+#define	VM_THREADED
+#endif
+
 #ifdef DEBUG_VM
 static char	*opnames[256] = {
 	"OP_UNDEF", 
@@ -141,6 +147,11 @@ static ID_INLINE unsigned int __lwbrx(register void *addr,
     }
 #endif
 
+#ifdef VM_THREADED
+static void VM_PrepareThreaded( vm_t *vm, vmHeader_t *header );
+static int VM_RunThreaded( vm_t *vm, int *args );
+#endif
+
 char *VM_Indent( vm_t *vm ) {
 	static char	*string = "                                        ";
 	if ( vm->callLevel > 20 ) {
@@ -174,6 +185,14 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int		instruction;
 	int		*codeBase;
 
+#ifdef VM_THREADED
+	if ( vm_threaded->integer ) {
+		VM_PrepareThreaded( vm, header );
+		return;
+	}
+#endif
+	vm->threaded = qfalse;
+
 	vm->codeBase = Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
 //	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
@@ -338,6 +357,12 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	vmSymbol_t	*profileSymbol;
 #endif
 
+#ifdef VM_THREADED
+	if ( vm->threaded ) {
+		return VM_RunThreaded( vm, args );
+	}
+#endif
+
 	// interpret the code
 	vm->currentlyInterpreting = qtrue;
 
@@ -533,20 +558,7 @@ nextInstruction2:
 				*(int *)&image[ programStack + 4 ] = -1 - programCounter;
 
 //VM_LogSyscalls( (int *)&image[ programStack + 4 ] );
-				{
-					intptr_t* argptr = (intptr_t *)&image[ programStack + 4 ];
-				#if __WORDSIZE == 64
-				// the vm has ints on the stack, we expect
-				// longs so we have to convert it
-					intptr_t argarr[16];
-					int i;
-					for (i = 0; i < 16; ++i) {
-						argarr[i] = *(int*)&image[ programStack + 4 + 4*i ];
-					}
-					argptr = argarr;
-				#endif
-					r = vm->systemCall( argptr );
-				}
+				r = VM_SystemCall( vm, (int *)&image[ programStack + 4 ], -1 - programCounter );
 
 #ifdef DEBUG_VM
 				// this is just our stack frame pointer, only needed
@@ -919,3 +931,636 @@ done:
 	// return the result
 	return *opStack;
 }
+
+#ifdef VM_THREADED
+/*
+=============================================================================
+
+THREADED INTERPRETER
+
+VM_PrepareThreaded decodes the bytecode once into one vmThreadedOp_t per
+instruction.  The program counter is an instruction number and every
+handler ends in a computed goto to the next one, so there is no switch
+and no per opcode range check.  An extra entry past the last instruction
+catches code that runs off the end, and branch targets outside the code
+are pointed at it when decoding.
+
+The opcode pairs qagame runs most often are fused into superinstructions
+on their first instruction.  The second instruction keeps its own entry,
+so branching to it still works.
+
+=============================================================================
+*/
+
+// superinstructions, numbered after the bytecode opcodes
+enum {
+	VMT_LOCAL_LOAD4 = OP_CVFI + 1,	// push local variable
+	VMT_CONST_LOAD4,				// push global variable
+	VMT_CONST_ADD,					// structure field address
+	VMT_ADD_LOAD4,
+	VMT_ADD_STORE4,
+	VMT_CONST_JUMP,
+	VMT_CONST_CALL,
+	VMT_CONST_EQ,					// compare with a constant and branch
+	VMT_CONST_NE,
+	VMT_CONST_LTI,
+	VMT_CONST_LEI,
+	VMT_CONST_GTI,
+	VMT_CONST_GEI,
+
+	VMT_BAD,						// undefined opcode or past the end
+	VMT_NUM_OPS
+};
+
+typedef struct {
+	const void	*label;				// opcode until linked by VM_LinkThreaded
+	int			arg;				// immediate, branch targets are instruction numbers
+} vmThreadedOp_t;
+
+static const void	**vmThreadedLabels;
+
+/*
+====================
+VM_ThreadedFuse
+
+Superinstruction for the pair starting at op, or op itself
+====================
+*/
+static int VM_ThreadedFuse( int op, int next ) {
+	switch ( op ) {
+	case OP_LOCAL:
+		return next == OP_LOAD4 ? VMT_LOCAL_LOAD4 : op;
+	case OP_ADD:
+		if ( next == OP_LOAD4 ) {
+			return VMT_ADD_LOAD4;
+		}
+		return next == OP_STORE4 ? VMT_ADD_STORE4 : op;
+	case OP_CONST:
+		switch ( next ) {
+		case OP_LOAD4:
+			return VMT_CONST_LOAD4;
+		case OP_ADD:
+			return VMT_CONST_ADD;
+		case OP_JUMP:
+			return VMT_CONST_JUMP;
+		case OP_CALL:
+			return VMT_CONST_CALL;
+		case OP_EQ:
+			return VMT_CONST_EQ;
+		case OP_NE:
+			return VMT_CONST_NE;
+		case OP_LTI:
+			return VMT_CONST_LTI;
+		case OP_LEI:
+			return VMT_CONST_LEI;
+		case OP_GTI:
+			return VMT_CONST_GTI;
+		case OP_GEI:
+			return VMT_CONST_GEI;
+		}
+		return op;
+	}
+	return op;
+}
+
+/*
+====================
+VM_PrepareThreaded
+====================
+*/
+static void VM_PrepareThreaded( vm_t *vm, vmHeader_t *header ) {
+	vmThreadedOp_t	*code;
+	byte			*bytecode;
+	int				count, instruction, pc, op;
+
+	if ( !vmThreadedLabels ) {
+		VM_RunThreaded( NULL, NULL );
+	}
+
+	count = header->instructionCount;
+	code = Hunk_Alloc( ( count + 1 ) * sizeof( *code ), h_high );
+	bytecode = (byte *)header + header->codeOffset;
+
+	pc = 0;
+	for ( instruction = 0 ; instruction < count ; instruction++ ) {
+		if ( pc >= header->codeLength ) {
+			Com_Error( ERR_DROP, "VM_PrepareThreaded: pc > header->codeLength" );
+		}
+		// symbols and vmprofile still use bytecode offsets
+		vm->instructionPointers[instruction] = pc;
+
+		op = bytecode[pc++];
+		code[instruction].label = (void *)(intptr_t)( op > OP_CVFI ? VMT_BAD : op );
+
+		switch ( op ) {
+		case OP_ENTER:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_LEAVE:
+		case OP_BLOCK_COPY:
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			if ( pc + 4 > header->codeLength ) {
+				Com_Error( ERR_DROP, "VM_PrepareThreaded: pc > header->codeLength" );
+			}
+			code[instruction].arg = loadWord( &bytecode[pc] );
+			pc += 4;
+			break;
+		case OP_ARG:
+			code[instruction].arg = bytecode[pc];
+			pc += 1;
+			break;
+		}
+
+		if ( op >= OP_EQ && op <= OP_GEF && (unsigned)code[instruction].arg >= count ) {
+			code[instruction].arg = count;
+		}
+	}
+	code[count].label = (void *)(intptr_t)VMT_BAD;
+
+	// fuse pairs, then turn the opcodes into labels
+	for ( instruction = 0 ; instruction < count - 1 ; instruction++ ) {
+		op = VM_ThreadedFuse( (intptr_t)code[instruction].label, (intptr_t)code[instruction + 1].label );
+		code[instruction].label = (void *)(intptr_t)op;
+	}
+	for ( instruction = 0 ; instruction <= count ; instruction++ ) {
+		code[instruction].label = vmThreadedLabels[(intptr_t)code[instruction].label];
+	}
+
+	vm->codeBase = (byte *)code;
+	vm->threaded = qtrue;
+}
+
+/*
+====================
+VM_RunThreaded
+
+Called with a NULL vm to fill in vmThreadedLabels
+====================
+*/
+static int VM_RunThreaded( vm_t *vm, int *args ) {
+	static const void *labels[VMT_NUM_OPS] = {
+		[OP_UNDEF] = &&bad,
+		[OP_IGNORE] = &&ignore,
+		[OP_BREAK] = &&brk,
+		[OP_ENTER] = &&enter,
+		[OP_LEAVE] = &&leave,
+		[OP_CALL] = &&call,
+		[OP_PUSH] = &&push,
+		[OP_POP] = &&pop,
+		[OP_CONST] = &&constant,
+		[OP_LOCAL] = &&local,
+		[OP_JUMP] = &&jump,
+		[OP_EQ] = &&eq,
+		[OP_NE] = &&ne,
+		[OP_LTI] = &&lti,
+		[OP_LEI] = &&lei,
+		[OP_GTI] = &&gti,
+		[OP_GEI] = &&gei,
+		[OP_LTU] = &&ltu,
+		[OP_LEU] = &&leu,
+		[OP_GTU] = &&gtu,
+		[OP_GEU] = &&geu,
+		[OP_EQF] = &&eqf,
+		[OP_NEF] = &&nef,
+		[OP_LTF] = &&ltf,
+		[OP_LEF] = &&lef,
+		[OP_GTF] = &&gtf,
+		[OP_GEF] = &&gef,
+		[OP_LOAD1] = &&load1,
+		[OP_LOAD2] = &&load2,
+		[OP_LOAD4] = &&load4,
+		[OP_STORE1] = &&store1,
+		[OP_STORE2] = &&store2,
+		[OP_STORE4] = &&store4,
+		[OP_ARG] = &&arg,
+		[OP_BLOCK_COPY] = &&block_copy,
+		[OP_SEX8] = &&sex8,
+		[OP_SEX16] = &&sex16,
+		[OP_NEGI] = &&negi,
+		[OP_ADD] = &&add,
+		[OP_SUB] = &&sub,
+		[OP_DIVI] = &&divi,
+		[OP_DIVU] = &&divu,
+		[OP_MODI] = &&modi,
+		[OP_MODU] = &&modu,
+		[OP_MULI] = &&muli,
+		[OP_MULU] = &&mulu,
+		[OP_BAND] = &&band,
+		[OP_BOR] = &&bor,
+		[OP_BXOR] = &&bxor,
+		[OP_BCOM] = &&bcom,
+		[OP_LSH] = &&lsh,
+		[OP_RSHI] = &&rshi,
+		[OP_RSHU] = &&rshu,
+		[OP_NEGF] = &&negf,
+		[OP_ADDF] = &&addf,
+		[OP_SUBF] = &&subf,
+		[OP_DIVF] = &&divf,
+		[OP_MULF] = &&mulf,
+		[OP_CVIF] = &&cvif,
+		[OP_CVFI] = &&cvfi,
+		[VMT_LOCAL_LOAD4] = &&local_load4,
+		[VMT_CONST_LOAD4] = &&const_load4,
+		[VMT_CONST_ADD] = &&const_add,
+		[VMT_ADD_LOAD4] = &&add_load4,
+		[VMT_ADD_STORE4] = &&add_store4,
+		[VMT_CONST_JUMP] = &&const_jump,
+		[VMT_CONST_CALL] = &&const_call,
+		[VMT_CONST_EQ] = &&const_eq,
+		[VMT_CONST_NE] = &&const_ne,
+		[VMT_CONST_LTI] = &&const_lti,
+		[VMT_CONST_LEI] = &&const_lei,
+		[VMT_CONST_GTI] = &&const_gti,
+		[VMT_CONST_GEI] = &&const_gei,
+		[VMT_BAD] = &&bad
+	};
+	int						stack[MAX_STACK];
+	int						*opStack;
+	const vmThreadedOp_t	*code, *ip;
+	byte					*image;
+	int						programStack, stackOnEntry;
+	int						dataMask, count, target, next, level;
+
+	if ( !vm ) {
+		vmThreadedLabels = labels;
+		return 0;
+	}
+
+	vm->currentlyInterpreting = qtrue;
+
+	// we might be called recursively, so this might not be the very top
+	programStack = stackOnEntry = vm->programStack;
+
+	image = vm->dataBase;
+	dataMask = vm->dataMask;
+	code = (const vmThreadedOp_t *)vm->codeBase;
+	count = vm->instructionPointersLength >> 2;
+
+	// stack[0] is never written, as long as opStack is valid
+	// opStack[-1] will not corrupt anything
+	opStack = stack;
+
+	programStack -= 48;
+
+	*(int *)&image[ programStack + 44] = args[9];
+	*(int *)&image[ programStack + 40] = args[8];
+	*(int *)&image[ programStack + 36] = args[7];
+	*(int *)&image[ programStack + 32] = args[6];
+	*(int *)&image[ programStack + 28] = args[5];
+	*(int *)&image[ programStack + 24] = args[4];
+	*(int *)&image[ programStack + 20] = args[3];
+	*(int *)&image[ programStack + 16] = args[2];
+	*(int *)&image[ programStack + 12] = args[1];
+	*(int *)&image[ programStack + 8 ] = args[0];
+	*(int *)&image[ programStack + 4 ] = 0;	// return stack
+	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
+
+	vm->callLevel = 0;
+
+#define	NEXT()			goto *(++ip)->label
+#define	SKIP2()			ip += 2; goto *ip->label
+#define	BRANCH(n)		ip = code + (n); goto *ip->label
+#define	CONDITION(c)	if ( c ) { BRANCH( ip->arg ); } NEXT()
+#define	CONDITION2(c)	if ( c ) { BRANCH( ip[1].arg ); } SKIP2()
+
+	ip = code;
+	goto *ip->label;
+
+bad:
+	Com_Error( ERR_DROP, "VM bad instruction %i", (int)( ip - code ) );
+ignore:
+	NEXT();
+brk:
+	vm->breakCount++;
+	NEXT();
+
+enter:
+	programStack -= ip->arg;
+	NEXT();
+leave:
+	programStack += ip->arg;
+	// grab the saved instruction, -1 is leaving the VM
+	target = *(int *)&image[ programStack ];
+	if ( target == -1 ) {
+		goto done;
+	}
+	if ( (unsigned)target >= count ) {
+		Com_Error( ERR_DROP, "VM program counter out of range in OP_LEAVE" );
+	}
+	BRANCH( target );
+
+call:
+	target = *opStack--;
+	next = ip + 1 - code;
+	goto docall;
+const_call:
+	target = ip->arg;
+	next = ip + 2 - code;
+docall:
+	// save the instruction to return to
+	*(int *)&image[ programStack ] = next;
+	if ( target < 0 ) {
+		// system call, save the stack to allow recursive VM entry
+		level = vm->callLevel;
+		vm->programStack = programStack - 4;
+		*(int *)&image[ programStack + 4 ] = -1 - target;
+		*++opStack = VM_SystemCall( vm, (int *)&image[ programStack + 4 ], -1 - target );
+		vm->callLevel = level;
+		BRANCH( next );
+	}
+	if ( target >= count ) {
+		Com_Error( ERR_DROP, "VM program counter out of range in OP_CALL" );
+	}
+	BRANCH( target );
+
+// push and pop are only needed for discarded or bad function return values
+push:
+	opStack++;
+	NEXT();
+pop:
+	opStack--;
+	NEXT();
+
+constant:
+	*++opStack = ip->arg;
+	NEXT();
+local:
+	*++opStack = ip->arg + programStack;
+	NEXT();
+
+jump:
+	target = *opStack--;
+	if ( (unsigned)target >= count ) {
+		Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
+	}
+	BRANCH( target );
+const_jump:
+	target = ip->arg;
+	if ( (unsigned)target >= count ) {
+		Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
+	}
+	BRANCH( target );
+
+eq:
+	opStack -= 2;
+	CONDITION( opStack[1] == opStack[2] );
+ne:
+	opStack -= 2;
+	CONDITION( opStack[1] != opStack[2] );
+lti:
+	opStack -= 2;
+	CONDITION( opStack[1] < opStack[2] );
+lei:
+	opStack -= 2;
+	CONDITION( opStack[1] <= opStack[2] );
+gti:
+	opStack -= 2;
+	CONDITION( opStack[1] > opStack[2] );
+gei:
+	opStack -= 2;
+	CONDITION( opStack[1] >= opStack[2] );
+ltu:
+	opStack -= 2;
+	CONDITION( (unsigned)opStack[1] < (unsigned)opStack[2] );
+leu:
+	opStack -= 2;
+	CONDITION( (unsigned)opStack[1] <= (unsigned)opStack[2] );
+gtu:
+	opStack -= 2;
+	CONDITION( (unsigned)opStack[1] > (unsigned)opStack[2] );
+geu:
+	opStack -= 2;
+	CONDITION( (unsigned)opStack[1] >= (unsigned)opStack[2] );
+eqf:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] == ((float *)opStack)[2] );
+nef:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] != ((float *)opStack)[2] );
+ltf:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] < ((float *)opStack)[2] );
+lef:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] <= ((float *)opStack)[2] );
+gtf:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] > ((float *)opStack)[2] );
+gef:
+	opStack -= 2;
+	CONDITION( ((float *)opStack)[1] >= ((float *)opStack)[2] );
+
+const_eq:
+	CONDITION2( *opStack-- == ip->arg );
+const_ne:
+	CONDITION2( *opStack-- != ip->arg );
+const_lti:
+	CONDITION2( *opStack-- < ip->arg );
+const_lei:
+	CONDITION2( *opStack-- <= ip->arg );
+const_gti:
+	CONDITION2( *opStack-- > ip->arg );
+const_gei:
+	CONDITION2( *opStack-- >= ip->arg );
+
+load1:
+	*opStack = image[ *opStack & dataMask ];
+	NEXT();
+load2:
+	*opStack = *(unsigned short *)&image[ *opStack & dataMask ];
+	NEXT();
+load4:
+	*opStack = *(int *)&image[ *opStack & dataMask ];
+	NEXT();
+local_load4:
+	*++opStack = *(int *)&image[ ( ip->arg + programStack ) & dataMask ];
+	SKIP2();
+const_load4:
+	*++opStack = *(int *)&image[ ip->arg & dataMask ];
+	SKIP2();
+add_load4:
+	opStack--;
+	*opStack = *(int *)&image[ ( opStack[0] + opStack[1] ) & dataMask ];
+	SKIP2();
+
+store1:
+	image[ opStack[-1] & dataMask ] = opStack[0];
+	opStack -= 2;
+	NEXT();
+store2:
+	*(short *)&image[ opStack[-1] & ( dataMask & ~1 ) ] = opStack[0];
+	opStack -= 2;
+	NEXT();
+store4:
+	*(int *)&image[ opStack[-1] & ( dataMask & ~3 ) ] = opStack[0];
+	opStack -= 2;
+	NEXT();
+add_store4:
+	// the address is below the two added values
+	*(int *)&image[ opStack[-2] & ( dataMask & ~3 ) ] = opStack[-1] + opStack[0];
+	opStack -= 3;
+	SKIP2();
+
+arg:
+	// single byte offset from programStack
+	*(int *)&image[ ( ip->arg + programStack ) & dataMask ] = *opStack--;
+	NEXT();
+
+block_copy:
+	{
+		int		*src, *dest;
+		int		i, n, srci, desti;
+
+		n = ip->arg;
+		// MrE: copy range check
+		srci = opStack[0] & dataMask;
+		desti = opStack[-1] & dataMask;
+		n = ((srci + n) & dataMask) - srci;
+		n = ((desti + n) & dataMask) - desti;
+
+		src = (int *)&image[ srci ];
+		dest = (int *)&image[ desti ];
+		if ( ( (intptr_t)src | (intptr_t)dest | n ) & 3 ) {
+			// happens in westernq3
+			Com_Printf( S_COLOR_YELLOW "Warning: OP_BLOCK_COPY not dword aligned\n");
+		}
+		n >>= 2;
+		for ( i = n-1 ; i>= 0 ; i-- ) {
+			dest[i] = src[i];
+		}
+		opStack -= 2;
+	}
+	NEXT();
+
+sex8:
+	*opStack = (signed char)*opStack;
+	NEXT();
+sex16:
+	*opStack = (short)*opStack;
+	NEXT();
+negi:
+	*opStack = -*opStack;
+	NEXT();
+add:
+	opStack[-1] += opStack[0];
+	opStack--;
+	NEXT();
+const_add:
+	*opStack += ip->arg;
+	SKIP2();
+sub:
+	opStack[-1] -= opStack[0];
+	opStack--;
+	NEXT();
+divi:
+	opStack[-1] /= opStack[0];
+	opStack--;
+	NEXT();
+divu:
+	opStack[-1] = ((unsigned)opStack[-1]) / ((unsigned)opStack[0]);
+	opStack--;
+	NEXT();
+modi:
+	opStack[-1] %= opStack[0];
+	opStack--;
+	NEXT();
+modu:
+	opStack[-1] = ((unsigned)opStack[-1]) % ((unsigned)opStack[0]);
+	opStack--;
+	NEXT();
+muli:
+	opStack[-1] *= opStack[0];
+	opStack--;
+	NEXT();
+mulu:
+	opStack[-1] = ((unsigned)opStack[-1]) * ((unsigned)opStack[0]);
+	opStack--;
+	NEXT();
+band:
+	opStack[-1] &= opStack[0];
+	opStack--;
+	NEXT();
+bor:
+	opStack[-1] |= opStack[0];
+	opStack--;
+	NEXT();
+bxor:
+	opStack[-1] ^= opStack[0];
+	opStack--;
+	NEXT();
+bcom:
+	*opStack = ~*opStack;
+	NEXT();
+lsh:
+	opStack[-1] <<= opStack[0];
+	opStack--;
+	NEXT();
+rshi:
+	opStack[-1] >>= opStack[0];
+	opStack--;
+	NEXT();
+rshu:
+	opStack[-1] = ((unsigned)opStack[-1]) >> opStack[0];
+	opStack--;
+	NEXT();
+
+negf:
+	*(float *)opStack = -*(float *)opStack;
+	NEXT();
+addf:
+	*(float *)(opStack-1) = *(float *)(opStack-1) + *(float *)opStack;
+	opStack--;
+	NEXT();
+subf:
+	*(float *)(opStack-1) = *(float *)(opStack-1) - *(float *)opStack;
+	opStack--;
+	NEXT();
+divf:
+	*(float *)(opStack-1) = *(float *)(opStack-1) / *(float *)opStack;
+	opStack--;
+	NEXT();
+mulf:
+	*(float *)(opStack-1) = *(float *)(opStack-1) * *(float *)opStack;
+	opStack--;
+	NEXT();
+cvif:
+	*(float *)opStack = (float)*opStack;
+	NEXT();
+cvfi:
+	*opStack = (int)*(float *)opStack;
+	NEXT();
+
+#undef NEXT
+#undef SKIP2
+#undef BRANCH
+#undef CONDITION
+#undef CONDITION2
+
+done:
+	vm->currentlyInterpreting = qfalse;
+
+	if ( opStack != &stack[1] ) {
+		Com_Error( ERR_DROP, "Interpreter error: opStack = %ld", (long int) (opStack - stack) );
+	}
+
+	vm->programStack = stackOnEntry;
+
+	// return the result
+	return *opStack;
+}
+#endif	// VM_THREADED
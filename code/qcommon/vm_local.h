@@ -120,6 +120,13 @@ typedef struct vmSymbol_s {
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+#define	VM_SYSCALL_STATS	1024		// higher call numbers share the last entry
+
+typedef struct vmSyscallStat_s {
+	int			calls;
+	int64_t		usec;
+} vmSyscallStat_t;
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -140,16 +147,20 @@ struct vm_s {
 
 	// for interpreted modules
 	qboolean	currentlyInterpreting;
+	qboolean	threaded;			// codeBase holds decoded instructions, see VM_RunThreaded
 
 	qboolean	compiled;
 	byte		*codeBase;
 	int			codeLength;
+	int			compileTime;		// usec spent in VM_Compile
+	qboolean	codeCached;			// VM_Compile mapped the code from vm_cache
 
 	int			*instructionPointers;
 	int			instructionPointersLength;
 
 	byte		*dataBase;
 	int			dataMask;
+	qboolean	dataGuarded;		// dataBase starts a guarded 4GB region, see vm_sandbox
 
 	int			stackBottom;		// if programStack < stackBottom, error
 
@@ -164,11 +175,21 @@ struct vm_s {
 
 	byte		*jumpTableTargets;
 	int			numJumpTableTargets;
+
+	const vmSyscall_t	*syscallTable;	// see VM_SetSyscallTable
+	int			numSyscalls;
+	struct vmSyscallStat_s	*syscallStats;	// vm_syscallStats, VM_SYSCALL_STATS entries
+
+	int			*sampleCounts;		// vmprof hits per instruction
+	int			sampleSyscalls;		// vmprof hits outside the code while running
 };
 
 
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
+extern	cvar_t	*vm_sandbox;		// compiled code only, x86_64 Linux
+extern	cvar_t	*vm_cache;			// compiled code only, x86_64
+extern	cvar_t	*vm_threaded;		// interpreter only
 
 void VM_Compile( vm_t *vm, vmHeader_t *header );
 int	VM_CallCompiled( vm_t *vm, int *args );
@@ -180,4 +201,14 @@ vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
 void VM_LogSyscalls( int *args );
+intptr_t VM_SystemCall( vm_t *vm, int *args, int callnum );
+
+#if defined(__linux__) && defined(__x86_64__) && !defined(NO_VM_COMPILED)
+#define	VM_SAMPLER		// "vmprof", SIGPROF sampling of compiled code
+
+extern	int		vmSamplesOther;		// hits with no compiled vm running
+
+qboolean VM_SamplerStart( int hz );
+void VM_SamplerStop( void );
+#endif
 
@@ -22,6 +22,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 // vm_x86_64.c -- load time compiler and execution environment for x86-64
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		// REG_RIP
+#endif
+
 #include "vm_local.h"
 
 #include <sys/mman.h>
@@ -34,10 +38,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <errno.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <signal.h>
+#ifdef VM_SAMPLER
+#include <pthread.h>
+#endif
 
-//#define USE_GAS
+//#define USE_ASSEMBLER	// generate AT&T text and assemble it, to debug the compiler
+//#define USE_GAS		// assemble with the external "as" (implies USE_ASSEMBLER)
 //#define DEBUG_VM
 
+#if defined(USE_GAS) && !defined(USE_ASSEMBLER)
+#define USE_ASSEMBLER
+#endif
+
 #ifdef DEBUG_VM
 #define Dfprintf(fd, args...) fprintf(fd, ##args)
 static FILE* qdasmout;
@@ -47,7 +60,12 @@ static FILE* qdasmout;
 
 #define VM_X86_64_MMAP
 
-#ifndef USE_GAS
+#if defined(__linux__) && !defined(USE_ASSEMBLER)
+#define VM_GUARD_PAGES
+#define	VM_GUARD_REGION		( 0x100000000UL + 0x10000UL )	// 4GB + guard for the widest access
+#endif
+
+#if defined(USE_ASSEMBLER) && !defined(USE_GAS)
 void assembler_set_output(char* buf);
 size_t assembler_get_code_size(void);
 void assembler_init(int pass);
@@ -56,7 +74,7 @@ void assemble_line(const char* input, size_t len);
 #undef Dfprintf
 #define Dfprintf(args...)
 #endif
-#endif // USE_GAS
+#endif // USE_ASSEMBLER && !USE_GAS
 
 static void VM_Destroy_Compiled(vm_t* self);
 
@@ -82,9 +100,6 @@ static long callAsmCall(long callProgramStack, long callSyscallNum)
 {
 	vm_t *savedVM;
 	long ret = 0x77;
-	long args[11];
-//	int iargs[11];
-	int i;
 
 //	Dfprintf(stderr, "callAsmCall(%ld, %ld)\n", callProgramStack, callSyscallNum);
 //	Com_Printf("-> callAsmCall %s, level %d, num %ld\n", currentVM->name, currentVM->callLevel, callSyscallNum);
@@ -94,14 +109,8 @@ static long callAsmCall(long callProgramStack, long callSyscallNum)
 	// save the stack to allow recursive VM entry
 	currentVM->programStack = callProgramStack - 4;
 
-	args[0] = callSyscallNum;
-//	iargs[0] = callSyscallNum;
-	for(i = 0; i < 10; ++i)
-	{
-//		iargs[i+1] = *(int *)((byte *)currentVM->dataBase + callProgramStack + 8 + 4*i);
-		args[i+1] = *(int *)((byte *)currentVM->dataBase + callProgramStack + 8 + 4*i);
-	}
-	ret = currentVM->systemCall(args);
+	// the arguments start at callProgramStack + 8, args[0] is unused
+	ret = VM_SystemCall( currentVM, (int *)( currentVM->dataBase + callProgramStack + 4 ), callSyscallNum );
 
  	currentVM = savedVM;
 //	Com_Printf("<- callAsmCall %s, level %d, num %ld\n", currentVM->name, currentVM->callLevel, callSyscallNum);
@@ -225,6 +234,7 @@ static unsigned char op_argsize[256] =
 	[OP_BLOCK_COPY] = 4,
 };
 
+#ifdef USE_ASSEMBLER
 #ifdef USE_GAS
 #define emit(x...) \
 	do { fprintf(fh_s, ##x); fputc('\n', fh_s); } while(0)
@@ -332,6 +342,7 @@ void emit(const char* fmt, ...)
 #define NOTIMPL(x) \
 	do { Com_Printf(S_COLOR_RED "instruction not implemented: %x\n", x); vm->compiled = qfalse; return; } while(0)
 #endif
+#endif // USE_ASSEMBLER
 
 static void* getentrypoint(vm_t* vm)
 {
@@ -447,6 +458,32 @@ static void block_copy_vm(unsigned dest, unsigned src, unsigned count)
 	memcpy(currentVM->dataBase+dest, currentVM->dataBase+src, count);
 }
 
+#if defined(VM_GUARD_PAGES) || defined(VM_SAMPLER)
+/*
+=================
+VM_CodeOffsetToInstruction
+=================
+*/
+static int VM_CodeOffsetToInstruction( vm_t *vm, int ofs )
+{
+	int		low, high, mid;
+
+	low = 0;
+	high = vm->instructionPointersLength / 4 - 1;
+	while ( low < high ) {
+		mid = ( low + high + 1 ) / 2;
+		if ( vm->instructionPointers[mid] <= ofs ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+#endif
+
+#ifdef USE_ASSEMBLER
+
 /*
 =================
 VM_Compile
@@ -1034,105 +1071,1557 @@ out:
 	}
 }
 
+#else // USE_ASSEMBLER
 
-void VM_Destroy_Compiled(vm_t* self)
+/*
+=============================================================================
+
+Machine code is written directly into a buffer in a single pass.  Jumps
+to other QVM instructions are emitted with an empty rel32 and patched
+once every instruction has its address, so no labels are needed.
+
+Within straight-line code the top of the opStack is kept in eax instead
+of memory, and an OP_CONST is folded into the instruction that uses it.
+Both stop at jump targets, where the whole stack has to be in memory.
+
+=============================================================================
+*/
+
+#define	MAX_INSTRUCTION_BYTES	256		// more than the longest translation of one opcode
+
+typedef struct {
+	int		ofs;		// first byte after the rel32
+	int		target;		// QVM instruction
+} jumpFixup_t;
+
+static byte			*buf;
+static int			bufSize;
+static int			compiledOfs;
+
+static jumpFixup_t	*fixups;
+static int			numFixups;
+static int			maxFixups;
+
+static byte			*jused;			// instructions reached by a jump or call
+static qboolean		tosInEax;		// top of the opStack is in eax, [rsi] is stale
+static byte			*guardRegion;	// data segment being set up for vm_sandbox
+
+typedef enum {
+	RELOC_INSTRUCTION_POINTERS,
+	RELOC_CALLASMCALL,
+	RELOC_BLOCK_COPY
+} vmRelocType_t;
+
+typedef struct {
+	int		ofs;		// of the 64 bit address in the code
+	int		type;		// vmRelocType_t
+} vmReloc_t;
+
+static vmReloc_t	*relocs;		// absolute addresses, for vm_cache
+static int			numRelocs;
+static int			maxRelocs;
+
+static void Emit1( int v )
 {
-#ifdef USE_GAS
-	munmap(self->codeBase, self->codeLength);
-#elif _WIN32
-	VirtualFree(self->codeBase, self->codeLength, MEM_RELEASE);
-#else
-	munmap(self->codeBase, self->codeLength);
-#endif
+	buf[ compiledOfs ] = v;
+	compiledOfs++;
+}
+
+static void Emit4( int v )
+{
+	Emit1( v & 255 );
+	Emit1( ( v >> 8 ) & 255 );
+	Emit1( ( v >> 16 ) & 255 );
+	Emit1( ( v >> 24 ) & 255 );
+}
+
+static void Emit8( unsigned long v )
+{
+	Emit4( v & 0xffffffff );
+	Emit4( v >> 32 );
 }
 
 /*
-==============
-VM_CallCompiled
+=================
+EmitAbsolute
 
-This function is called directly by the generated code
-==============
+Addresses that change from one run to the next are recorded so a
+cached copy of the code can be patched
+=================
 */
+static void EmitAbsolute( vmRelocType_t type, unsigned long address )
+{
+	if ( numRelocs == maxRelocs ) {
+		maxRelocs = maxRelocs * 2 + 64;
+		relocs = realloc( relocs, maxRelocs * sizeof( *relocs ) );
+		if ( !relocs ) {
+			Com_Error( ERR_DROP, "VM_CompileX86: out of memory" );
+		}
+	}
+	relocs[numRelocs].ofs = compiledOfs;
+	relocs[numRelocs].type = type;
+	numRelocs++;
+	Emit8( address );
+}
 
-#ifdef DEBUG_VM
-static char* memData;
+static int Hex( int c )
+{
+	if ( c >= 'a' && c <= 'f' ) {
+		return 10 + c - 'a';
+	}
+	if ( c >= 'A' && c <= 'F' ) {
+		return 10 + c - 'A';
+	}
+	if ( c >= '0' && c <= '9' ) {
+		return c - '0';
+	}
+
+	Com_Error( ERR_DROP, "Hex: bad char '%c'", c );
+
+	return 0;
+}
+
+static void EmitString( const char *string )
+{
+	int		c1, c2;
+	int		v;
+
+	while ( 1 ) {
+		c1 = string[0];
+		c2 = string[1];
+
+		v = ( Hex( c1 ) << 4 ) | Hex( c2 );
+		Emit1( v );
+
+		if ( !string[2] ) {
+			break;
+		}
+		string += 3;
+	}
+}
+
+/*
+=================
+EmitReserve
+
+Makes room for the next instruction, buf may move
+=================
+*/
+static void EmitReserve( void )
+{
+	byte	*newBuf;
+
+	if ( compiledOfs + MAX_INSTRUCTION_BYTES <= bufSize ) {
+		return;
+	}
+	newBuf = realloc( buf, bufSize * 2 );
+	if ( !newBuf ) {
+		Com_Error( ERR_DROP, "VM_CompileX86: out of memory" );
+	}
+	buf = newBuf;
+	bufSize *= 2;
+}
+
+/*
+=================
+EmitJump
+
+jmp or jcc with a rel32 to a QVM instruction, patched in VM_Compile
+=================
+*/
+static void EmitJump( const char *opcode, int target )
+{
+	jumpFixup_t	*newFixups;
+
+	if ( numFixups == maxFixups ) {
+		newFixups = realloc( fixups, maxFixups * 2 * sizeof( *fixups ) );
+		if ( !newFixups ) {
+			Com_Error( ERR_DROP, "VM_CompileX86: out of memory" );
+		}
+		fixups = newFixups;
+		maxFixups *= 2;
+	}
+
+	EmitString( opcode );
+	Emit4( 0 );
+	fixups[ numFixups ].ofs = compiledOfs;
+	fixups[ numFixups ].target = target;
+	numFixups++;
+}
+
+/*
+=================
+EmitForward / PatchForward
+
+rel32 jump to a point later in the same instruction
+=================
+*/
+static int EmitForward( const char *opcode )
+{
+	EmitString( opcode );
+	Emit4( 0 );
+	return compiledOfs;
+}
+
+static void PatchForward( int ofs )
+{
+	int		rel;
+
+	rel = compiledOfs - ofs;
+	memcpy( buf + ofs - 4, &rel, 4 );
+}
+
+static void VM_FreeCompileBuffers( void )
+{
+	free( buf );
+	buf = NULL;
+	free( fixups );
+	fixups = NULL;
+	free( jused );
+	jused = NULL;
+	free( relocs );
+	relocs = NULL;
+	maxRelocs = 0;
+#ifdef VM_GUARD_PAGES
+	if ( guardRegion ) {
+		munmap( guardRegion, VM_GUARD_REGION );
+		guardRegion = NULL;
+	}
 #endif
+}
 
-int	VM_CallCompiled( vm_t *vm, int *args ) {
-	int		programCounter;
-	int		programStack;
-	int		stackOnEntry;
-	byte	*image;
-	void	*entryPoint;
-	void	*opStack;
-	int stack[1024] = { 0xDEADBEEF };
+// with the data segment in a guarded region no address needs masking
+#define RANGECHECK(modrm) \
+	do { if ( !guardRegion ) { EmitString( "81 " modrm ); Emit4( vm->dataMask ); } } while(0)	// and reg, dataMask
 
-	currentVM = vm;
+#ifdef VM_GUARD_PAGES
+/*
+=============================================================================
 
-	++vm->callLevel;
-//	Com_Printf("entering %s level %d, call %d, arg1 = 0x%x\n", vm->name, vm->callLevel, args[0], args[1]);
+vm_sandbox
 
-	// interpret the code
-	vm->currentlyInterpreting = qtrue;
+The data segment is moved to the start of a 4GB reservation with a guard
+area behind it.  Addresses are 32 bit unsigned and added to r8 without
+masking, so anything past the data segment faults and the SIGSEGV
+handler turns that into an ERR_DROP.
 
-//	callMask = vm->dataMask;
+=============================================================================
+*/
 
-	// we might be called recursively, so this might not be the very top
-	programStack = vm->programStack;
-	stackOnEntry = programStack;
+static qboolean			vmFaultHandlerInstalled;
+static struct sigaction	vmOldSegv;
 
-	// set up the stack frame 
-	image = vm->dataBase;
-#ifdef DEBUG_VM
-	memData = (char*)image;
+/*
+=================
+VM_GuardFault
+
+SA_NODEFER leaves SIGSEGV unblocked when Com_Error longjmps out of here
+=================
+*/
+static void VM_GuardFault( int sig, siginfo_t *info, void *context )
+{
+	vm_t	*vm = currentVM;
+	byte	*addr, *rip;
+
+	addr = info->si_addr;
+	rip = (byte *)( (ucontext_t *)context )->uc_mcontext.gregs[REG_RIP];
+
+	if ( vm && vm->dataGuarded && addr >= vm->dataBase && addr < vm->dataBase + VM_GUARD_REGION ) {
+		if ( rip >= vm->codeBase && rip < vm->codeBase + vm->codeLength ) {
+			int instruction = VM_CodeOffsetToInstruction( vm, rip - vm->codeBase );
+
+			// symbols hold code offsets, see VM_LoadSymbols
+			Com_Error( ERR_DROP, "VM %s: access to 0x%lx out of range at instruction %i (%s)",
+				vm->name, (unsigned long)( addr - vm->dataBase ), instruction,
+				VM_ValueToSymbol( vm, vm->instructionPointers[instruction] ) );
+		}
+		Com_Error( ERR_DROP, "VM %s: access to 0x%lx out of range in a system call",
+			vm->name, (unsigned long)( addr - vm->dataBase ) );
+	}
+
+	// not a vm access, let the previous handler deal with it
+	if ( vmOldSegv.sa_flags & SA_SIGINFO ) {
+		vmOldSegv.sa_sigaction( sig, info, context );
+	} else if ( vmOldSegv.sa_handler != SIG_DFL && vmOldSegv.sa_handler != SIG_IGN ) {
+		vmOldSegv.sa_handler( sig );
+	} else {
+		signal( sig, SIG_DFL );
+		raise( sig );
+	}
+}
+
+/*
+=================
+VM_ReserveGuardRegion
+
+Returns NULL if the address space can't be reserved, the compiler
+masks addresses then
+=================
+*/
+static byte *VM_ReserveGuardRegion( vm_t *vm )
+{
+	struct sigaction	sa;
+	byte				*region;
+
+	region = mmap( NULL, VM_GUARD_REGION, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0 );
+	if ( region == (void *)-1 ) {
+		Com_Printf( S_COLOR_YELLOW "vm_sandbox: can't reserve address space for %s\n", vm->name );
+		return NULL;
+	}
+	if ( mprotect( region, vm->dataMask + 1, PROT_READ|PROT_WRITE ) ) {
+		Com_Printf( S_COLOR_YELLOW "vm_sandbox: mprotect failed for %s\n", vm->name );
+		munmap( region, VM_GUARD_REGION );
+		return NULL;
+	}
+
+	if ( !vmFaultHandlerInstalled ) {
+		Com_Memset( &sa, 0, sizeof( sa ) );
+		sa.sa_sigaction = VM_GuardFault;
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset( &sa.sa_mask );
+		sigaction( SIGSEGV, &sa, &vmOldSegv );
+		vmFaultHandlerInstalled = qtrue;
+	}
+
+	return region;
+}
 #endif
 
-	programCounter = 0;
+/*
+=================
+FlushTos
 
-	programStack -= 48;
+Writes a top of stack held in eax back to the opStack
+=================
+*/
+static void FlushTos( void )
+{
+	if ( tosInEax ) {
+		EmitString( "89 06" );			// mov [rsi], eax
+		tosInEax = qfalse;
+	}
+}
 
-	*(int *)&image[ programStack + 44] = args[9];
-	*(int *)&image[ programStack + 40] = args[8];
-	*(int *)&image[ programStack + 36] = args[7];
-	*(int *)&image[ programStack + 32] = args[6];
-	*(int *)&image[ programStack + 28] = args[5];
-	*(int *)&image[ programStack + 24] = args[4];
-	*(int *)&image[ programStack + 20] = args[3];
-	*(int *)&image[ programStack + 16] = args[2];
-	*(int *)&image[ programStack + 12] = args[1];
-	*(int *)&image[ programStack + 8 ] = args[0];
-	*(int *)&image[ programStack + 4 ] = 0x77777777;	// return stack
-	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
+/*
+=================
+LoadTos
 
-	// off we go into generated code...
-	entryPoint = getentrypoint(vm);
-	opStack = &stack;
+Makes eax hold the top of stack
+=================
+*/
+static void LoadTos( void )
+{
+	if ( !tosInEax ) {
+		EmitString( "8B 06" );			// mov eax, [rsi]
+		tosInEax = qtrue;
+	}
+}
 
-	__asm__ __volatile__ (
-		"	movq %5,%%rsi		\r\n" \
-		"	movl %4,%%edi		\r\n" \
-		"	movq %2,%%r10		\r\n" \
-		"	movq %3,%%r8		\r\n" \
-		"       subq $24, %%rsp # fix alignment as call pushes one value \r\n" \
-		"	callq *%%r10		\r\n" \
-		"       addq $24, %%rsp          \r\n" \
-		"	movl %%edi, %0		\r\n" \
-		"	movq %%rsi, %1		\r\n" \
-		: "=m" (programStack), "=m" (opStack)
-		: "m" (entryPoint), "m" (vm->dataBase), "m" (programStack), "m" (opStack)
-		: "%rsi", "%rdi", "%rax", "%rbx", "%rcx", "%rdx", "%r8", "%r10", "%r15", "%xmm0"
-	);
+/*
+=================
+PopTosToEcx
 
-	if ( opStack != &stack[1] ) {
-		Com_Error( ERR_DROP, "opStack corrupted in compiled code (offset %ld)\n", (long int) ((void *) &stack[1] - opStack));
+Pops the top of stack into ecx, for operations with a second operand
+=================
+*/
+static void PopTosToEcx( void )
+{
+	if ( tosInEax ) {
+		EmitString( "89 C1" );			// mov ecx, eax
+		tosInEax = qfalse;
+	} else {
+		EmitString( "8B 0E" );			// mov ecx, [rsi]
 	}
-	if ( programStack != stackOnEntry - 48 ) {
-		Com_Error( ERR_DROP, "programStack corrupted in compiled code\n" );
+	EmitString( "48 83 EE 04" );		// sub rsi, 4
+}
+
+/*
+=================
+EmitBinaryOp
+
+Leaves a op b in eax where b is the top of stack.  opMem is the
+operation with [rsi+4], opSwapped with [rsi] for commutative operations.
+=================
+*/
+static void EmitBinaryOp( const char *opEcx, const char *opMem, const char *opSwapped )
+{
+	if ( tosInEax && opSwapped ) {
+		EmitString( "48 83 EE 04" );	// sub rsi, 4
+		EmitString( opSwapped );		// op eax, [rsi]
+	} else if ( tosInEax ) {
+		PopTosToEcx();
+		EmitString( "8B 06" );			// mov eax, [rsi]
+		EmitString( opEcx );			// op eax, ecx
+	} else {
+		EmitString( "48 83 EE 04" );	// sub rsi, 4
+		EmitString( "8B 06" );			// mov eax, [rsi]
+		EmitString( opMem );			// op eax, [rsi+4]
 	}
+	tosInEax = qtrue;
+}
 
-//	Com_Printf("exiting %s level %d\n", vm->name, vm->callLevel);
-	--vm->callLevel;
-	vm->programStack = stackOnEntry;
+/*
+=================
+EmitFloatOp
+=================
+*/
+static void EmitFloatOp( const char *op )
+{
+	if ( tosInEax ) {
+		EmitString( "66 0F 6E C8" );	// movd xmm1, eax
+	} else {
+		EmitString( "F3 0F 10 0E" );	// movss xmm1, [rsi]
+	}
+	EmitString( "48 83 EE 04" );		// sub rsi, 4
+	EmitString( "F3 0F 10 06" );		// movss xmm0, [rsi]
+	EmitString( op );					// op xmm0, xmm1
+	EmitString( "66 0F 7E C0" );		// movd eax, xmm0
+	tosInEax = qtrue;
+}
 
-	return *(int *)opStack;
+/*
+=================
+EmitFloatCompare
+
+Pops two floats and compares them into the flags
+=================
+*/
+static void EmitFloatCompare( void )
+{
+	if ( tosInEax ) {
+		EmitString( "66 0F 6E C8" );	// movd xmm1, eax
+		tosInEax = qfalse;
+	} else {
+		EmitString( "F3 0F 10 0E" );	// movss xmm1, [rsi]
+	}
+	EmitString( "48 83 EE 08" );		// sub rsi, 8
+	EmitString( "F3 0F 10 46 04" );		// movss xmm0, [rsi+4]
+	EmitString( "0F 2E C1" );			// ucomiss xmm0, xmm1
 }
+
+/*
+=================
+IntJcc
+
+Condition of an integer compare and jump opcode
+=================
+*/
+static const char *IntJcc( int op )
+{
+	switch ( op ) {
+		case OP_EQ:		return "0F 84";		// je
+		case OP_NE:		return "0F 85";		// jne
+		case OP_LTI:	return "0F 8C";		// jl
+		case OP_LEI:	return "0F 8E";		// jle
+		case OP_GTI:	return "0F 8F";		// jg
+		case OP_GEI:	return "0F 8D";		// jge
+		case OP_LTU:	return "0F 82";		// jb
+		case OP_LEU:	return "0F 86";		// jbe
+		case OP_GTU:	return "0F 87";		// ja
+		case OP_GEU:	return "0F 83";		// jae
+	}
+	return NULL;
+}
+
+/*
+=================
+EmitSyscall
+
+callnum is -1 when eax holds the negative QVM address of the call,
+the result is pushed on the opStack
+=================
+*/
+static void EmitSyscall( int callnum )
+{
+	EmitString( "56" );					// push rsi
+	EmitString( "57" );					// push rdi
+	EmitString( "41 50" );				// push r8
+	EmitString( "41 51" );				// push r9
+	EmitString( "41 52" );				// push r10
+	EmitString( "48 89 E3" );			// mov rbx, rsp		align the stack pointer
+	EmitString( "48 83 EB 08" );		// sub rbx, 8
+	EmitString( "48 83 E3 7F" );		// and rbx, 127
+	EmitString( "48 29 DC" );			// sub rsp, rbx
+	EmitString( "53" );					// push rbx
+										// first argument already in rdi
+	if ( callnum >= 0 ) {
+		EmitString( "BE" );				// mov esi, callnum		second argument
+		Emit4( callnum );
+	} else {
+		EmitString( "F7 D8" );			// neg eax		convert to actual number
+		EmitString( "FF C8" );			// dec eax
+		EmitString( "48 89 C6" );		// mov rsi, rax		second argument
+	}
+	EmitString( "48 B8" );				// mov rax, callAsmCall
+	EmitAbsolute( RELOC_CALLASMCALL, (unsigned long)callAsmCall );
+	EmitString( "FF D0" );				// call rax
+	EmitString( "5B" );					// pop rbx
+	EmitString( "48 01 DC" );			// add rsp, rbx
+	EmitString( "41 5A" );				// pop r10
+	EmitString( "41 59" );				// pop r9
+	EmitString( "41 58" );				// pop r8
+	EmitString( "5F" );					// pop rdi
+	EmitString( "5E" );					// pop rsi
+	EmitString( "48 83 C6 04" );		// add rsi, 4
+	EmitString( "89 06" );				// mov [rsi], eax	store return value
+}
+
+/*
+=================
+EmitConstFused
+
+Translates OP_CONST together with the instruction that consumes it.
+Returns qfalse if nextOp has no combined form.
+=================
+*/
+static qboolean EmitConstFused( vm_t *vm, int value, int nextOp, int nextArg, int instruction, int instructionCount )
+{
+	switch ( nextOp ) {
+		case OP_LOAD4:
+		case OP_LOAD2:
+		case OP_LOAD1:
+			if ( guardRegion && (unsigned)value > vm->dataMask ) {
+				return qfalse;		// leave the fault to the unfused load
+			}
+			FlushTos();
+			EmitString( "48 83 C6 04" );	// add rsi, 4
+			if ( nextOp == OP_LOAD4 ) {
+				EmitString( "41 8B 80" );		// mov eax, [r8+value]
+			} else if ( nextOp == OP_LOAD2 ) {
+				EmitString( "41 0F B7 80" );	// movzx eax, word [r8+value]
+			} else {
+				EmitString( "41 0F B6 80" );	// movzx eax, byte [r8+value]
+			}
+			Emit4( value & vm->dataMask );
+			tosInEax = qtrue;
+			return qtrue;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_BAND:
+		case OP_BOR:
+		case OP_BXOR:
+			LoadTos();
+			switch ( nextOp ) {
+				case OP_ADD:	EmitString( "05" ); break;		// add eax, value
+				case OP_SUB:	EmitString( "2D" ); break;		// sub eax, value
+				case OP_BAND:	EmitString( "25" ); break;		// and eax, value
+				case OP_BOR:	EmitString( "0D" ); break;		// or eax, value
+				default:		EmitString( "35" ); break;		// xor eax, value
+			}
+			Emit4( value );
+			return qtrue;
+		case OP_MULI:
+		case OP_MULU:
+			LoadTos();
+			EmitString( "69 C0" );			// imul eax, eax, value
+			Emit4( value );
+			return qtrue;
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			LoadTos();
+			if ( nextOp == OP_LSH ) {
+				EmitString( "C1 E0" );		// shl eax, value
+			} else if ( nextOp == OP_RSHI ) {
+				EmitString( "C1 F8" );		// sar eax, value
+			} else {
+				EmitString( "C1 E8" );		// shr eax, value
+			}
+			Emit1( value & 31 );
+			return qtrue;
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+			EmitString( "48 83 EE 04" );	// sub rsi, 4
+			if ( tosInEax ) {
+				EmitString( "3D" );			// cmp eax, value
+				tosInEax = qfalse;
+			} else {
+				EmitString( "81 7E 04" );	// cmp [rsi+4], value
+			}
+			Emit4( value );
+			EmitJump( IntJcc( nextOp ), nextArg );
+			return qtrue;
+		case OP_JUMP:
+			if ( (unsigned)value >= instructionCount ) {
+				return qfalse;
+			}
+			FlushTos();
+			EmitJump( "E9", value );		// jmp value
+			return qtrue;
+		case OP_CALL:
+			if ( value >= instructionCount ) {
+				return qfalse;
+			}
+			FlushTos();
+			EmitString( "41 C7 04 38" );	// mov [r8+rdi], instruction after the call
+			Emit4( instruction + 2 );
+			if ( value >= 0 ) {
+				EmitJump( "E8", value );	// call value
+			} else {
+				EmitSyscall( -1 - value );
+			}
+			return qtrue;
+	}
+
+	return qfalse;
+}
+
+/*
+=================
+VM_FindJumpTargets
+
+Marks every instruction that can be reached other than by falling
+through.  The top of stack cache is flushed before these and no
+instructions are fused across them.
+=================
+*/
+static void VM_FindJumpTargets( vm_t *vm, vmHeader_t *header )
+{
+	byte		*code;
+	int			i, pc, op, arg, target;
+	int			lastOp, lastArg;
+	qboolean	computedJump;
+
+	Com_Memset( jused, 0, header->instructionCount + 2 );
+
+	for ( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		target = *(int *)( vm->jumpTableTargets + i * sizeof( int ) );
+		if ( (unsigned)target < header->instructionCount ) {
+			jused[ target ] = 1;
+		}
+	}
+
+	code = (byte *)header + header->codeOffset;
+	computedJump = qfalse;
+	lastOp = lastArg = -1;
+	pc = 0;
+
+	for ( i = 0; i < header->instructionCount; i++ )
+	{
+		op = code[ pc ];
+		arg = op_argsize[ op ] == 4 ? *(int *)( code + pc + 1 ) : 0;
+		pc += 1 + op_argsize[ op ];
+
+		switch ( op )
+		{
+			case OP_ENTER:
+				jused[ i ] = 1;
+				break;
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+				if ( (unsigned)arg < header->instructionCount ) {
+					jused[ arg ] = 1;
+				}
+				break;
+			case OP_JUMP:
+				if ( lastOp == OP_CONST ) {
+					if ( (unsigned)lastArg < header->instructionCount ) {
+						jused[ lastArg ] = 1;
+					}
+				} else if ( !vm->numJumpTableTargets ) {
+					computedJump = qtrue;
+				}
+				break;
+		}
+
+		lastOp = op;
+		lastArg = arg;
+	}
+
+	// old qvms don't list their jump table targets, any instruction
+	// could be one
+	if ( computedJump ) {
+		Com_Memset( jused, 1, header->instructionCount + 2 );
+	}
+}
+
+/*
+=============================================================================
+
+vm_cache
+
+The compiled code of every QVM is kept in fs_homepath/vmcache, named
+after the checksum of the QVM file.  The file holds the instruction
+offsets, a list of the absolute addresses in the code and the code
+itself on a page boundary, so a later load maps it instead of compiling.
+Anything that changes the generated code has to be part of the header.
+
+=============================================================================
+*/
+
+#define	VM_CACHE_IDENT		( ( 'T' << 24 ) + ( 'I' << 16 ) + ( 'J' << 8 ) + 'Q' )
+#define	VM_CACHE_VERSION	1
+#define	VM_CACHE_BUILD		Q3_VERSION " " __DATE__ " " __TIME__
+
+typedef struct {
+	int		ident;
+	int		version;
+	char	build[64];			// VM_CACHE_BUILD, the compiler may have changed
+	int		checksum;			// of the whole QVM file
+	int		fileLength;
+	int		sandboxed;			// addresses aren't masked
+	int		instructionCount;
+	int		numRelocs;
+	int		codeOffset;			// page aligned
+	int		codeLength;
+} vmCacheHeader_t;
+
+/*
+=================
+VM_CachePath
+=================
+*/
+static char *VM_CachePath( vm_t *vm, int checksum )
+{
+	return FS_BuildOSPath( Cvar_VariableString( "fs_homepath" ), "vmcache",
+		va( "%s-%08x%s.jit", vm->name, checksum, guardRegion ? "-sandbox" : "" ) );
+}
+
+/*
+=================
+VM_CacheHeader
+=================
+*/
+static void VM_CacheHeader( vmCacheHeader_t *cache, vmHeader_t *header, int checksum, int fileLength )
+{
+	Com_Memset( cache, 0, sizeof( *cache ) );
+	cache->ident = VM_CACHE_IDENT;
+	cache->version = VM_CACHE_VERSION;
+	Q_strncpyz( cache->build, VM_CACHE_BUILD, sizeof( cache->build ) );
+	cache->checksum = checksum;
+	cache->fileLength = fileLength;
+	cache->sandboxed = guardRegion != NULL;
+	cache->instructionCount = header->instructionCount;
+}
+
+/*
+=================
+VM_LoadCache
+
+Maps the code and patches the absolute addresses, qfalse if there
+is no usable file
+=================
+*/
+static qboolean VM_LoadCache( vm_t *vm, vmHeader_t *header, int checksum, int fileLength )
+{
+	vmCacheHeader_t	expected, cache;
+	vmReloc_t		*list, *reloc;
+	struct stat		st;
+	unsigned long	address;
+	byte			*code;
+	int				fd, i, size;
+
+	fd = open( VM_CachePath( vm, checksum ), O_RDONLY );
+	if ( fd == -1 ) {
+		return qfalse;
+	}
+
+	VM_CacheHeader( &expected, header, checksum, fileLength );
+	if ( read( fd, &cache, sizeof( cache ) ) != sizeof( cache )
+		|| memcmp( &cache, &expected, (byte *)&expected.numRelocs - (byte *)&expected )
+		|| cache.numRelocs < 0
+		|| cache.codeLength <= 0
+		|| cache.codeOffset & ( getpagesize() - 1 )
+		|| fstat( fd, &st ) || st.st_size < (off_t)cache.codeOffset + cache.codeLength ) {
+		close( fd );
+		return qfalse;
+	}
+
+	size = header->instructionCount * sizeof( *vm->instructionPointers );
+	list = malloc( cache.numRelocs * sizeof( *list ) + 1 );
+	if ( !list
+		|| read( fd, vm->instructionPointers, size ) != size
+		|| read( fd, list, cache.numRelocs * sizeof( *list ) ) != cache.numRelocs * sizeof( *list ) ) {
+		free( list );
+		close( fd );
+		return qfalse;
+	}
+
+	// only the pages with an address in them are copied
+	code = mmap( NULL, cache.codeLength, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, cache.codeOffset );
+	close( fd );
+	if ( code == (void *)-1 ) {
+		free( list );
+		return qfalse;
+	}
+
+	for ( i = 0, reloc = list ; i < cache.numRelocs ; i++, reloc++ ) {
+		switch ( reloc->type ) {
+		case RELOC_INSTRUCTION_POINTERS:
+			address = (unsigned long)vm->instructionPointers;
+			break;
+		case RELOC_CALLASMCALL:
+			address = (unsigned long)callAsmCall;
+			break;
+		case RELOC_BLOCK_COPY:
+			address = (unsigned long)block_copy_vm;
+			break;
+		default:
+			address = 0;
+			break;
+		}
+		if ( !address || reloc->ofs < 0 || reloc->ofs > cache.codeLength - 8 ) {
+			munmap( code, cache.codeLength );
+			free( list );
+			return qfalse;
+		}
+		memcpy( code + reloc->ofs, &address, 8 );
+	}
+	free( list );
+
+	vm->codeBase = code;
+	vm->codeLength = cache.codeLength;
+	return qtrue;
+}
+
+/*
+=================
+VM_SaveCache
+
+Written to a temporary name first, another server on the same
+homepath may be loading the file
+=================
+*/
+static void VM_SaveCache( vm_t *vm, vmHeader_t *header, int checksum, int fileLength )
+{
+	vmCacheHeader_t	cache;
+	char			path[MAX_OSPATH], temp[MAX_OSPATH];
+	int				fd, ok, pad;
+
+	Q_strncpyz( path, VM_CachePath( vm, checksum ), sizeof( path ) );
+	Com_sprintf( temp, sizeof( temp ), "%s.%i", path, (int)getpid() );
+
+	Sys_Mkdir( FS_BuildOSPath( Cvar_VariableString( "fs_homepath" ), "vmcache", "" ) );
+	fd = open( temp, O_WRONLY|O_CREAT|O_TRUNC, 0644 );
+	if ( fd == -1 ) {
+		Com_DPrintf( "vm_cache: couldn't write %s\n", temp );
+		return;
+	}
+
+	VM_CacheHeader( &cache, header, checksum, fileLength );
+	cache.numRelocs = numRelocs;
+	cache.codeOffset = sizeof( cache ) + header->instructionCount * sizeof( *vm->instructionPointers )
+		+ numRelocs * sizeof( *relocs );
+	pad = -cache.codeOffset & ( getpagesize() - 1 );
+	cache.codeOffset += pad;
+	cache.codeLength = vm->codeLength;
+
+	ok = write( fd, &cache, sizeof( cache ) ) == sizeof( cache )
+		&& write( fd, vm->instructionPointers, header->instructionCount * sizeof( *vm->instructionPointers ) )
+			== header->instructionCount * sizeof( *vm->instructionPointers )
+		&& write( fd, relocs, numRelocs * sizeof( *relocs ) ) == numRelocs * sizeof( *relocs )
+		&& lseek( fd, cache.codeOffset, SEEK_SET ) == cache.codeOffset
+		&& write( fd, vm->codeBase, vm->codeLength ) == vm->codeLength;
+	close( fd );
+
+	if ( !ok || rename( temp, path ) ) {
+		Com_DPrintf( "vm_cache: couldn't write %s\n", temp );
+		unlink( temp );
+	}
+}
+
+/*
+=================
+VM_FinishCompile
+
+Makes the code executable and moves the data into the vm_sandbox region
+=================
+*/
+static void VM_FinishCompile( vm_t *vm )
+{
+	if ( guardRegion ) {
+		// the hunk copy stays unused until the vm is freed
+		Com_Memcpy( guardRegion, vm->dataBase, vm->dataMask + 1 );
+		vm->dataBase = guardRegion;
+		vm->dataGuarded = qtrue;
+		guardRegion = NULL;
+	}
+	VM_FreeCompileBuffers();
+
+	if(mprotect(vm->codeBase, vm->codeLength, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_DROP, "VM_CompileX86: mprotect failed");
+
+	vm->destroy = VM_Destroy_Compiled;
+}
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile( vm_t *vm, vmHeader_t *header ) {
+	unsigned char op;
+	int pc;
+	unsigned instruction;
+	char* code;
+	unsigned iarg = 0;
+	unsigned char barg = 0;
+	int nextOp, nextArg;
+	int skip, rel, i;
+	qboolean useCache;
+	int checksum, fileLength;
+
+#ifdef VM_GUARD_PAGES
+	if ( vm_sandbox->integer ) {
+		guardRegion = VM_ReserveGuardRegion( vm );
+	}
+#endif
+
+	// the generated code depends on nothing but the file and vm_sandbox
+	useCache = vm_cache->integer;
+	checksum = fileLength = 0;
+	if ( useCache ) {
+		fileLength = header->dataOffset + header->dataLength + header->litLength;
+		if ( header->vmMagic == VM_MAGIC_VER2 ) {
+			fileLength += header->jtrgLength;
+		}
+		checksum = Com_BlockChecksum( header, fileLength );
+
+		if ( VM_LoadCache( vm, header, checksum, fileLength ) ) {
+			VM_FinishCompile( vm );
+			vm->codeCached = qtrue;
+			Com_Printf( "VM file %s loaded %i bytes of cached code (%p - %p)\n", vm->name, vm->codeLength, vm->codeBase, vm->codeBase+vm->codeLength );
+			return;
+		}
+	}
+
+	bufSize = header->instructionCount * 16 + MAX_INSTRUCTION_BYTES;
+	buf = malloc( bufSize );
+	maxFixups = header->instructionCount / 4 + 16;
+	fixups = malloc( maxFixups * sizeof( *fixups ) );
+	jused = malloc( header->instructionCount + 2 );
+	if ( !buf || !fixups || !jused ) {
+		VM_FreeCompileBuffers();
+		Com_Error( ERR_DROP, "VM_CompileX86: out of memory" );
+	}
+	compiledOfs = 0;
+	numFixups = 0;
+	numRelocs = 0;
+	tosInEax = qfalse;
+
+	VM_FindJumpTargets( vm, header );
+
+	// translate all instructions
+	pc = 0;
+	code = (char *)header + header->codeOffset;
+
+	for ( instruction = 0; instruction < header->instructionCount; ++instruction )
+	{
+		EmitReserve();
+
+		// everything that jumps here expects the whole stack in memory
+		if ( jused[instruction] ) {
+			FlushTos();
+		}
+		vm->instructionPointers[instruction] = compiledOfs;
+
+		op = code[ pc ];
+		++pc;
+
+		if(op_argsize[op] == 4)
+		{
+			iarg = *(int*)(code+pc);
+			pc += 4;
+		}
+		else if(op_argsize[op] == 1)
+		{
+			barg = code[pc++];
+		}
+
+		// the next instruction can be folded into this one unless
+		// something jumps to it
+		nextOp = -1;
+		nextArg = 0;
+		if ( instruction + 1 < header->instructionCount && !jused[instruction + 1] ) {
+			nextOp = (byte)code[ pc ];
+			if ( op_argsize[nextOp] == 4 ) {
+				nextArg = *(int *)( code + pc + 1 );
+			}
+		}
+
+		switch ( op )
+		{
+			case OP_IGNORE:
+				break;
+			case OP_BREAK:
+				FlushTos();
+				EmitString( "CC" );				// int 3
+				break;
+			case OP_ENTER:
+				FlushTos();
+				EmitString( "81 EF" );			// sub edi, iarg
+				Emit4( iarg );
+				RANGECHECK( "E7" );
+				break;
+			case OP_LEAVE:
+				FlushTos();
+				EmitString( "81 C7" );			// add edi, iarg
+				Emit4( iarg );
+				EmitString( "C3" );				// ret
+				break;
+			case OP_CALL:
+				LoadTos();
+				tosInEax = qfalse;
+				EmitString( "48 83 EE 04" );	// sub rsi, 4
+				EmitString( "41 C7 04 38" );	// mov [r8+rdi], instruction+1
+				Emit4( instruction + 1 );
+				EmitString( "09 C0" );			// or eax, eax
+				skip = EmitForward( "0F 8C" );	// jl syscall
+				EmitString( "48 BB" );			// mov rbx, instructionPointers
+				EmitAbsolute( RELOC_INSTRUCTION_POINTERS, (unsigned long)vm->instructionPointers );
+				EmitString( "8B 04 83" );		// mov eax, [rbx+rax*4]
+				EmitString( "4C 01 D0" );		// add rax, r10
+				EmitString( "FF D0" );			// call rax
+				i = EmitForward( "E9" );		// jmp next instruction
+				PatchForward( skip );
+				EmitSyscall( -1 );
+				PatchForward( i );
+				break;
+			case OP_PUSH:
+				FlushTos();
+				EmitString( "48 83 C6 04" );	// add rsi, 4
+				break;
+			case OP_POP:
+				tosInEax = qfalse;				// a cached value is simply dropped
+				EmitString( "48 83 EE 04" );	// sub rsi, 4
+				break;
+			case OP_CONST:
+				if ( EmitConstFused( vm, iarg, nextOp, nextArg, instruction, header->instructionCount ) ) {
+					instruction++;
+					vm->instructionPointers[instruction] = vm->instructionPointers[instruction - 1];
+					pc += 1 + op_argsize[nextOp];
+					break;
+				}
+				FlushTos();
+				EmitString( "48 83 C6 04" );	// add rsi, 4
+				EmitString( "B8" );				// mov eax, iarg
+				Emit4( iarg );
+				tosInEax = qtrue;
+				break;
+			case OP_LOCAL:
+				FlushTos();
+				EmitString( "48 83 C6 04" );	// add rsi, 4
+				EmitString( "8D 87" );			// lea eax, [rdi+iarg]
+				Emit4( iarg );
+				tosInEax = qtrue;
+				break;
+			case OP_JUMP:
+				LoadTos();
+				tosInEax = qfalse;
+				EmitString( "48 83 EE 04" );	// sub rsi, 4
+				EmitString( "48 BB" );			// mov rbx, instructionPointers
+				EmitAbsolute( RELOC_INSTRUCTION_POINTERS, (unsigned long)vm->instructionPointers );
+				EmitString( "8B 04 83" );		// mov eax, [rbx+rax*4]
+				EmitString( "4C 01 D0" );		// add rax, r10
+				EmitString( "FF E0" );			// jmp rax
+				break;
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+				EmitString( "48 83 EE 08" );	// sub rsi, 8
+				if ( tosInEax ) {
+					EmitString( "39 46 04" );	// cmp [rsi+4], eax
+					tosInEax = qfalse;
+				} else {
+					EmitString( "8B 46 04" );	// mov eax, [rsi+4]
+					EmitString( "3B 46 08" );	// cmp eax, [rsi+8]
+				}
+				EmitJump( IntJcc( op ), iarg );
+				break;
+			case OP_EQF:
+				EmitFloatCompare();
+				EmitString( "7A 06" );			// jp over the jcc, unordered never jumps
+				EmitJump( "0F 84", iarg );		// je
+				break;
+			case OP_NEF:
+				EmitFloatCompare();
+				EmitJump( "0F 8A", iarg );		// jp, unordered is not equal
+				EmitJump( "0F 85", iarg );		// jne
+				break;
+			case OP_LTF:
+				EmitFloatCompare();
+				EmitString( "7A 06" );			// jp over the jcc
+				EmitJump( "0F 82", iarg );		// jb
+				break;
+			case OP_LEF:
+				EmitFloatCompare();
+				EmitString( "7A 06" );			// jp over the jcc
+				EmitJump( "0F 86", iarg );		// jbe
+				break;
+			case OP_GTF:
+				EmitFloatCompare();
+				EmitString( "7A 06" );			// jp over the jcc
+				EmitJump( "0F 87", iarg );		// ja
+				break;
+			case OP_GEF:
+				EmitFloatCompare();
+				EmitString( "7A 06" );			// jp over the jcc
+				EmitJump( "0F 83", iarg );		// jae
+				break;
+			case OP_LOAD1:
+				LoadTos();
+				RANGECHECK( "E0" );
+				EmitString( "41 0F B6 04 00" );	// movzx eax, byte [r8+rax]
+				break;
+			case OP_LOAD2:
+				LoadTos();
+				RANGECHECK( "E0" );
+				EmitString( "41 0F B7 04 00" );	// movzx eax, word [r8+rax]
+				break;
+			case OP_LOAD4:
+				LoadTos();
+				RANGECHECK( "E0" );
+				EmitString( "41 8B 04 00" );	// mov eax, [r8+rax]
+				break;
+			case OP_STORE1:
+				LoadTos();
+				EmitString( "8B 5E FC" );		// mov ebx, [rsi-4]
+				RANGECHECK( "E3" );
+				EmitString( "41 88 04 18" );	// mov [r8+rbx], al
+				EmitString( "48 83 EE 08" );	// sub rsi, 8
+				tosInEax = qfalse;
+				break;
+			case OP_STORE2:
+				LoadTos();
+				EmitString( "8B 5E FC" );		// mov ebx, [rsi-4]
+				RANGECHECK( "E3" );
+				EmitString( "66 41 89 04 18" );	// mov [r8+rbx], ax
+				EmitString( "48 83 EE 08" );	// sub rsi, 8
+				tosInEax = qfalse;
+				break;
+			case OP_STORE4:
+				LoadTos();
+				EmitString( "8B 5E FC" );		// mov ebx, [rsi-4]
+				RANGECHECK( "E3" );
+				EmitString( "41 89 04 18" );	// mov [r8+rbx], eax
+				EmitString( "48 83 EE 08" );	// sub rsi, 8
+				tosInEax = qfalse;
+				break;
+			case OP_ARG:
+				LoadTos();
+				EmitString( "8D 9F" );			// lea ebx, [rdi+barg]
+				Emit4( barg );
+				RANGECHECK( "E3" );
+				EmitString( "41 89 04 18" );	// mov [r8+rbx], eax
+				EmitString( "48 83 EE 04" );	// sub rsi, 4
+				tosInEax = qfalse;
+				break;
+			case OP_BLOCK_COPY:
+				FlushTos();
+				EmitString( "48 83 EE 08" );	// sub rsi, 8
+				EmitString( "56" );				// push rsi
+				EmitString( "57" );				// push rdi
+				EmitString( "41 50" );			// push r8
+				EmitString( "41 51" );			// push r9
+				EmitString( "41 52" );			// push r10
+				EmitString( "8B 7E 04" );		// mov edi, [rsi+4]	dest
+				EmitString( "8B 76 08" );		// mov esi, [rsi+8]	src
+				EmitString( "BA" );				// mov edx, iarg	count
+				Emit4( iarg );
+				EmitString( "48 B8" );			// mov rax, block_copy_vm
+				EmitAbsolute( RELOC_BLOCK_COPY, (unsigned long)block_copy_vm );
+				EmitString( "FF D0" );			// call rax
+				EmitString( "41 5A" );			// pop r10
+				EmitString( "41 59" );			// pop r9
+				EmitString( "41 58" );			// pop r8
+				EmitString( "5F" );				// pop rdi
+				EmitString( "5E" );				// pop rsi
+				break;
+			case OP_SEX8:
+				if ( tosInEax ) {
+					EmitString( "0F BE C0" );	// movsx eax, al
+				} else {
+					EmitString( "0F BE 06" );	// movsx eax, byte [rsi]
+				}
+				tosInEax = qtrue;
+				break;
+			case OP_SEX16:
+				if ( tosInEax ) {
+					EmitString( "0F BF C0" );	// movsx eax, ax
+				} else {
+					EmitString( "0F BF 06" );	// movsx eax, word [rsi]
+				}
+				tosInEax = qtrue;
+				break;
+			case OP_NEGI:
+				if ( tosInEax ) {
+					EmitString( "F7 D8" );		// neg eax
+				} else {
+					EmitString( "F7 1E" );		// neg dword [rsi]
+				}
+				break;
+			case OP_BCOM:
+				if ( tosInEax ) {
+					EmitString( "F7 D0" );		// not eax
+				} else {
+					EmitString( "F7 16" );		// not dword [rsi]
+				}
+				break;
+			case OP_ADD:
+				EmitBinaryOp( "01 C8", "03 46 04", "03 06" );	// add
+				break;
+			case OP_SUB:
+				EmitBinaryOp( "29 C8", "2B 46 04", NULL );		// sub
+				break;
+			case OP_BAND:
+				EmitBinaryOp( "21 C8", "23 46 04", "23 06" );	// and
+				break;
+			case OP_BOR:
+				EmitBinaryOp( "09 C8", "0B 46 04", "0B 06" );	// or
+				break;
+			case OP_BXOR:
+				EmitBinaryOp( "31 C8", "33 46 04", "33 06" );	// xor
+				break;
+			case OP_MULI:
+			case OP_MULU:
+				// the low 32 bits are the same for signed and unsigned
+				EmitBinaryOp( "0F AF C1", "0F AF 46 04", "0F AF 06" );	// imul
+				break;
+			case OP_DIVI:
+			case OP_MODI:
+				PopTosToEcx();
+				EmitString( "8B 06" );			// mov eax, [rsi]
+				EmitString( "99" );				// cdq
+				EmitString( "F7 F9" );			// idiv ecx
+				if ( op == OP_MODI ) {
+					EmitString( "89 D0" );		// mov eax, edx
+				}
+				tosInEax = qtrue;
+				break;
+			case OP_DIVU:
+			case OP_MODU:
+				PopTosToEcx();
+				EmitString( "8B 06" );			// mov eax, [rsi]
+				EmitString( "31 D2" );			// xor edx, edx
+				EmitString( "F7 F1" );			// div ecx
+				if ( op == OP_MODU ) {
+					EmitString( "89 D0" );		// mov eax, edx
+				}
+				tosInEax = qtrue;
+				break;
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+				PopTosToEcx();
+				EmitString( "8B 06" );			// mov eax, [rsi]
+				if ( op == OP_LSH ) {
+					EmitString( "D3 E0" );		// shl eax, cl
+				} else if ( op == OP_RSHI ) {
+					EmitString( "D3 F8" );		// sar eax, cl
+				} else {
+					EmitString( "D3 E8" );		// shr eax, cl
+				}
+				tosInEax = qtrue;
+				break;
+			case OP_NEGF:
+				if ( tosInEax ) {
+					EmitString( "35 00 00 00 80" );		// xor eax, 0x80000000
+				} else {
+					EmitString( "81 36 00 00 00 80" );	// xor dword [rsi], 0x80000000
+				}
+				break;
+			case OP_ADDF:
+				EmitFloatOp( "F3 0F 58 C1" );	// addss xmm0, xmm1
+				break;
+			case OP_SUBF:
+				EmitFloatOp( "F3 0F 5C C1" );	// subss xmm0, xmm1
+				break;
+			case OP_DIVF:
+				EmitFloatOp( "F3 0F 5E C1" );	// divss xmm0, xmm1
+				break;
+			case OP_MULF:
+				EmitFloatOp( "F3 0F 59 C1" );	// mulss xmm0, xmm1
+				break;
+			case OP_CVIF:
+				if ( tosInEax ) {
+					EmitString( "F3 0F 2A C0" );	// cvtsi2ss xmm0, eax
+				} else {
+					EmitString( "F3 0F 2A 06" );	// cvtsi2ss xmm0, dword [rsi]
+				}
+				EmitString( "66 0F 7E C0" );	// movd eax, xmm0
+				tosInEax = qtrue;
+				break;
+			case OP_CVFI:
+				if ( tosInEax ) {
+					EmitString( "66 0F 6E C0" );	// movd xmm0, eax
+				} else {
+					EmitString( "F3 0F 10 06" );	// movss xmm0, [rsi]
+				}
+				EmitString( "F3 0F 2C C0" );	// cvttss2si eax, xmm0
+				tosInEax = qtrue;
+				break;
+			default:
+				VM_FreeCompileBuffers();
+				Com_Printf( S_COLOR_RED "instruction not implemented: %x\n", op );
+				vm->compiled = qfalse;
+				return;
+		}
+	}
+
+	// every instruction has an address now
+	for ( i = 0; i < numFixups; i++ )
+	{
+		if ( (unsigned)fixups[i].target >= header->instructionCount ) {
+			VM_FreeCompileBuffers();
+			Com_Error( ERR_DROP, "VM_CompileX86: jump target out of range at offset %d", fixups[i].ofs );
+		}
+		rel = vm->instructionPointers[ fixups[i].target ] - fixups[i].ofs;
+		memcpy( buf + fixups[i].ofs - 4, &rel, 4 );
+	}
+
+	vm->codeLength = compiledOfs;
+	vm->codeBase = mmap(NULL, compiledOfs, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(vm->codeBase == (void*)-1)
+	{
+		VM_FreeCompileBuffers();
+		Com_Error(ERR_DROP, "VM_CompileX86: can't mmap memory");
+	}
+
+	memcpy( vm->codeBase, buf, compiledOfs );
+
+	if ( useCache ) {
+		VM_SaveCache( vm, header, checksum, fileLength );
+	}
+
+	VM_FinishCompile( vm );
+
+	Com_Printf( "VM file %s compiled to %i bytes of code (%p - %p)\n", vm->name, vm->codeLength, vm->codeBase, vm->codeBase+vm->codeLength );
+}
+
+#endif // USE_ASSEMBLER
+
+
+void VM_Destroy_Compiled(vm_t* self)
+{
+#ifdef USE_GAS
+	munmap(self->codeBase, self->codeLength);
+#elif _WIN32
+	VirtualFree(self->codeBase, self->codeLength, MEM_RELEASE);
+#else
+	munmap(self->codeBase, self->codeLength);
+#endif
+#ifdef VM_GUARD_PAGES
+	if(self->dataGuarded)
+		munmap(self->dataBase, VM_GUARD_REGION);
+#endif
+}
+
+/*
+==============
+VM_CallCompiled
+
+This function is called directly by the generated code
+==============
+*/
+
+#ifdef DEBUG_VM
+static char* memData;
+#endif
+
+int	VM_CallCompiled( vm_t *vm, int *args ) {
+	int		programCounter;
+	int		programStack;
+	int		stackOnEntry;
+	byte	*image;
+	void	*entryPoint;
+	void	*opStack;
+	int stack[1024] = { 0xDEADBEEF };
+
+	currentVM = vm;
+
+	++vm->callLevel;
+//	Com_Printf("entering %s level %d, call %d, arg1 = 0x%x\n", vm->name, vm->callLevel, args[0], args[1]);
+
+	// interpret the code
+	vm->currentlyInterpreting = qtrue;
+
+//	callMask = vm->dataMask;
+
+	// we might be called recursively, so this might not be the very top
+	programStack = vm->programStack;
+	stackOnEntry = programStack;
+
+	// set up the stack frame 
+	image = vm->dataBase;
+#ifdef DEBUG_VM
+	memData = (char*)image;
+#endif
+
+	programCounter = 0;
+
+	programStack -= 48;
+
+	*(int *)&image[ programStack + 44] = args[9];
+	*(int *)&image[ programStack + 40] = args[8];
+	*(int *)&image[ programStack + 36] = args[7];
+	*(int *)&image[ programStack + 32] = args[6];
+	*(int *)&image[ programStack + 28] = args[5];
+	*(int *)&image[ programStack + 24] = args[4];
+	*(int *)&image[ programStack + 20] = args[3];
+	*(int *)&image[ programStack + 16] = args[2];
+	*(int *)&image[ programStack + 12] = args[1];
+	*(int *)&image[ programStack + 8 ] = args[0];
+	*(int *)&image[ programStack + 4 ] = 0x77777777;	// return stack
+	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
+
+	// off we go into generated code...
+	entryPoint = getentrypoint(vm);
+	opStack = &stack;
+
+	__asm__ __volatile__ (
+		"	movq %5,%%rsi		\r\n" \
+		"	movl %4,%%edi		\r\n" \
+		"	movq %2,%%r10		\r\n" \
+		"	movq %3,%%r8		\r\n" \
+		"       subq $24, %%rsp # fix alignment as call pushes one value \r\n" \
+		"	callq *%%r10		\r\n" \
+		"       addq $24, %%rsp          \r\n" \
+		"	movl %%edi, %0		\r\n" \
+		"	movq %%rsi, %1		\r\n" \
+		: "=m" (programStack), "=m" (opStack)
+		: "m" (entryPoint), "m" (vm->dataBase), "m" (programStack), "m" (opStack)
+		: "%rsi", "%rdi", "%rax", "%rbx", "%rcx", "%rdx", "%r8", "%r10", "%r15", "%xmm0"
+	);
+
+	if ( opStack != &stack[1] ) {
+		Com_Error( ERR_DROP, "opStack corrupted in compiled code (offset %ld)\n", (long int) ((void *) &stack[1] - opStack));
+	}
+	if ( programStack != stackOnEntry - 48 ) {
+		Com_Error( ERR_DROP, "programStack corrupted in compiled code\n" );
+	}
+
+//	Com_Printf("exiting %s level %d\n", vm->name, vm->callLevel);
+	--vm->callLevel;
+	vm->programStack = stackOnEntry;
+
+	return *(int *)opStack;
+}
+
+#ifdef VM_SAMPLER
+/*
+=============================================================================
+
+vmprof
+
+ITIMER_PROF raises SIGPROF after every interval of cpu time used by the
+process.  The handler only counts: a hit in the code of the running vm
+goes to that instruction, any other hit while it runs to its system
+calls.  Only the thread that started the sampler runs vms.
+
+=============================================================================
+*/
+
+static pthread_t		vmSamplerThread;
+static struct sigaction	vmOldProf;
+static qboolean			vmSampling;
+
+/*
+=================
+VM_SamplerSignal
+=================
+*/
+static void VM_SamplerSignal( int sig, siginfo_t *info, void *context )
+{
+	vm_t	*vm = currentVM;
+	int		*counts;
+	byte	*rip;
+
+	// currentVM isn't cleared when the outermost call returns
+	if ( !vm || !vm->callLevel || !vm->sampleCounts || !pthread_equal( pthread_self(), vmSamplerThread ) ) {
+		vmSamplesOther++;
+		return;
+	}
+	counts = vm->sampleCounts;
+
+	rip = (byte *)( (ucontext_t *)context )->uc_mcontext.gregs[REG_RIP];
+	if ( rip >= vm->codeBase && rip < vm->codeBase + vm->codeLength ) {
+		counts[VM_CodeOffsetToInstruction( vm, rip - vm->codeBase )]++;
+	} else {
+		vm->sampleSyscalls++;
+	}
+}
+
+/*
+=================
+VM_SamplerStart
+=================
+*/
+qboolean VM_SamplerStart( int hz )
+{
+	struct sigaction	sa;
+	struct itimerval	timer;
+
+	if ( vmSampling ) {
+		VM_SamplerStop();
+	}
+
+	vmSamplerThread = pthread_self();
+
+	Com_Memset( &sa, 0, sizeof( sa ) );
+	sa.sa_sigaction = VM_SamplerSignal;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset( &sa.sa_mask );
+	if ( sigaction( SIGPROF, &sa, &vmOldProf ) ) {
+		return qfalse;
+	}
+
+	Com_Memset( &timer, 0, sizeof( timer ) );
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value = timer.it_interval;
+	if ( setitimer( ITIMER_PROF, &timer, NULL ) ) {
+		sigaction( SIGPROF, &vmOldProf, NULL );
+		return qfalse;
+	}
+
+	vmSampling = qtrue;
+	return qtrue;
+}
+
+/*
+=================
+VM_SamplerStop
+=================
+*/
+void VM_SamplerStop( void )
+{
+	struct itimerval	timer;
+
+	if ( !vmSampling ) {
+		return;
+	}
+
+	Com_Memset( &timer, 0, sizeof( timer ) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+	sigaction( SIGPROF, &vmOldProf, NULL );
+	vmSampling = qfalse;
+}
+#endif
@@ -36,6 +36,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
+	struct svEntity_s **worldCell;		// sv_worldGrid chain, instead of worldSector
 	struct svEntity_s *nextEntityInWorldSector;
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
@@ -43,6 +44,7 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
+	int			originCluster, originArea;	// leaf of r.currentOrigin when linked
 	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
@@ -114,9 +116,22 @@ typedef struct netchan_buffer_s {
 	struct netchan_buffer_s *next;
 } netchan_buffer_t;
 
+// userinfo keys the server reads on its own, parsed in one pass by
+// SV_ParseUserinfo whenever the userinfo string is replaced
+typedef struct {
+	char			name[MAX_NAME_LENGTH];
+	char			guid[64];			// cl_guid
+	char			ip[24];				// "ip" without the port
+	char			gear[32];
+	char			rate[16];
+	char			snaps[16];
+	char			handicap[16];
+} clientUserinfo_t;
+
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
+	clientUserinfo_t	uinfo;			// parsed from userinfo
 	char			userinfobuffer[MAX_INFO_STRING]; //used for buffering of user info
 
 	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
@@ -319,6 +334,12 @@ extern	cvar_t	*  sv_noump45;
 extern  cvar_t  *pb_database;
 extern  cvar_t  *pb_filecommands;
 
+extern	cvar_t	*sv_profile;
+extern	cvar_t	*sv_profileCsv;
+extern	cvar_t	*sv_metrics;
+extern	cvar_t	*sv_worldGrid;
+extern	cvar_t	*sv_traceCache;
+
 //===========================================================
 
 //
@@ -364,6 +385,8 @@ void SV_AuthorizeIpPacket( netadr_t from );
 
 void SV_ExecuteClientMessage( client_t *cl, msg_t *msg );
 void SV_UserinfoChanged( client_t *cl );
+void SV_ParseUserinfo( client_t *cl );
+void SV_UserinfoTest_f( void );
 
 void SV_ClientEnterWorld( client_t *client, usercmd_t *cmd );
 void SV_DropClient( client_t *drop, const char *reason );
@@ -461,6 +484,10 @@ void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
+qboolean	SV_EntitiesInPVS( int entityNum1, int entityNum2, qboolean portals );
+void		SV_PVSTest_f( void );
+qboolean	SV_BenchAllowed( void );
+void		SV_GameBench_f( void );
 
 //
 // sv_bot.c
@@ -502,6 +529,8 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_WorldBenchEntity( sharedEntity_t *gEnt, int num, int *seed, const vec3_t mins, const vec3_t maxs );
+void SV_WorldBench_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -532,6 +561,54 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
+//
+// sv_prof.c
+//
+typedef enum {
+	SVP_PACKETS,		// SV_PacketEvent, between frames
+	SVP_PINGS,
+	SVP_BOTS,
+	SVP_GAME,			// GAME_RUN_FRAME
+	SVP_TIMEOUTS,
+	SVP_SNAPSHOT,		// SV_BuildClientSnapshot
+	SVP_ENCODE,			// commands, entities and downloads written to the msg
+	SVP_SEND,			// netchan transmit and demo recording
+	SVP_DATABASE,		// sqlite lookups, also counted in the phase they happen in
+	SVP_FRAME,			// the whole SV_Frame after the sleep
+	SVP_NUM_PHASES
+} svProfPhaseNum_t;
+
+int64_t	SV_ProfStart( void );
+void	SV_ProfStop( svProfPhaseNum_t phase, int64_t start );
+void	SV_ProfEndFrame( int64_t frameStart );
+void	SV_ProfReset( void );
+void	SV_ProfShutdown( void );
+void	SV_Prof_f( void );
+
+//
+// sv_metrics.c
+//
+int64_t	SV_MetricsStart( void );
+void	SV_MetricsPacketIn( client_t *cl, int length );
+void	SV_MetricsPacketOut( int length );
+void	SV_MetricsDatabase( void );
+void	SV_MetricsEndFrame( int64_t frameStart );
+void	SV_MetricsTest_f( void );
+
+//
+// sv_tracecache.c
+//
+void	SV_TraceCacheFrame( void );
+void	SV_TraceCacheForget( void );
+void	SV_TraceCacheTouch( const vec3_t absmin, const vec3_t absmax );
+qboolean	SV_TraceCacheGetTrace( trace_t *results, const vec3_t start, const vec3_t mins,
+			const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule );
+void	SV_TraceCachePutTrace( const trace_t *results, const vec3_t boxmins, const vec3_t boxmaxs );
+qboolean	SV_TraceCacheGetContents( int *contents, const vec3_t p, int passEntityNum );
+void	SV_TraceCachePutContents( int contents, const vec3_t p );
+void	SV_TraceCache_f( void );
+void	SV_TraceCacheTest_f( void );
+
 //
 // sv_net_chan.c
 //
@@ -1647,7 +1647,7 @@ int SQ_TestName(client_t *cl)
     
     nrv = sqlite3_prepare_v2(ndb,nrequete,-1,&nstmt,0);
 
-    char *nbguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+    char *nbguid = cl->uinfo.guid;
     char *nbname = cl->name;
 
     Q_strncpyz( cname, nbname, sizeof(cname) );
@@ -1787,12 +1787,14 @@ SV_Clientindatabase
 
 void SV_Clientindatabase(client_t *cl, char *type)
 {  
+        int64_t start = SV_ProfStart();
+
         SQ_TestDatabase_f();
+        SV_MetricsDatabase();
 
-        char *guid = Info_ValueForKey(cl->userinfo, "cl_guid");
-        char *ip = Info_ValueForKey(cl->userinfo, "ip");
+        char *guid = cl->uinfo.guid;
+        char *ip = cl->uinfo.ip;
 
-        ip = strtok(ip, ":");
 
         SQ_ClientConnect(cl->name, guid, ip, type, NULL, NULL, NULL);
 
@@ -1802,6 +1804,7 @@ void SV_Clientindatabase(client_t *cl, char *type)
            SQ_TestName(cl);
         }
 
+        SV_ProfStop(SVP_DATABASE, start);
         return;    
 }
 /*
@@ -2194,10 +2197,9 @@ static void SV_SetLevel_f(void)
         return;
     }
 
-    ip = Info_ValueForKey(cl->userinfo, "ip");
-    ip = strtok(ip, ":");
+    ip = cl->uinfo.ip;
 
-    guid = Info_ValueForKey(cl->userinfo, "cl_guid");
+    guid = cl->uinfo.guid;
     level = atoi(Cmd_Argv(2));
     
 
@@ -2270,10 +2272,10 @@ int TestLevel(char *command)
 }
 /*
 =================
-SQ_TestClient
+SQ_QueryClient
 =================
 */
-int SQ_TestClient(char *guid, char *type)
+static int SQ_QueryClient(char *guid, char *type)
 {
 
     char *tdatabase;
@@ -2445,6 +2447,21 @@ int SQ_TestClient(char *guid, char *type)
 
 }
 
+/*
+=================
+SQ_TestClient
+=================
+*/
+int SQ_TestClient(char *guid, char *type)
+{
+    int64_t start = SV_ProfStart();
+    int result = SQ_QueryClient(guid, type);
+
+    SV_MetricsDatabase();
+    SV_ProfStop(SVP_DATABASE, start);
+    return result;
+}
+
 /*
 =================
 SQ_TestClientID
@@ -2500,7 +2517,7 @@ void PB_Ctime (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -2537,7 +2554,7 @@ void PB_Cme (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -2565,10 +2582,9 @@ void PB_Cme (client_t *cl) {
               char	*playerdate;
               int       playerid;
 
-              playerip = Info_ValueForKey(cl->userinfo, "ip");
+              playerip = cl->uinfo.ip;
 
               playeraka = SQ_TestClient(cguid, "Aka");
-              playerip = strtok(playerip, ":");
               playerconnection = SQ_TestClient(cguid, "Connections");
               playerdate = SQ_TestClient(cguid, "Date");
               playerid = SQ_TestClient(cguid, "ID");
@@ -2600,7 +2616,7 @@ void PB_Creload (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -2633,7 +2649,7 @@ void PB_Crestart (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -2666,7 +2682,7 @@ void PB_Ccyclemap (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -2699,7 +2715,7 @@ void PB_Cmap (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -2742,7 +2758,7 @@ void PB_Chelp (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char     *clientlevel;
        clevel = TestLevel("help");
@@ -2809,7 +2825,7 @@ void PB_Csetnextmap (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -2852,7 +2868,7 @@ void PB_Ckick (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
      
@@ -2914,7 +2930,7 @@ void PB_Cslap (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        
@@ -2984,7 +3000,7 @@ void PB_Ckill (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3053,7 +3069,7 @@ void PB_Clist( client_t *cl ) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3106,7 +3122,7 @@ void PB_Clist( client_t *cl ) {
                    lteam = "^3Spectator";
                 }
 
-                guid = Info_ValueForKey(clientl->userinfo, "cl_guid");
+                guid = clientl->uinfo.guid;
                 playerlevel = SQ_TestClient(guid, "Setlevel");
 
                 if (playerlevel == NULL ) {playerlevel = 0;}
@@ -3126,7 +3142,7 @@ void PB_Cplayerinfo (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3188,9 +3204,8 @@ void PB_Cplayerinfo (client_t *cl, char *arg) {
 
                 if (client) 
                 {
-                  playerip = Info_ValueForKey(client->userinfo, "ip");
-                  playerguid = Info_ValueForKey(client->userinfo, "cl_guid");
-                  playerip = strtok(playerip, ":");
+                  playerip = client->uinfo.ip;
+                  playerguid = client->uinfo.guid;
                   playername = client->name;
                   playerid = SQ_TestClient(playerguid, "ID");  
 
@@ -3249,13 +3264,12 @@ void PB_Cregister(client_t *cl)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	*ip;
 
-       ip = Info_ValueForKey(cl->userinfo, "ip");
-       ip = strtok(ip, ":");
+       ip = cl->uinfo.ip;
 
        clevel = TestLevel("register");
 
@@ -3299,7 +3313,7 @@ void PB_Csetlevel(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char     *type = "Setlevel";
@@ -3366,10 +3380,9 @@ void PB_Csetlevel(client_t *cl, char *arg)
                 if (client) 
                 {
 
-                 guid = Info_ValueForKey(client->userinfo, "cl_guid");
+                 guid = client->uinfo.guid;
                  clientname = client->name;
-                 clientip = Info_ValueForKey(client->userinfo, "ip");
-                 clientip = strtok(clientip, ":");
+                 clientip = client->uinfo.ip;
 
                 }
 
@@ -3411,7 +3424,7 @@ void PB_Cban(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	*guid;
        int	clevel;
        int      clientlevel;
@@ -3472,10 +3485,9 @@ void PB_Cban(client_t *cl, char *arg)
                 if (client) 
                 {
 
-                 guid = Info_ValueForKey(client->userinfo, "cl_guid");
+                 guid = client->uinfo.guid;
                  clientname = client->name;
-                 clientip = Info_ValueForKey(client->userinfo, "ip");
-                 clientip = strtok(clientip, ":");
+                 clientip = client->uinfo.ip;
 
                 }
 
@@ -3519,7 +3531,7 @@ void PB_Ctempban(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3585,10 +3597,9 @@ void PB_Ctempban(client_t *cl, char *arg)
                 if (client) 
                 {
 
-                 guid = Info_ValueForKey(client->userinfo, "cl_guid");
+                 guid = client->uinfo.guid;
                  clientname = client->name;
-                 clientip = Info_ValueForKey(client->userinfo, "ip");
-                 clientip = strtok(clientip, ":");
+                 clientip = client->uinfo.ip;
                 }
 
                 else 
@@ -3646,7 +3657,7 @@ void PB_Cunban(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3731,7 +3742,7 @@ void PB_Cforce(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -3803,7 +3814,7 @@ void PB_Cteams( client_t *cl )
     if (!Q_stricmp(sv_commands->string, "0"))
         return;
 
-    char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+    char	*cguid = cl->uinfo.guid;
     int	clevel;
     int      clientlevel;
 
@@ -3988,7 +3999,7 @@ void PB_Cmapname (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	*mapname;
        int	clevel;
        int      clientlevel;
@@ -4022,7 +4033,7 @@ void PB_Cwarn(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*message;
        int      clientlevel;
@@ -4078,7 +4089,7 @@ void PB_Cveto (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -4112,7 +4123,7 @@ void PB_Cnuke (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        
@@ -4183,7 +4194,7 @@ void PB_Crename(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*newname;
        int      clientlevel;
@@ -4220,7 +4231,7 @@ void PB_Crename(client_t *cl, char *arg)
 
              
              Info_SetValueForKey(client->userinfo, "name", newname);
-             SV_UserinfoChanged(cl);
+             SV_UserinfoChanged(client);
              VM_Call(gvm, GAME_CLIENT_USERINFO_CHANGED, client - svs.clients);
 
            }
@@ -4240,7 +4251,7 @@ void PB_Cbigtext(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int	*message;
        int      clientlevel;
@@ -4285,7 +4296,7 @@ void PB_Cprivatebigtext(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*message;
        int      clientlevel;
@@ -4339,7 +4350,7 @@ void PB_Cmute (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        
@@ -4398,7 +4409,7 @@ void PB_Cpause (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -4432,7 +4443,7 @@ void PB_Cswapteams (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -4466,7 +4477,7 @@ void PB_Cshuffleteams (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	cmd[64];
        int	clevel;
        int      clientlevel;
@@ -4500,7 +4511,7 @@ void PB_Cmoon(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*onoff;
        int      clientlevel;
@@ -4566,7 +4577,7 @@ void PB_Cgravity(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4613,7 +4624,7 @@ void PB_Cexec(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*value;
        int      clientlevel;
@@ -4658,7 +4669,7 @@ void PB_Cgametype(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*gametype;
        char     *ngametype;
@@ -4719,7 +4730,7 @@ void PB_Crespawndelay(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4769,7 +4780,7 @@ void PB_Crespawngod(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4819,7 +4830,7 @@ void PB_Ctimelimit(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4869,7 +4880,7 @@ void PB_Cfraglimit(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4919,7 +4930,7 @@ void PB_Ccaplimit(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
        char	cmd[64];
@@ -4969,7 +4980,7 @@ void PB_Cmatchmode(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*onoff;
        int      clientlevel;
@@ -5040,7 +5051,7 @@ void PB_Cswaproles(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*onoff;
        int      clientlevel;
@@ -5111,7 +5122,7 @@ void PB_Cfriendlyfire(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        char	*onoff;
        int      clientlevel;
@@ -5202,7 +5213,7 @@ void PB_Cnextmap (client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	*nextmapname;
        int	clevel;
        int      clientlevel;
@@ -5314,7 +5325,7 @@ void PB_Csuperslap (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -5408,7 +5419,7 @@ void PB_Cadmins(client_t *cl) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        int	clevel;
        int      clientlevel;
 
@@ -5441,7 +5452,7 @@ void PB_Cadmins(client_t *cl) {
 		    if (!client->state)
 		       {continue;}
 
-                     adminguid = Info_ValueForKey(client->userinfo, "cl_guid");
+                     adminguid = client->uinfo.guid;
                      
                      adminlevel = SQ_TestClient(adminguid, "Setlevel");
                      adminaka = SQ_TestClient(adminguid, "Aka");
@@ -5609,7 +5620,7 @@ void PB_Clookup (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
 
        int	clevel;
        int      clientlevel;
@@ -5719,7 +5730,7 @@ void PB_Clookupip (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
 
        int	clevel;
        int      clientlevel;
@@ -5968,7 +5979,7 @@ void PB_Clookupban (client_t *cl, char *arg) {
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
 
        int	clevel;
        int      clientlevel;
@@ -6009,7 +6020,7 @@ void PB_Cinfoban(client_t *cl, char *arg)
         return;
     }
 
-       char	*cguid = Info_ValueForKey(cl->userinfo, "cl_guid");
+       char	*cguid = cl->uinfo.guid;
        char	*guid;
        int	clevel;
        int      clientlevel;
@@ -6154,8 +6165,12 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("serverinfo", SV_Serverinfo_f);
 	Cmd_AddCommand ("systeminfo", SV_Systeminfo_f);
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
+	Cmd_AddCommand ("uinfotest", SV_UserinfoTest_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("worldbench", SV_WorldBench_f);
+	Cmd_AddCommand ("tracecache", SV_TraceCache_f);
+	Cmd_AddCommand ("tracecachetest", SV_TraceCacheTest_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 
 #ifndef PRE_RELEASE_DEMO
@@ -6176,6 +6191,14 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("killplayer", SV_KillPlayer_f);
 	Cmd_AddCommand ("killp", SV_KillPlayer_f);
 	Cmd_AddCommand ("setlevel", SV_SetLevel_f);
+	Cmd_AddCommand ("svprof", SV_Prof_f);
+	Cmd_AddCommand ("metricstest", SV_MetricsTest_f);
+	Cmd_AddCommand ("gamebench", SV_GameBench_f);
+	Cmd_AddCommand ("pvstest", SV_PVSTest_f);
+	Cmd_AddCommand ("cmstress", CM_Stress_f);
+	Cmd_AddCommand ("cmsidestest", CM_SidesTest_f);
+	Cmd_AddCommand ("cmpatchtest", CM_PatchTest_f);
+	Cmd_AddCommand ("cmareatest", CM_AreaTest_f);
 }
 
 /*
@@ -420,7 +420,7 @@ gotnewcl:
 		SV_Heartbeat_f();
 	}
 
-	gear = Info_ValueForKey(newcl->userinfo, "gear");
+	gear = newcl->uinfo.gear;
 
 	SV_ChangeGear(newcl, gear);
 
@@ -1135,6 +1135,137 @@ static void SV_ResetPureClient_f( client_t *cl ) {
 	cl->gotCP = qfalse;
 }
 
+typedef struct {
+	const char	*key;
+	size_t		offset;
+	int			size;
+} userinfoField_t;
+
+#define	UIOFS(x)	((size_t)&(((clientUserinfo_t *)0)->x))
+#define	UISIZE(x)	sizeof(((clientUserinfo_t *)0)->x)
+
+static const userinfoField_t userinfoFields[] = {
+	{ "name", UIOFS( name ), UISIZE( name ) },
+	{ "cl_guid", UIOFS( guid ), UISIZE( guid ) },
+	{ "ip", UIOFS( ip ), UISIZE( ip ) },
+	{ "gear", UIOFS( gear ), UISIZE( gear ) },
+	{ "rate", UIOFS( rate ), UISIZE( rate ) },
+	{ "snaps", UIOFS( snaps ), UISIZE( snaps ) },
+	{ "handicap", UIOFS( handicap ), UISIZE( handicap ) }
+};
+
+#define	NUM_USERINFO_FIELDS		( sizeof( userinfoFields ) / sizeof( userinfoFields[0] ) )
+
+/*
+=================
+SV_ParseUserinfo
+
+Copy the userinfo keys the server uses into cl->uinfo with a single
+walk of the info string, so callers don't rescan it for every lookup.
+A repeated key keeps its first value, the one Info_ValueForKey and
+the game see.
+=================
+*/
+void SV_ParseUserinfo( client_t *cl ) {
+	char		key[BIG_INFO_KEY];
+	char		value[BIG_INFO_VALUE];
+	const char	*s;
+	char		*field, *port;
+	int			i, seen;
+
+	Com_Memset( &cl->uinfo, 0, sizeof( cl->uinfo ) );
+
+	seen = 0;
+	s = cl->userinfo;
+	while ( *s ) {
+		Info_NextPair( &s, key, value );
+
+		for ( i = 0 ; i < NUM_USERINFO_FIELDS ; i++ ) {
+			if ( !Q_stricmp( key, userinfoFields[i].key ) ) {
+				break;
+			}
+		}
+		if ( i == NUM_USERINFO_FIELDS || ( seen & ( 1 << i ) ) ) {
+			continue;
+		}
+		seen |= 1 << i;
+
+		field = (char *)&cl->uinfo + userinfoFields[i].offset;
+		Q_strncpyz( field, value, userinfoFields[i].size );
+		if ( field == cl->uinfo.ip ) {
+			port = strchr( field, ':' );
+			if ( port ) {
+				*port = 0;
+			}
+		}
+	}
+}
+
+/*
+=================
+SV_UserinfoTest_f
+
+uinfotest
+
+Parses crafted userinfo strings, and the one of every connected
+client, and counts the cached fields that differ from what
+Info_ValueForKey returns for the same key
+=================
+*/
+void SV_UserinfoTest_f( void ) {
+	static const char *tests[] = {
+		"\\name\\Player\\cl_guid\\AAAA\\ip\\1.2.3.4:27960",
+		"\\cl_guid\\AAAA\\name\\First\\cl_guid\\BBBB\\name\\Second",
+		"\\ip\\1.2.3.4:27960\\ip\\5.6.7.8:27960\\rate\\25000\\rate\\1000",
+		"\\name\\\\name\\NotEmpty\\snaps\\20",
+		"\\NAME\\Upper\\name\\lower\\Gear\\GZAAVWT\\gear\\FAAAAAA",
+		"\\\\skipped\\handicap\\100\\handicap\\50",
+		"\\name\\Last\\cl_guid"
+	};
+	static client_t	scratch;
+	client_t		*cl;
+	const char		*expected;
+	char			*field, *port;
+	char			ip[BIG_INFO_VALUE];
+	int				i, j, numTests, checked, mismatches;
+
+	checked = mismatches = 0;
+	numTests = sizeof( tests ) / sizeof( tests[0] );
+	for ( i = -numTests ; i < sv_maxclients->integer ; i++ ) {
+		if ( i < 0 ) {
+			cl = &scratch;
+			Q_strncpyz( cl->userinfo, tests[i + numTests], sizeof( cl->userinfo ) );
+			SV_ParseUserinfo( cl );
+		} else {
+			if ( !svs.clients || svs.clients[i].state < CS_CONNECTED ) {
+				continue;
+			}
+			cl = &svs.clients[i];
+		}
+
+		for ( j = 0 ; j < NUM_USERINFO_FIELDS ; j++ ) {
+			expected = Info_ValueForKey( cl->userinfo, userinfoFields[j].key );
+			field = (char *)&cl->uinfo + userinfoFields[j].offset;
+			if ( field == cl->uinfo.ip ) {
+				Q_strncpyz( ip, expected, sizeof( ip ) );
+				port = strchr( ip, ':' );
+				if ( port ) {
+					*port = 0;
+				}
+				expected = ip;
+			}
+			if ( strncmp( field, expected, userinfoFields[j].size - 1 ) ) {
+				Com_Printf( "\"%s\": %s is \"%s\", Info_ValueForKey has \"%s\"\n",
+					cl->userinfo, userinfoFields[j].key, field, expected );
+				mismatches++;
+			}
+			checked++;
+		}
+	}
+
+	Com_Printf( "%i userinfo fields checked, %i differ\n", checked, mismatches );
+}
+
 /*
 =================
 SV_UserinfoChanged
@@ -1150,8 +1281,10 @@ void SV_UserinfoChanged( client_t *cl ) {
 	int	len;
 
 
+	SV_ParseUserinfo( cl );
+
 	// name for C code
-	Q_strncpyz( cl->name, Info_ValueForKey (cl->userinfo, "name"), sizeof(cl->name) );
+	Q_strncpyz( cl->name, cl->uinfo.name, sizeof(cl->name) );
 
 	// rate command
 
@@ -1160,7 +1293,7 @@ void SV_UserinfoChanged( client_t *cl ) {
 	if ( Sys_IsLANAddress( cl->netchan.remoteAddress ) && com_dedicated->integer != 2 && sv_lanForceRate->integer == 1) {
 		cl->rate = 99999;	// lans should not rate limit
 	} else {
-		val = Info_ValueForKey (cl->userinfo, "rate");
+		val = cl->uinfo.rate;
 		if (strlen(val)) {
 			i = atoi(val);
 			cl->rate = i;
@@ -1173,16 +1306,17 @@ void SV_UserinfoChanged( client_t *cl ) {
 			cl->rate = 3000;
 		}
 	}
-	val = Info_ValueForKey (cl->userinfo, "handicap");
+	val = cl->uinfo.handicap;
 	if (strlen(val)) {
 		i = atoi(val);
 		if (i<=0 || i>100 || strlen(val) > 4) {
 			Info_SetValueForKey( cl->userinfo, "handicap", "100" );
+			Q_strncpyz( cl->uinfo.handicap, "100", sizeof( cl->uinfo.handicap ) );
 		}
 	}
 
 	// snaps command
-	val = Info_ValueForKey (cl->userinfo, "snaps");
+	val = cl->uinfo.snaps;
 	if (strlen(val)) {
 		i = atoi(val);
 		if ( i < 1 ) {
@@ -1209,10 +1343,16 @@ void SV_UserinfoChanged( client_t *cl ) {
 	else
 		len = strlen( ip ) + 4 + strlen( cl->userinfo );
 
-	if( len >= MAX_INFO_STRING )
+	if( len >= MAX_INFO_STRING ) {
 		SV_DropClient( cl, "userinfo string length exceeded" );
-	else
+	} else {
 		Info_SetValueForKey( cl->userinfo, "ip", ip );
+		Q_strncpyz( cl->uinfo.ip, ip, sizeof( cl->uinfo.ip ) );
+		val = strchr( cl->uinfo.ip, ':' );
+		if ( val ) {
+			*val = 0;
+		}
+	}
 
 }
 
@@ -1240,7 +1380,7 @@ void SV_UpdateUserinfo_f( client_t *cl ) {
 	char 		*c;
 	char		*gear;
 
-	gear = Info_ValueForKey(cl->userinfo, "gear");
+	gear = cl->uinfo.gear;
 	SV_ChangeGear(cl, gear);
 
 	if ((c = strpbrk(cl->name, " ")!= NULL) || (c = strpbrk(cl->name, "/")!= NULL))
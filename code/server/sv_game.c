@@ -144,6 +144,23 @@ void SV_SetBrushModel( sharedEntity_t *ent, const char *name ) {
 
 
 
+/*
+=================
+SV_ClusterVisible
+=================
+*/
+static qboolean SV_ClusterVisible( int cluster1, int area1, int cluster2, int area2, qboolean portals ) {
+	byte	*mask;
+
+	mask = CM_ClusterPVS( cluster1 );
+	if ( mask && (!(mask[cluster2>>3] & (1<<(cluster2&7)) ) ) )
+		return qfalse;
+	if ( portals && !CM_AreasConnected( area1, area2 ) )
+		return qfalse;		// a door blocks sight
+	return qtrue;
+}
+
+
 /*
 =================
 SV_inPVS
@@ -153,24 +170,12 @@ Also checks portalareas so that doors block sight
 */
 qboolean SV_inPVS (const vec3_t p1, const vec3_t p2)
 {
-	int		leafnum;
-	int		cluster;
-	int		area1, area2;
-	byte	*mask;
-
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	area1 = CM_LeafArea (leafnum);
-	mask = CM_ClusterPVS (cluster);
+	int		leaf1, leaf2;
 
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
-	area2 = CM_LeafArea (leafnum);
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
-		return qfalse;
-	if (!CM_AreasConnected (area1, area2))
-		return qfalse;		// a door blocks sight
-	return qtrue;
+	leaf1 = CM_PointLeafnum (p1);
+	leaf2 = CM_PointLeafnum (p2);
+	return SV_ClusterVisible( CM_LeafCluster( leaf1 ), CM_LeafArea( leaf1 ),
+		CM_LeafCluster( leaf2 ), CM_LeafArea( leaf2 ), qtrue );
 }
 
 
@@ -183,27 +188,180 @@ Does NOT check portalareas
 */
 qboolean SV_inPVSIgnorePortals( const vec3_t p1, const vec3_t p2)
 {
-	int		leafnum;
-	int		cluster;
-	int		area1, area2;
-	byte	*mask;
+	int		leaf1, leaf2;
 
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	area1 = CM_LeafArea (leafnum);
-	mask = CM_ClusterPVS (cluster);
+	leaf1 = CM_PointLeafnum (p1);
+	leaf2 = CM_PointLeafnum (p2);
+	return SV_ClusterVisible( CM_LeafCluster( leaf1 ), -1,
+		CM_LeafCluster( leaf2 ), -1, qfalse );
+}
 
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
-	area2 = CM_LeafArea (leafnum);
 
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
-		return qfalse;
+/*
+=================
+SV_EntityOriginLeaf
 
-	return qtrue;
+Linked entities use the leaf SV_LinkEntity found for their origin,
+the others are looked up where they are now
+=================
+*/
+static void SV_EntityOriginLeaf( int entityNum, int *cluster, int *area ) {
+	sharedEntity_t	*gEnt;
+	svEntity_t		*svEnt;
+	int				leafnum;
+
+	if ( entityNum < 0 || entityNum >= sv.num_entities ) {
+		Com_Error( ERR_DROP, "SV_EntityOriginLeaf: bad entity %i", entityNum );
+	}
+	gEnt = SV_GentityNum( entityNum );
+	svEnt = sv.svEntities + entityNum;
+
+	if ( gEnt->r.linked ) {
+		*cluster = svEnt->originCluster;
+		*area = svEnt->originArea;
+		return;
+	}
+	leafnum = CM_PointLeafnum( gEnt->r.currentOrigin );
+	*cluster = CM_LeafCluster( leafnum );
+	*area = CM_LeafArea( leafnum );
+}
+
+
+/*
+=================
+SV_EntitiesInPVS
+
+SV_inPVS for the origins of two entities, without walking the tree
+for the ones that are linked
+=================
+*/
+qboolean SV_EntitiesInPVS( int entityNum1, int entityNum2, qboolean portals ) {
+	int		cluster1, area1, cluster2, area2;
+
+	SV_EntityOriginLeaf( entityNum1, &cluster1, &area1 );
+	SV_EntityOriginLeaf( entityNum2, &cluster2, &area2 );
+	return SV_ClusterVisible( cluster1, area1, cluster2, area2, portals );
 }
 
 
+/*
+=================
+SV_PVSTest_f
+
+pvstest [entities] [pairs]
+
+Puts boxes in the free entity slots, linked or moved after unlinking,
+and counts the pairs for which SV_EntitiesInPVS differs from SV_inPVS
+and SV_inPVSIgnorePortals on their origins.  The slots are put back
+afterwards.
+=================
+*/
+void SV_PVSTest_f( void ) {
+	vec3_t			worldMins, worldMaxs;
+	sharedEntity_t	*gEnt, *gEnt2;
+	byte			*savedEntities;
+	svEntity_t		*savedSvEntities;
+	int				*pairs;
+	qboolean		*results;
+	int				numEntities, numPairs, first, seed, checked, differ, visible;
+	int				i, j, pass;
+	int64_t			start, entityUsec, pointUsec;
+	qboolean		portals, inPVS;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !SV_BenchAllowed() ) {
+		return;
+	}
+
+	numEntities = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 256;
+	numPairs = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 100000;
+	first = sv.num_entities;
+	if ( numEntities > ENTITYNUM_MAX_NORMAL - first ) {
+		numEntities = ENTITYNUM_MAX_NORMAL - first;
+	}
+	if ( numEntities <= 0 || numPairs <= 0 ) {
+		Com_Printf( "Usage: pvstest [entities] [pairs]\n" );
+		return;
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+
+	savedEntities = Z_Malloc( numEntities * sv.gentitySize );
+	savedSvEntities = Z_Malloc( numEntities * sizeof( *savedSvEntities ) );
+	pairs = Z_Malloc( numPairs * 2 * sizeof( *pairs ) );
+	results = Z_Malloc( numPairs * sizeof( *results ) );
+	Com_Memcpy( savedEntities, SV_GentityNum( first ), numEntities * sv.gentitySize );
+	Com_Memcpy( savedSvEntities, sv.svEntities + first, numEntities * sizeof( *savedSvEntities ) );
+
+	// one in four is unlinked and put somewhere else, like a dead body
+	seed = 1;
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		gEnt = SV_GentityNum( first + i );
+		SV_WorldBenchEntity( gEnt, first + i, &seed, worldMins, worldMaxs );
+		SV_LinkEntity( gEnt );
+		if ( ( i & 3 ) == 3 ) {
+			SV_UnlinkEntity( gEnt );
+			for ( j = 0 ; j < 3 ; j++ ) {
+				gEnt->r.currentOrigin[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			}
+		}
+	}
+	sv.num_entities = first + numEntities;
+
+	for ( i = 0 ; i < numPairs * 2 ; i++ ) {
+		pairs[i] = first + (int)( Q_random( &seed ) * numEntities ) % numEntities;
+	}
+
+	checked = differ = visible = 0;
+	entityUsec = pointUsec = 0;
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		portals = ( pass == 1 );
+
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < numPairs ; i++ ) {
+			results[i] = SV_EntitiesInPVS( pairs[i * 2], pairs[i * 2 + 1], portals );
+		}
+		entityUsec += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < numPairs ; i++ ) {
+			gEnt = SV_GentityNum( pairs[i * 2] );
+			gEnt2 = SV_GentityNum( pairs[i * 2 + 1] );
+			if ( portals ) {
+				inPVS = SV_inPVS( gEnt->r.currentOrigin, gEnt2->r.currentOrigin );
+			} else {
+				inPVS = SV_inPVSIgnorePortals( gEnt->r.currentOrigin, gEnt2->r.currentOrigin );
+			}
+			if ( inPVS != results[i] ) {
+				differ++;
+			}
+			visible += inPVS;
+		}
+		pointUsec += Sys_Microseconds() - start;
+		checked += numPairs;
+	}
+
+	// put the slots back and the world the way it was
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		SV_UnlinkEntity( SV_GentityNum( first + i ) );
+	}
+	Com_Memcpy( SV_GentityNum( first ), savedEntities, numEntities * sv.gentitySize );
+	Com_Memcpy( sv.svEntities + first, savedSvEntities, numEntities * sizeof( *savedSvEntities ) );
+	sv.num_entities = first;
+
+	Z_Free( savedEntities );
+	Z_Free( savedSvEntities );
+	Z_Free( pairs );
+	Z_Free( results );
+
+	Com_Printf( "SV_EntitiesInPVS %i usec, SV_inPVS on the origins %i usec\n",
+		(int)entityUsec, (int)pointUsec );
+	Com_Printf( "%i pairs checked, %i visible, %i differ\n", checked, visible, differ );
+}
+
 /*
 ========================
 SV_AdjustAreaPortalState
@@ -298,6 +456,184 @@ static int	FloatAsInt( float f ) {
 	return temp.i;
 }
 
+/*
+====================
+SV_GameOpenFile
+
+Files the game appends to are its logs (games.log), those are written
+from the log thread when com_logAsync is set
+====================
+*/
+static int SV_GameOpenFile( const char *qpath, fileHandle_t *f, fsMode_t mode ) {
+	int		r;
+
+	r = FS_FOpenFileByMode( qpath, f, mode );
+	if ( f && *f && ( mode == FS_APPEND || mode == FS_APPEND_SYNC ) ) {
+		FS_AsyncLog( *f );
+	}
+	return r;
+}
+
+/*
+====================
+SV_GameTraceBatch
+
+The arrays come from the module, so both are bounded before any trace runs
+====================
+*/
+static void SV_GameTraceBatch( intptr_t requests, intptr_t results, int count ) {
+	traceRequest_t	*request;
+	trace_t			*trace;
+	int				i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+	if ( count > MAX_TRACE_BATCH ) {
+		Com_Error( ERR_DROP, "SV_GameTraceBatch: %i traces, max is %i", count, MAX_TRACE_BATCH );
+	}
+	request = VM_ArgArray( requests, count, sizeof( *request ) );
+	trace = VM_ArgArray( results, count, sizeof( *trace ) );
+	if ( !request || !trace ) {
+		Com_Error( ERR_DROP, "SV_GameTraceBatch: bad array" );
+	}
+
+	for ( i = 0 ; i < count ; i++, request++, trace++ ) {
+		SV_Trace( trace, request->start, request->mins, request->maxs, request->end,
+			request->passEntityNum, request->contentmask, request->capsule );
+	}
+}
+
+/*
+=============================================================================
+
+The traps the game calls most often, typed and indexed by call number so
+the vm can skip the switch in SV_GameSystemCalls.  args are the module's
+own ints with the first argument in args[1].
+
+=============================================================================
+*/
+
+static intptr_t SV_GameTrace( int *args ) {
+	SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
+	return 0;
+}
+
+static intptr_t SV_GameTraceCapsule( int *args ) {
+	SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
+	return 0;
+}
+
+static intptr_t SV_GameTraceBatchTrap( int *args ) {
+	SV_GameTraceBatch( args[1], args[2], args[3] );
+	return 0;
+}
+
+static intptr_t SV_GamePointContents( int *args ) {
+	return SV_PointContents( VMA(1), args[2] );
+}
+
+static intptr_t SV_GameEntitiesInBox( int *args ) {
+	return SV_AreaEntities( VMA(1), VMA(2), VMA(3), args[4] );
+}
+
+static intptr_t SV_GameEntityContact( int *args ) {
+	return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qfalse );
+}
+
+static intptr_t SV_GameLinkEntity( int *args ) {
+	SV_LinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameUnlinkEntity( int *args ) {
+	SV_UnlinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameInPVS( int *args ) {
+	return SV_inPVS( VMA(1), VMA(2) );
+}
+
+static intptr_t SV_GameEntitiesInPVS( int *args ) {
+	return SV_EntitiesInPVS( args[1], args[2], args[3] );
+}
+
+static intptr_t SV_GameGetUsercmd( int *args ) {
+	SV_GetUsercmd( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_GameCvarUpdate( int *args ) {
+	Cvar_Update( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameMilliseconds( int *args ) {
+	return Sys_Milliseconds();
+}
+
+static intptr_t SV_GameMemset( int *args ) {
+	Com_Memset( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+static intptr_t SV_GameMemcpy( int *args ) {
+	Com_Memcpy( VMA(1), VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_GameSqrt( int *args ) {
+	return FloatAsInt( sqrt( VMF(1) ) );
+}
+
+static intptr_t SV_GameSin( int *args ) {
+	return FloatAsInt( sin( VMF(1) ) );
+}
+
+static intptr_t SV_GameCos( int *args ) {
+	return FloatAsInt( cos( VMF(1) ) );
+}
+
+static intptr_t SV_GameAtan2( int *args ) {
+	return FloatAsInt( atan2( VMF(1), VMF(2) ) );
+}
+
+static intptr_t SV_GameAngleVectors( int *args ) {
+	AngleVectors( VMA(1), VMA(2), VMA(3), VMA(4) );
+	return 0;
+}
+
+static vmSyscall_t	svGameSyscalls[TRAP_CEIL + 1];
+
+/*
+====================
+SV_GameSyscallTable
+====================
+*/
+static void SV_GameSyscallTable( void ) {
+	svGameSyscalls[G_TRACE] = SV_GameTrace;
+	svGameSyscalls[G_TRACECAPSULE] = SV_GameTraceCapsule;
+	svGameSyscalls[G_TRACE_BATCH] = SV_GameTraceBatchTrap;
+	svGameSyscalls[G_POINT_CONTENTS] = SV_GamePointContents;
+	svGameSyscalls[G_ENTITIES_IN_BOX] = SV_GameEntitiesInBox;
+	svGameSyscalls[G_ENTITY_CONTACT] = SV_GameEntityContact;
+	svGameSyscalls[G_LINKENTITY] = SV_GameLinkEntity;
+	svGameSyscalls[G_UNLINKENTITY] = SV_GameUnlinkEntity;
+	svGameSyscalls[G_IN_PVS] = SV_GameInPVS;
+	svGameSyscalls[G_ENTITIES_IN_PVS] = SV_GameEntitiesInPVS;
+	svGameSyscalls[G_GET_USERCMD] = SV_GameGetUsercmd;
+	svGameSyscalls[G_CVAR_UPDATE] = SV_GameCvarUpdate;
+	svGameSyscalls[G_MILLISECONDS] = SV_GameMilliseconds;
+	svGameSyscalls[TRAP_MEMSET] = SV_GameMemset;
+	svGameSyscalls[TRAP_MEMCPY] = SV_GameMemcpy;
+	svGameSyscalls[TRAP_SQRT] = SV_GameSqrt;
+	svGameSyscalls[TRAP_SIN] = SV_GameSin;
+	svGameSyscalls[TRAP_COS] = SV_GameCos;
+	svGameSyscalls[TRAP_ATAN2] = SV_GameAtan2;
+	svGameSyscalls[TRAP_ANGLEVECTORS] = SV_GameAngleVectors;
+}
+
 /*
 ====================
 SV_GameSystemCalls
@@ -339,7 +675,7 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		return 0;
 
 	case G_FS_FOPEN_FILE:
-		return FS_FOpenFileByMode( VMA(1), VMA(2), args[3] );
+		return SV_GameOpenFile( VMA(1), VMA(2), args[3] );
 	case G_FS_READ:
 		FS_Read2( VMA(1), args[2], args[3] );
 		return 0;
@@ -381,6 +717,9 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TRACECAPSULE:
 		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
 		return 0;
+	case G_TRACE_BATCH:
+		SV_GameTraceBatch( args[1], args[2], args[3] );
+		return 0;
 	case G_POINT_CONTENTS:
 		return SV_PointContents( VMA(1), args[2] );
 	case G_SET_BRUSH_MODEL:
@@ -390,6 +729,8 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		return SV_inPVS( VMA(1), VMA(2) );
 	case G_IN_PVS_IGNORE_PORTALS:
 		return SV_inPVSIgnorePortals( VMA(1), VMA(2) );
+	case G_ENTITIES_IN_PVS:
+		return SV_EntitiesInPVS( args[1], args[2], args[3] );
 
 	case G_SET_CONFIGSTRING:
 		SV_SetConfigstring( args[1], VMA(2) );
@@ -946,11 +1287,18 @@ void SV_InitGameProgs( void ) {
 		bot_enable = 0;
 	}
 
+	// tells the game G_TRACE_BATCH is there
+	Cvar_Get( GAME_TRACE_BATCH_CVAR, "1", CVAR_ROM );
+	// and G_ENTITIES_IN_PVS
+	Cvar_Get( GAME_ENTITIES_IN_PVS_CVAR, "1", CVAR_ROM );
+
 	// load the dll or bytecode
 	gvm = VM_Create( "qagame", SV_GameSystemCalls, Cvar_VariableValue( "vm_game" ) );
 	if ( !gvm ) {
 		Com_Error( ERR_FATAL, "VM_Create on game failed" );
 	}
+	SV_GameSyscallTable();
+	VM_SetSyscallTable( gvm, svGameSyscalls, sizeof( svGameSyscalls ) / sizeof( svGameSyscalls[0] ) );
 
 	SV_InitGameVM( qfalse );
 }
@@ -971,3 +1319,73 @@ qboolean SV_GameCommand( void ) {
 	return VM_Call( gvm, GAME_CONSOLE_COMMAND );
 }
 
+/*
+====================
+SV_BenchAllowed
+
+The benches stall the server and can move its clock, so with players
+on it they need sv_cheats.  Bots don't count.
+====================
+*/
+qboolean SV_BenchAllowed( void ) {
+	client_t	*cl;
+	int			i;
+
+	if ( Cvar_VariableIntegerValue( "sv_cheats" ) ) {
+		return qtrue;
+	}
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED && cl->netchan.remoteAddress.type != NA_BOT ) {
+			Com_Printf( "%s needs sv_cheats while clients are connected.\n", Cmd_Argv( 0 ) );
+			return qfalse;
+		}
+	}
+	return qtrue;
+}
+
+/*
+====================
+SV_GameBench_f
+
+gamebench [frames]
+
+Runs game frames back to back and times them, to compare vm_game and
+vm_threaded on the same map.  Only for a test server: the clients see
+the time jump, so it is refused with clients on unless sv_cheats is set.
+====================
+*/
+void SV_GameBench_f( void ) {
+	int64_t		start, usec;
+	int			i, frames, frameMsec;
+
+	if ( sv.state != SS_GAME || !gvm ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !SV_BenchAllowed() ) {
+		return;
+	}
+
+	frames = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000;
+	if ( frames <= 0 ) {
+		Com_Printf( "Usage: gamebench [frames]\n" );
+		return;
+	}
+	frameMsec = 1000 / ( sv_fps->integer > 0 ? sv_fps->integer : 20 );
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < frames ; i++ ) {
+		svs.time += frameMsec;
+		sv.time += frameMsec;
+		// as SV_Frame does, cached traces are only good for one frame
+		SV_TraceCacheFrame();
+		if ( com_dedicated->integer ) {
+			SV_BotFrame( sv.time );
+		}
+		VM_Call( gvm, GAME_RUN_FRAME, sv.time );
+	}
+	usec = Sys_Microseconds() - start;
+
+	Com_Printf( "%i frames in %i msec, %i usec per frame\n", frames,
+		(int)( usec / 1000 ), (int)( usec / frames ) );
+}
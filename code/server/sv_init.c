@@ -185,7 +185,8 @@ void SV_SetUserinfo( int index, const char *val ) {
 	}
 
 	Q_strncpyz( svs.clients[index].userinfo, val, sizeof( svs.clients[ index ].userinfo ) );
-	Q_strncpyz( svs.clients[index].name, Info_ValueForKey( val, "name" ), sizeof(svs.clients[index].name) );
+	SV_ParseUserinfo( &svs.clients[index] );
+	Q_strncpyz( svs.clients[index].name, svs.clients[index].uinfo.name, sizeof(svs.clients[index].name) );
 }
 
 
@@ -707,6 +708,12 @@ void SV_Init (void) {
         pb_database = Cvar_Get("pb_database", "UrTDataBase.db", CVAR_ARCHIVE);
         pb_filecommands = Cvar_Get("pb_filecommands", "commands.cfg", CVAR_ARCHIVE);
 
+	sv_profile = Cvar_Get ("sv_profile", "1", 0 );
+	sv_profileCsv = Cvar_Get ("sv_profileCsv", "", 0 );
+	sv_metrics = Cvar_Get ("sv_metrics", "", 0 );
+	sv_worldGrid = Cvar_Get ("sv_worldGrid", "0", CVAR_ARCHIVE );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
+
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
 
@@ -772,6 +779,7 @@ void SV_Shutdown( char *finalmsg ) {
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
 	SV_ShutdownGameProgs();
+	SV_ProfShutdown();
 
 	// free current level
 	SV_ClearServer();
@@ -77,6 +77,12 @@ cvar_t	*  sv_noump45;
 
 cvar_t  *pb_database;
 cvar_t  *pb_filecommands;
+
+cvar_t	*sv_profile;			// time the server frame phases for svprof
+cvar_t	*sv_profileCsv;			// also append every frame to this file
+cvar_t	*sv_metrics;			// local socket for the per second telemetry
+cvar_t	*sv_worldGrid;			// loose grids instead of world sectors, read on map load
+cvar_t	*sv_traceCache;			// keep trace results until the world changes
 /*
 =============================================================================
 
@@ -672,16 +678,17 @@ void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 
 /*
 =================
-SV_ReadPackets
+SV_ReadPacket
 =================
 */
-void SV_PacketEvent( netadr_t from, msg_t *msg ) {
+static void SV_ReadPacket( netadr_t from, msg_t *msg ) {
 	int			i;
 	client_t	*cl;
 	int			qport;
 
 	// check for connectionless packet (0xffffffff) first
 	if ( msg->cursize >= 4 && *(int *)msg->data == -1) {
+		SV_MetricsPacketIn( NULL, msg->cursize );
 		SV_ConnectionlessPacket( from, msg );
 		return;
 	}
@@ -715,6 +722,7 @@ void SV_PacketEvent( netadr_t from, msg_t *msg ) {
 		}
 
 		// make sure it is a valid, in sequence packet
+		SV_MetricsPacketIn( cl, msg->cursize );
 		if (SV_Netchan_Process(cl, msg)) {
 			// zombie clients still need to do the Netchan_Process
 			// to make sure they don't need to retransmit the final
@@ -727,11 +735,26 @@ void SV_PacketEvent( netadr_t from, msg_t *msg ) {
 		return;
 	}
 	
+	SV_MetricsPacketIn( NULL, msg->cursize );
+
 	// if we received a sequenced packet from an address we don't recognize,
 	// send an out of band disconnect packet to it
 	NET_OutOfBandPrint( NS_SERVER, from, "disconnect" );
 }
 
+/*
+=================
+SV_PacketEvent
+=================
+*/
+void SV_PacketEvent( netadr_t from, msg_t *msg ) {
+	int64_t		start;
+
+	start = SV_ProfStart();
+	SV_ReadPacket( from, msg );
+	SV_ProfStop( SVP_PACKETS, start );
+}
+
 
 /*
 ===================
@@ -881,6 +904,9 @@ happen before SV_Frame is called
 void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
+	int64_t	frameStart;
+	int64_t	phaseStart;
+	int64_t	metricsStart;
 
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
@@ -951,6 +977,9 @@ void SV_Frame( int msec ) {
 		return;
 	}
 
+	frameStart = SV_ProfStart();
+	metricsStart = SV_MetricsStart();
+
 	// update infostrings if anything has been changed
 	if ( cvar_modifiedFlags & CVAR_SERVERINFO ) {
 		SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO ) );
@@ -968,11 +997,20 @@ void SV_Frame( int msec ) {
 	}
 
 	// update ping based on the all received frames
+	phaseStart = SV_ProfStart();
 	SV_CalcPings();
+	SV_ProfStop( SVP_PINGS, phaseStart );
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	SV_TraceCacheFrame();
+
+	if (com_dedicated->integer) {
+		phaseStart = SV_ProfStart();
+		SV_BotFrame (sv.time);
+		SV_ProfStop( SVP_BOTS, phaseStart );
+	}
 
 	// run the game simulation in chunks
+	phaseStart = SV_ProfStart();
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
@@ -981,13 +1019,16 @@ void SV_Frame( int msec ) {
 		// let everything in the world think and move
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	}
+	SV_ProfStop( SVP_GAME, phaseStart );
 
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
 
 	// check timeouts
+	phaseStart = SV_ProfStart();
 	SV_CheckTimeouts();
+	SV_ProfStop( SVP_TIMEOUTS, phaseStart );
 	
 	// check user info buffer thingy
 	SV_CheckClientUserinfoTimer();
@@ -997,6 +1038,9 @@ void SV_Frame( int msec ) {
         
         // send a heartbeat to the master if needed
 	SV_MasterHeartbeat();
+
+	SV_ProfEndFrame( frameStart );
+	SV_MetricsEndFrame( metricsStart );
 }
 
 //============================================================================
@@ -0,0 +1,385 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_metrics.c -- per second telemetry for a local collector
+
+#include "server.h"
+
+/*
+=============================================================================
+
+When sv_metrics is set ("unix:/path/to/socket" or "127.0.0.1:<port>"),
+one datagram is sent every second.  Each line is a record type followed
+by space separated key=value pairs, new keys may be added at any time:
+
+sv time=<unix seconds> svtime=<msec> fps=<sv_fps> frames=<n>
+   frame_avg=<usec> frame_max=<usec> pkt_in=<n> bytes_in=<n>
+   pkt_out=<n> bytes_out=<n> clients=<n> db=<n>
+
+cl num=<client> ping=<msec> loss=<percent> rate=<bytes/sec>
+   snap=<bytes> relq=<n> name=<name without colors, rest of the line>
+
+The "sv" line comes first, followed by one "cl" line for every connected
+client.  Packets are counted as the server sees them: pkt_in is every
+packet read, pkt_out every netchan message.  db counts the database
+lookups, which run in the frame.  loss is the share of sequence numbers
+the client skipped since the last record.
+
+=============================================================================
+*/
+
+#define	METRICS_INTERVAL	1000		// msec
+
+typedef struct {
+	int			connectTime;		// detects a reused slot
+	int			lastSequence;
+	int			packets;
+} metricsClient_t;
+
+static struct {
+	int				nextSend;
+
+	int				frames;
+	int64_t			frameTotal;
+	int				frameMax;
+
+	int				packetsIn;
+	int				bytesIn;
+	int				packetsOut;
+	int				bytesOut;
+	int				database;
+
+	metricsClient_t	clients[MAX_CLIENTS];
+} svMetrics;
+
+
+/*
+==================
+SV_MetricsStart
+==================
+*/
+int64_t SV_MetricsStart( void ) {
+	if ( !sv_metrics || !sv_metrics->string[0] ) {
+		return 0;
+	}
+	return Sys_Microseconds();
+}
+
+/*
+==================
+SV_MetricsPacketIn
+
+cl is NULL for connectionless packets
+==================
+*/
+void SV_MetricsPacketIn( client_t *cl, int length ) {
+	svMetrics.packetsIn++;
+	svMetrics.bytesIn += length;
+	if ( cl ) {
+		svMetrics.clients[cl - svs.clients].packets++;
+	}
+}
+
+/*
+==================
+SV_MetricsPacketOut
+==================
+*/
+void SV_MetricsPacketOut( int length ) {
+	svMetrics.packetsOut++;
+	svMetrics.bytesOut += length;
+}
+
+/*
+==================
+SV_MetricsDatabase
+==================
+*/
+void SV_MetricsDatabase( void ) {
+	svMetrics.database++;
+}
+
+/*
+==================
+SV_MetricsClientLine
+==================
+*/
+static void SV_MetricsClientLine( client_t *cl, char *line, int size ) {
+	metricsClient_t	*mc;
+	char			name[MAX_NAME_LENGTH];
+	int				sequences, loss;
+
+	mc = &svMetrics.clients[cl - svs.clients];
+	if ( mc->connectTime != cl->lastConnectTime ) {
+		mc->connectTime = cl->lastConnectTime;
+		mc->lastSequence = cl->netchan.incomingSequence;
+		mc->packets = 0;
+	}
+
+	sequences = cl->netchan.incomingSequence - mc->lastSequence;
+	loss = 0;
+	if ( sequences > mc->packets ) {
+		loss = ( sequences - mc->packets ) * 100 / sequences;
+	}
+	mc->lastSequence = cl->netchan.incomingSequence;
+	mc->packets = 0;
+
+	Q_strncpyz( name, cl->name, sizeof( name ) );
+	Q_CleanStr( name );
+
+	Com_sprintf( line, size, "cl num=%i ping=%i loss=%i rate=%i snap=%i relq=%i name=%s\n",
+		(int)( cl - svs.clients ), cl->ping, loss, cl->rate,
+		cl->frames[( cl->netchan.outgoingSequence - 1 ) & PACKET_MASK].messageSize,
+		cl->reliableSequence - cl->reliableAcknowledge, name );
+}
+
+/*
+==================
+SV_MetricsSend
+==================
+*/
+static void SV_MetricsSend( const char *target ) {
+	static char	record[MAX_CLIENTS * 128 + 512];
+	client_t	*cl;
+	int			i, length, clients;
+
+	clients = 0;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED ) {
+			clients++;
+		}
+	}
+
+	Com_sprintf( record, sizeof( record ),
+		"sv time=%li svtime=%i fps=%i frames=%i frame_avg=%i frame_max=%i "
+		"pkt_in=%i bytes_in=%i pkt_out=%i bytes_out=%i clients=%i db=%i\n",
+		(long)time( NULL ), svs.time, sv_fps->integer, svMetrics.frames,
+		svMetrics.frames ? (int)( svMetrics.frameTotal / svMetrics.frames ) : 0, svMetrics.frameMax,
+		svMetrics.packetsIn, svMetrics.bytesIn, svMetrics.packetsOut, svMetrics.bytesOut,
+		clients, svMetrics.database );
+	length = strlen( record );
+
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state < CS_CONNECTED ) {
+			continue;
+		}
+		SV_MetricsClientLine( cl, record + length, sizeof( record ) - length );
+		length += strlen( record + length );
+	}
+
+	NET_SendMetrics( target, record, length );
+
+	svMetrics.frames = 0;
+	svMetrics.frameTotal = 0;
+	svMetrics.frameMax = 0;
+	svMetrics.packetsIn = 0;
+	svMetrics.bytesIn = 0;
+	svMetrics.packetsOut = 0;
+	svMetrics.bytesOut = 0;
+	svMetrics.database = 0;
+}
+
+/*
+==================
+SV_MetricsEndFrame
+
+Called once per server frame that ran the game
+==================
+*/
+void SV_MetricsEndFrame( int64_t frameStart ) {
+	int		usec, now;
+
+	if ( !frameStart ) {
+		// closes the socket if sv_metrics was cleared
+		NET_SendMetrics( sv_metrics->string, NULL, 0 );
+		return;
+	}
+
+	usec = (int)( Sys_Microseconds() - frameStart );
+	svMetrics.frames++;
+	svMetrics.frameTotal += usec;
+	if ( usec > svMetrics.frameMax ) {
+		svMetrics.frameMax = usec;
+	}
+
+	now = Sys_Milliseconds();
+	if ( now - svMetrics.nextSend < 0 ) {
+		return;
+	}
+	svMetrics.nextSend = now + METRICS_INTERVAL;
+
+	SV_MetricsSend( sv_metrics->string );
+}
+
+/*
+==================
+SV_MetricsTestField
+
+Checks " key=<number>" in line against what the record should hold
+==================
+*/
+static qboolean SV_MetricsTestField( const char *line, const char *key, long expected, long slack ) {
+	char		pattern[32];
+	const char	*p;
+	char		*end;
+	long		value;
+
+	Com_sprintf( pattern, sizeof( pattern ), " %s=", key );
+	p = strstr( line, pattern );
+	if ( !p ) {
+		Com_Printf( "metricstest: no %s in \"%s\"\n", key, line );
+		return qfalse;
+	}
+
+	p += strlen( pattern );
+	value = strtol( p, &end, 10 );
+	if ( end == p || ( *end && *end != ' ' ) ) {
+		Com_Printf( "metricstest: %s is not a number in \"%s\"\n", key, line );
+		return qfalse;
+	}
+	if ( value < expected - slack || value > expected + slack ) {
+		Com_Printf( "metricstest: %s=%li, expected %li\n", key, value, expected );
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+==================
+SV_MetricsTest_f
+
+metricstest
+
+Sends the record of the current second to a socket of its own instead
+of the collector, parses it back and checks every field of the "sv"
+line and the "cl" lines against the counters it was built from
+==================
+*/
+void SV_MetricsTest_f( void ) {
+	static char	record[MAX_CLIENTS * 128 + 512];
+	char		target[64];
+	char		*line, *next;
+	client_t	*cl;
+	long		now;
+	int			i, length, clients, svtime, wrong, checked, num;
+	int			frames, frameAvg, frameMax, pktIn, bytesIn, pktOut, bytesOut, db;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !NET_OpenMetricsReader( target, sizeof( target ) ) ) {
+		return;
+	}
+
+	// SV_MetricsSend clears the counters
+	clients = 0;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED ) {
+			clients++;
+		}
+	}
+	now = (long)time( NULL );
+	svtime = svs.time;
+	frames = svMetrics.frames;
+	frameAvg = frames ? (int)( svMetrics.frameTotal / frames ) : 0;
+	frameMax = svMetrics.frameMax;
+	pktIn = svMetrics.packetsIn;
+	bytesIn = svMetrics.bytesIn;
+	pktOut = svMetrics.packetsOut;
+	bytesOut = svMetrics.bytesOut;
+	db = svMetrics.database;
+
+	SV_MetricsSend( target );
+	length = NET_ReadMetrics( record, sizeof( record ) - 1, 1000 );
+	// back to the collector, if there is one
+	NET_SendMetrics( sv_metrics->string, NULL, 0 );
+	if ( length <= 0 ) {
+		Com_Printf( "metricstest: no record came back from %s\n", target );
+		return;
+	}
+	record[length] = 0;
+
+	line = record;
+	next = strchr( line, '\n' );
+	if ( !next ) {
+		Com_Printf( "metricstest: the record doesn't end in a newline\n" );
+		return;
+	}
+	*next++ = 0;
+	Com_Printf( "%s\n", line );
+
+	checked = 12;
+	wrong = 0;
+	if ( strncmp( line, "sv ", 3 ) ) {
+		Com_Printf( "metricstest: the record doesn't start with an sv line\n" );
+		wrong++;
+	}
+	wrong += !SV_MetricsTestField( line, "time", now, 1 );
+	wrong += !SV_MetricsTestField( line, "svtime", svtime, 0 );
+	wrong += !SV_MetricsTestField( line, "fps", sv_fps->integer, 0 );
+	wrong += !SV_MetricsTestField( line, "frames", frames, 0 );
+	wrong += !SV_MetricsTestField( line, "frame_avg", frameAvg, 0 );
+	wrong += !SV_MetricsTestField( line, "frame_max", frameMax, 0 );
+	wrong += !SV_MetricsTestField( line, "pkt_in", pktIn, 0 );
+	wrong += !SV_MetricsTestField( line, "bytes_in", bytesIn, 0 );
+	wrong += !SV_MetricsTestField( line, "pkt_out", pktOut, 0 );
+	wrong += !SV_MetricsTestField( line, "bytes_out", bytesOut, 0 );
+	wrong += !SV_MetricsTestField( line, "clients", clients, 0 );
+	wrong += !SV_MetricsTestField( line, "db", db, 0 );
+
+	// one cl line for every connected client, in slot order
+	num = 0;
+	for ( line = next ; *line ; line = next ) {
+		next = strchr( line, '\n' );
+		if ( !next ) {
+			Com_Printf( "metricstest: the record doesn't end in a newline\n" );
+			wrong++;
+			break;
+		}
+		*next++ = 0;
+
+		while ( num < sv_maxclients->integer && svs.clients[num].state < CS_CONNECTED ) {
+			num++;
+		}
+		checked += 3;
+		if ( strncmp( line, "cl ", 3 ) || num >= sv_maxclients->integer ) {
+			Com_Printf( "metricstest: unexpected line \"%s\"\n", line );
+			wrong++;
+			continue;
+		}
+		cl = &svs.clients[num];
+		wrong += !SV_MetricsTestField( line, "num", num, 0 );
+		wrong += !SV_MetricsTestField( line, "rate", cl->rate, 0 );
+		if ( !strstr( line, " name=" ) ) {
+			Com_Printf( "metricstest: no name in \"%s\"\n", line );
+			wrong++;
+		}
+		num++;
+		clients--;
+	}
+	if ( clients ) {
+		Com_Printf( "metricstest: %i cl lines missing\n", clients );
+		wrong++;
+	}
+
+	Com_Printf( "%i fields checked, %i wrong\n", checked, wrong );
+}
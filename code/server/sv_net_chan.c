@@ -146,6 +146,7 @@ void SV_Netchan_TransmitNextFragment( client_t *client ) {
 			netbuf = client->netchan_start_queue;
 			SV_Netchan_Encode( client, &netbuf->msg );
 			Netchan_Transmit( &client->netchan, netbuf->msg.cursize, netbuf->msg.data );
+			SV_MetricsPacketOut( netbuf->msg.cursize );
 			// pop from queue
 			client->netchan_start_queue = netbuf->next;
 			if (!client->netchan_start_queue) {
@@ -188,6 +189,7 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg) {	//int length, const by
 	} else {
 		SV_Netchan_Encode( client, msg );
 		Netchan_Transmit( &client->netchan, msg->cursize, msg->data );
+		SV_MetricsPacketOut( msg->cursize );
 	}
 }
 
@@ -0,0 +1,314 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_prof.c -- server frame phase timing
+
+#include "server.h"
+
+/*
+=============================================================================
+
+Every phase accumulates microseconds during a frame.  SV_ProfEndFrame
+moves the totals into a ring of the last SV_PROF_SAMPLES frames, which
+"svprof" turns into percentiles on demand.  Packets are read between
+server frames, so their time is charged to the frame that follows.
+
+=============================================================================
+*/
+
+#define	SV_PROF_SAMPLES		1024	// about 50 seconds at sv_fps 20
+#define	SV_PROF_BUCKETS		24		// log2 buckets of microseconds
+
+typedef struct {
+	int			current;					// accumulated this frame
+	int			samples[SV_PROF_SAMPLES];
+} svProfPhase_t;
+
+static const char *svProfNames[SVP_NUM_PHASES] = {
+	"packets",
+	"pings",
+	"bots",
+	"game",
+	"timeouts",
+	"snapshot",
+	"encode",
+	"send",
+	"database",
+	"frame"
+};
+
+static svProfPhase_t	svProf[SVP_NUM_PHASES];
+static int				svProfFrames;		// total frames recorded
+static fileHandle_t		svProfCsv;
+
+
+/*
+==================
+SV_ProfStart
+==================
+*/
+int64_t SV_ProfStart( void ) {
+	if ( !sv_profile || !sv_profile->integer ) {
+		return 0;
+	}
+	return Sys_Microseconds();
+}
+
+/*
+==================
+SV_ProfStop
+==================
+*/
+void SV_ProfStop( svProfPhaseNum_t phase, int64_t start ) {
+	if ( !start ) {
+		return;
+	}
+	svProf[phase].current += (int)( Sys_Microseconds() - start );
+}
+
+/*
+==================
+SV_ProfCloseCsv
+==================
+*/
+static void SV_ProfCloseCsv( void ) {
+	if ( svProfCsv ) {
+		FS_FCloseFile( svProfCsv );
+		svProfCsv = 0;
+	}
+}
+
+/*
+==================
+SV_ProfClientCount
+==================
+*/
+static int SV_ProfClientCount( void ) {
+	int		i, count;
+
+	if ( !svs.clients ) {
+		return 0;
+	}
+
+	count = 0;
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+==================
+SV_ProfWriteCsv
+
+One line per frame, opened again whenever sv_profileCsv changes
+==================
+*/
+static void SV_ProfWriteCsv( void ) {
+	char	line[MAX_STRING_CHARS];
+	int		i;
+
+	if ( sv_profileCsv->modified ) {
+		sv_profileCsv->modified = qfalse;
+		SV_ProfCloseCsv();
+
+		if ( sv_profileCsv->string[0] ) {
+			svProfCsv = FS_FOpenFileWrite( sv_profileCsv->string );
+			if ( !svProfCsv ) {
+				Com_Printf( "Couldn't open %s for writing\n", sv_profileCsv->string );
+				return;
+			}
+			Com_sprintf( line, sizeof( line ), "svstime,clients" );
+			for ( i = 0 ; i < SVP_NUM_PHASES ; i++ ) {
+				Q_strcat( line, sizeof( line ), va( ",%s", svProfNames[i] ) );
+			}
+			Q_strcat( line, sizeof( line ), "\n" );
+			FS_Write( line, strlen( line ), svProfCsv );
+		}
+	}
+
+	if ( !svProfCsv ) {
+		return;
+	}
+
+	Com_sprintf( line, sizeof( line ), "%i,%i", svs.time, SV_ProfClientCount() );
+	for ( i = 0 ; i < SVP_NUM_PHASES ; i++ ) {
+		Q_strcat( line, sizeof( line ), va( ",%i", svProf[i].current ) );
+	}
+	Q_strcat( line, sizeof( line ), "\n" );
+	FS_Write( line, strlen( line ), svProfCsv );
+}
+
+/*
+==================
+SV_ProfEndFrame
+
+Called once per server frame that ran the game
+==================
+*/
+void SV_ProfEndFrame( int64_t frameStart ) {
+	int		i, index;
+
+	if ( !frameStart ) {
+		return;
+	}
+	SV_ProfStop( SVP_FRAME, frameStart );
+
+	SV_ProfWriteCsv();
+
+	index = svProfFrames % SV_PROF_SAMPLES;
+	for ( i = 0 ; i < SVP_NUM_PHASES ; i++ ) {
+		svProf[i].samples[index] = svProf[i].current;
+		svProf[i].current = 0;
+	}
+	svProfFrames++;
+}
+
+/*
+==================
+SV_ProfReset
+==================
+*/
+void SV_ProfReset( void ) {
+	Com_Memset( svProf, 0, sizeof( svProf ) );
+	svProfFrames = 0;
+}
+
+/*
+==================
+SV_ProfShutdown
+==================
+*/
+void SV_ProfShutdown( void ) {
+	SV_ProfCloseCsv();
+	sv_profileCsv->modified = qtrue;
+}
+
+/*
+==================
+SV_ProfCompare
+==================
+*/
+static int QDECL SV_ProfCompare( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+==================
+SV_ProfPrintHistogram
+==================
+*/
+static void SV_ProfPrintHistogram( int phase, const int *sorted, int count ) {
+	int		buckets[SV_PROF_BUCKETS];
+	int		i, bucket, value, max;
+	char	bar[41];
+
+	Com_Memset( buckets, 0, sizeof( buckets ) );
+	for ( i = 0 ; i < count ; i++ ) {
+		bucket = 0;
+		for ( value = sorted[i] ; value > 1 && bucket < SV_PROF_BUCKETS - 1 ; value >>= 1 ) {
+			bucket++;
+		}
+		buckets[bucket]++;
+	}
+
+	max = 1;
+	for ( i = 0 ; i < SV_PROF_BUCKETS ; i++ ) {
+		if ( buckets[i] > max ) {
+			max = buckets[i];
+		}
+	}
+
+	Com_Printf( "%s, microseconds per frame:\n", svProfNames[phase] );
+	for ( i = 0 ; i < SV_PROF_BUCKETS ; i++ ) {
+		if ( !buckets[i] ) {
+			continue;
+		}
+		value = buckets[i] * ( sizeof( bar ) - 1 ) / max;
+		Com_Memset( bar, '#', value );
+		bar[value] = 0;
+		Com_Printf( "%8i-%-8i %5i %s\n", i ? 1 << i : 0, ( 2 << i ) - 1, buckets[i], bar );
+	}
+}
+
+/*
+==================
+SV_Prof_f
+
+svprof [reset | <phase>]
+==================
+*/
+void SV_Prof_f( void ) {
+	int		*sorted;
+	int		count, i, phase;
+	char	*arg;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		SV_ProfReset();
+		Com_Printf( "Server profile cleared.\n" );
+		return;
+	}
+
+	if ( !sv_profile->integer ) {
+		Com_Printf( "sv_profile is 0, no timings are being collected.\n" );
+	}
+
+	count = svProfFrames < SV_PROF_SAMPLES ? svProfFrames : SV_PROF_SAMPLES;
+	if ( !count ) {
+		Com_Printf( "No server frames recorded.\n" );
+		return;
+	}
+
+	sorted = Z_Malloc( count * sizeof( *sorted ) );
+
+	arg = Cmd_Argv( 1 );
+	if ( *arg ) {
+		for ( phase = 0 ; phase < SVP_NUM_PHASES ; phase++ ) {
+			if ( !Q_stricmp( arg, svProfNames[phase] ) ) {
+				break;
+			}
+		}
+		if ( phase == SVP_NUM_PHASES ) {
+			Com_Printf( "Usage: svprof [reset | <phase>]\n" );
+		} else {
+			Com_Memcpy( sorted, svProf[phase].samples, count * sizeof( *sorted ) );
+			qsort( sorted, count, sizeof( *sorted ), SV_ProfCompare );
+			SV_ProfPrintHistogram( phase, sorted, count );
+		}
+		Z_Free( sorted );
+		return;
+	}
+
+	Com_Printf( "last %i frames, microseconds:\n", count );
+	Com_Printf( "phase          p50      p95      p99      max\n" );
+	Com_Printf( "---------- -------- -------- -------- --------\n" );
+	for ( i = 0 ; i < SVP_NUM_PHASES ; i++ ) {
+		Com_Memcpy( sorted, svProf[i].samples, count * sizeof( *sorted ) );
+		qsort( sorted, count, sizeof( *sorted ), SV_ProfCompare );
+		Com_Printf( "%-10s %8i %8i %8i %8i\n", svProfNames[i],
+			sorted[count * 50 / 100], sorted[count * 95 / 100],
+			sorted[count * 99 / 100], sorted[count - 1] );
+	}
+
+	Z_Free( sorted );
+}
@@ -654,9 +654,12 @@ Also called by SV_FinalMessage
 void SV_SendClientSnapshot( client_t *client ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
+	int64_t		start;
 
 	// build the snapshot
+	start = SV_ProfStart();
 	SV_BuildClientSnapshot( client );
+	SV_ProfStop( SVP_SNAPSHOT, start );
 
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
@@ -664,6 +667,8 @@ void SV_SendClientSnapshot( client_t *client ) {
 		return;
 	}
 
+	start = SV_ProfStart();
+
 	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
 	msg.allowoverflow = qtrue;
 
@@ -686,8 +691,11 @@ void SV_SendClientSnapshot( client_t *client ) {
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
 		MSG_Clear (&msg);
 	}
+	SV_ProfStop( SVP_ENCODE, start );
 
+	start = SV_ProfStart();
 	SV_SendMessageToClient( &msg, client );
+	SV_ProfStop( SVP_SEND, start );
 }
 
 
@@ -699,6 +707,7 @@ SV_SendClientMessages
 void SV_SendClientMessages( void ) {
 	int			i;
 	client_t	*c;
+	int64_t		start;
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -715,7 +724,9 @@ void SV_SendClientMessages( void ) {
 		if ( c->netchan.unsentFragments ) {
 			c->nextSnapshotTime = svs.time + 
 				SV_RateMsec( c, c->netchan.unsentLength - c->netchan.unsentFragmentStart );
+			start = SV_ProfStart();
 			SV_Netchan_TransmitNextFragment( c );
+			SV_ProfStop( SVP_SEND, start );
 			continue;
 		}
 
@@ -0,0 +1,571 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_tracecache.c -- repeated SV_Trace and SV_PointContents within a frame
+
+#include "server.h"
+
+/*
+=============================================================================
+
+With sv_traceCache set, the results of SV_Trace and SV_PointContents are
+kept until the next server frame, in a direct mapped table keyed by all of
+their arguments.  Every entry remembers the box its query looked at, and
+SV_LinkEntity / SV_UnlinkEntity drop the entries whose box touches the
+old or the new bounds of the entity, so only the queries an entity can
+have changed are done again.
+
+A cached result is only right as long as the game relinks an entity after
+changing its contents, owner or origin, which the game code normally does
+but nothing enforces, so it is off by default.  sv_traceCache 2 still does
+every query and counts the cached results that would have been wrong, to
+check a game before trusting it.  "tracecache" prints the hit rates and an
+estimate of the collision time they saved.
+
+=============================================================================
+*/
+
+#define	TRACE_CACHE_SIZE	1024		// power of two
+
+typedef enum {
+	TCQ_TRACE,
+	TCQ_CAPSULE,
+	TCQ_POINT
+} traceCacheQuery_t;
+
+typedef struct {
+	vec3_t		start, end, mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			query;					// traceCacheQuery_t
+} traceCacheKey_t;
+
+typedef struct {
+	int				generation;			// valid if it is the current one
+	traceCacheKey_t	key;
+	vec3_t			absmin, absmax;		// everything the query looked at
+	trace_t			trace;				// contents only for TCQ_POINT
+} traceCacheEntry_t;
+
+typedef struct {
+	int			lookups;
+	int			hits;
+	int			wrong;				// sv_traceCache 2 hits that differed
+	int64_t		missUsec;			// spent on the queries that missed
+} traceCacheStats_t;
+
+static struct {
+	int					generation;
+	traceCacheEntry_t	entries[TRACE_CACHE_SIZE];
+
+	// stored since the last new generation, to be checked on a relink
+	int					live[TRACE_CACHE_SIZE];
+	int					numLive;
+
+	traceCacheKey_t		missKey;		// the lookup that missed last
+	int64_t				missStart;
+	qboolean			verifying;		// missed on purpose, compare with...
+	trace_t				cached;
+
+	traceCacheStats_t	traces, points;
+	int					frames;
+	int					dropped;
+
+	qboolean			suspended;		// tracecachetest asks the world itself
+} svTraceCache;
+
+
+/*
+==================
+SV_TraceCacheForget
+
+Also for code that moves entities without SV_LinkEntity
+==================
+*/
+void SV_TraceCacheForget( void ) {
+	svTraceCache.generation++;
+	if ( !svTraceCache.generation ) {
+		svTraceCache.generation++;		// 0 never matches
+	}
+	svTraceCache.numLive = 0;
+}
+
+/*
+==================
+SV_TraceCacheActive
+==================
+*/
+static qboolean SV_TraceCacheActive( void ) {
+	if ( sv_traceCache->modified ) {
+		// nothing was dropped while it was off
+		sv_traceCache->modified = qfalse;
+		SV_TraceCacheForget();
+	}
+	return sv_traceCache->integer != 0 && !svTraceCache.suspended;
+}
+
+/*
+==================
+SV_TraceCacheFrame
+
+Called at the start of every server frame, forgets everything
+==================
+*/
+void SV_TraceCacheFrame( void ) {
+	if ( !SV_TraceCacheActive() ) {
+		return;
+	}
+	SV_TraceCacheForget();
+	svTraceCache.frames++;
+}
+
+/*
+==================
+SV_TraceCacheTouch
+
+Drops the queries that could see an entity with these bounds
+==================
+*/
+void SV_TraceCacheTouch( const vec3_t absmin, const vec3_t absmax ) {
+	traceCacheEntry_t	*entry;
+	int					i;
+
+	if ( !sv_traceCache->integer ) {
+		return;
+	}
+
+	for ( i = 0 ; i < svTraceCache.numLive ; i++ ) {
+		entry = &svTraceCache.entries[svTraceCache.live[i]];
+		if ( entry->generation != svTraceCache.generation
+			|| entry->absmin[0] > absmax[0] || entry->absmax[0] < absmin[0]
+			|| entry->absmin[1] > absmax[1] || entry->absmax[1] < absmin[1]
+			|| entry->absmin[2] > absmax[2] || entry->absmax[2] < absmin[2] ) {
+			continue;
+		}
+		entry->generation = 0;
+		svTraceCache.dropped++;
+	}
+}
+
+/*
+==================
+SV_TraceCacheKey
+==================
+*/
+static void SV_TraceCacheKey( traceCacheKey_t *key, const vec3_t start, const vec3_t mins,
+	const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int query ) {
+	Com_Memset( key, 0, sizeof( *key ) );
+	VectorCopy( start, key->start );
+	VectorCopy( end, key->end );
+	VectorCopy( mins, key->mins );
+	VectorCopy( maxs, key->maxs );
+	key->passEntityNum = passEntityNum;
+	key->contentmask = contentmask;
+	key->query = query;
+}
+
+/*
+==================
+SV_TraceCacheEntry
+==================
+*/
+static traceCacheEntry_t *SV_TraceCacheEntry( const traceCacheKey_t *key ) {
+	const int	*p;
+	unsigned	hash;
+	int			i;
+
+	// FNV-1a over the words of the key
+	hash = 2166136261u;
+	for ( i = 0, p = (const int *)key ; i < sizeof( *key ) / sizeof( int ) ; i++, p++ ) {
+		hash = ( hash ^ *p ) * 16777619u;
+	}
+	hash ^= hash >> 15;
+
+	return &svTraceCache.entries[hash & ( TRACE_CACHE_SIZE - 1 )];
+}
+
+/*
+==================
+SV_TraceCacheGet
+==================
+*/
+static traceCacheEntry_t *SV_TraceCacheGet( traceCacheStats_t *stats, const vec3_t start,
+	const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int query ) {
+	traceCacheEntry_t	*entry;
+
+	if ( !SV_TraceCacheActive() ) {
+		return NULL;
+	}
+
+	SV_TraceCacheKey( &svTraceCache.missKey, start, mins, maxs, end, passEntityNum, contentmask, query );
+	entry = SV_TraceCacheEntry( &svTraceCache.missKey );
+
+	stats->lookups++;
+	if ( entry->generation == svTraceCache.generation
+		&& !memcmp( &entry->key, &svTraceCache.missKey, sizeof( entry->key ) ) ) {
+		stats->hits++;
+		if ( sv_traceCache->integer != 2 ) {
+			return entry;
+		}
+		svTraceCache.verifying = qtrue;
+		svTraceCache.cached = entry->trace;
+		return NULL;
+	}
+
+	svTraceCache.verifying = qfalse;
+	svTraceCache.missStart = Sys_Microseconds();
+	return NULL;
+}
+
+/*
+==================
+SV_TraceCachePut
+
+Only after the SV_TraceCacheGet that missed for the same query
+==================
+*/
+static traceCacheEntry_t *SV_TraceCachePut( traceCacheStats_t *stats ) {
+	traceCacheEntry_t	*entry;
+
+	if ( !sv_traceCache->integer || svTraceCache.suspended ) {
+		return NULL;
+	}
+
+	if ( !svTraceCache.verifying ) {
+		stats->missUsec += Sys_Microseconds() - svTraceCache.missStart;
+	}
+
+	if ( svTraceCache.numLive == TRACE_CACHE_SIZE ) {
+		SV_TraceCacheForget();		// a busy frame, start over
+	}
+
+	entry = SV_TraceCacheEntry( &svTraceCache.missKey );
+	entry->generation = svTraceCache.generation;
+	entry->key = svTraceCache.missKey;
+	svTraceCache.live[svTraceCache.numLive++] = entry - svTraceCache.entries;
+	return entry;
+}
+
+/*
+==================
+SV_TraceCacheGetTrace
+
+qtrue if the result was cached
+==================
+*/
+qboolean SV_TraceCacheGetTrace( trace_t *results, const vec3_t start, const vec3_t mins,
+	const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceCacheEntry_t	*entry;
+
+	entry = SV_TraceCacheGet( &svTraceCache.traces, start, mins, maxs, end,
+		passEntityNum, contentmask, capsule ? TCQ_CAPSULE : TCQ_TRACE );
+	if ( !entry ) {
+		return qfalse;
+	}
+	*results = entry->trace;
+	return qtrue;
+}
+
+/*
+==================
+SV_TraceCachePutTrace
+
+boxmins and boxmaxs bound the entities the trace was clipped against,
+NULL if the world stopped it before any entity was looked at
+==================
+*/
+void SV_TraceCachePutTrace( const trace_t *results, const vec3_t boxmins, const vec3_t boxmaxs ) {
+	traceCacheEntry_t	*entry;
+
+	entry = SV_TraceCachePut( &svTraceCache.traces );
+	if ( !entry ) {
+		return;
+	}
+	if ( boxmins ) {
+		VectorCopy( boxmins, entry->absmin );
+		VectorCopy( boxmaxs, entry->absmax );
+	} else {
+		ClearBounds( entry->absmin, entry->absmax );
+	}
+	entry->trace = *results;
+
+	if ( svTraceCache.verifying && ( results->fraction != svTraceCache.cached.fraction
+		|| results->allsolid != svTraceCache.cached.allsolid
+		|| results->startsolid != svTraceCache.cached.startsolid
+		|| results->entityNum != svTraceCache.cached.entityNum
+		|| results->contents != svTraceCache.cached.contents
+		|| results->surfaceFlags != svTraceCache.cached.surfaceFlags
+		|| !VectorCompare( results->endpos, svTraceCache.cached.endpos )
+		|| !VectorCompare( results->plane.normal, svTraceCache.cached.plane.normal ) ) ) {
+		svTraceCache.traces.wrong++;
+	}
+}
+
+/*
+==================
+SV_TraceCacheGetContents
+
+qtrue if the result was cached
+==================
+*/
+qboolean SV_TraceCacheGetContents( int *contents, const vec3_t p, int passEntityNum ) {
+	traceCacheEntry_t	*entry;
+
+	entry = SV_TraceCacheGet( &svTraceCache.points, p, vec3_origin, vec3_origin, p,
+		passEntityNum, 0, TCQ_POINT );
+	if ( !entry ) {
+		return qfalse;
+	}
+	*contents = entry->trace.contents;
+	return qtrue;
+}
+
+/*
+==================
+SV_TraceCachePutContents
+==================
+*/
+void SV_TraceCachePutContents( int contents, const vec3_t p ) {
+	traceCacheEntry_t	*entry;
+
+	entry = SV_TraceCachePut( &svTraceCache.points );
+	if ( !entry ) {
+		return;
+	}
+	VectorCopy( p, entry->absmin );
+	VectorCopy( p, entry->absmax );
+	entry->trace.contents = contents;
+
+	if ( svTraceCache.verifying && contents != svTraceCache.cached.contents ) {
+		svTraceCache.points.wrong++;
+	}
+}
+
+/*
+==================
+SV_TraceCachePrintStats
+==================
+*/
+static void SV_TraceCachePrintStats( const char *name, const traceCacheStats_t *stats ) {
+	int		misses;
+
+	misses = stats->lookups - stats->hits;
+	Com_Printf( "%-16s %9i %9i %5.1f%% %9.2f %10i %6i\n", name, stats->lookups, stats->hits,
+		stats->lookups ? stats->hits * 100.0f / stats->lookups : 0,
+		misses ? (float)stats->missUsec / misses : 0,
+		misses ? (int)( stats->missUsec * stats->hits / misses / 1000 ) : 0, stats->wrong );
+}
+
+/*
+==================
+SV_TraceCache_f
+
+tracecache [reset]
+==================
+*/
+void SV_TraceCache_f( void ) {
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &svTraceCache.traces, 0, sizeof( svTraceCache.traces ) );
+		Com_Memset( &svTraceCache.points, 0, sizeof( svTraceCache.points ) );
+		svTraceCache.frames = 0;
+		svTraceCache.dropped = 0;
+		Com_Printf( "Trace cache statistics cleared.\n" );
+		return;
+	}
+
+	if ( !sv_traceCache->integer ) {
+		Com_Printf( "sv_traceCache is 0, nothing is being cached.\n" );
+	}
+
+	Com_Printf( "query              lookups      hits   rate usec/miss saved msec  wrong\n" );
+	Com_Printf( "---------------- --------- --------- ------ --------- ---------- ------\n" );
+	SV_TraceCachePrintStats( "SV_Trace", &svTraceCache.traces );
+	SV_TraceCachePrintStats( "SV_PointContents", &svTraceCache.points );
+	Com_Printf( "%i frames, %i results dropped by relinked entities\n",
+		svTraceCache.frames, svTraceCache.dropped );
+}
+
+/*
+==================
+SV_TraceCacheTestQuery
+==================
+*/
+static void SV_TraceCacheTestQuery( trace_t *trace, int *contents, const vec3_t start,
+	vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
+	SV_Trace( trace, start, mins, maxs, end, passEntityNum, contentmask, qfalse );
+	*contents = SV_PointContents( end, passEntityNum );
+}
+
+/*
+==================
+SV_TraceCacheTest_f
+
+tracecachetest [entities] [queries] [rounds]
+
+Adds boxes in the free entity slots like worldbench, then every round
+moves, unlinks or links some of them with SV_LinkEntity and
+SV_UnlinkEntity and does the same traces and point contents with the
+cache and straight on the world, counting the results that differ.
+The slots and sv_traceCache are put back afterwards.
+==================
+*/
+void SV_TraceCacheTest_f( void ) {
+	static vec3_t	playerMins = { -15, -15, -24 };
+	static vec3_t	playerMaxs = { 15, 15, 32 };
+	vec3_t			worldMins, worldMaxs;
+	vec3_t			*starts, *ends;
+	int				*passEntities, *masks, *cachedContents;
+	trace_t			*cached;
+	trace_t			trace;
+	sharedEntity_t	*gEnt;
+	byte			*savedEntities;
+	svEntity_t		*savedSvEntities;
+	char			savedCache[MAX_CVAR_VALUE_STRING];
+	int				numEntities, queries, rounds, first, seed, hits;
+	int				i, j, round, contents, checked, differ;
+	float			*mins, *maxs;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !SV_BenchAllowed() ) {
+		return;
+	}
+
+	numEntities = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 256;
+	queries = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 200;
+	rounds = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 50;
+	first = sv.num_entities;
+	if ( numEntities > ENTITYNUM_MAX_NORMAL - first ) {
+		numEntities = ENTITYNUM_MAX_NORMAL - first;
+	}
+	if ( numEntities <= 0 || queries <= 0 || rounds <= 0 ) {
+		Com_Printf( "Usage: tracecachetest [entities] [queries] [rounds]\n" );
+		return;
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+
+	savedEntities = Z_Malloc( numEntities * sv.gentitySize );
+	savedSvEntities = Z_Malloc( numEntities * sizeof( *savedSvEntities ) );
+	starts = Z_Malloc( queries * sizeof( *starts ) );
+	ends = Z_Malloc( queries * sizeof( *ends ) );
+	passEntities = Z_Malloc( queries * sizeof( *passEntities ) );
+	masks = Z_Malloc( queries * sizeof( *masks ) );
+	cached = Z_Malloc( queries * sizeof( *cached ) );
+	cachedContents = Z_Malloc( queries * sizeof( *cachedContents ) );
+
+	Com_Memcpy( savedEntities, SV_GentityNum( first ), numEntities * sv.gentitySize );
+	Com_Memcpy( savedSvEntities, sv.svEntities + first, numEntities * sizeof( *savedSvEntities ) );
+	Q_strncpyz( savedCache, sv_traceCache->string, sizeof( savedCache ) );
+	Cvar_Set( "sv_traceCache", "1" );
+
+	seed = 1;
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		gEnt = SV_GentityNum( first + i );
+		SV_WorldBenchEntity( gEnt, first + i, &seed, worldMins, worldMaxs );
+		SV_LinkEntity( gEnt );
+	}
+	sv.num_entities = first + numEntities;
+
+	// start next to an entity, so moving it changes the result
+	for ( i = 0 ; i < queries ; i++ ) {
+		gEnt = SV_GentityNum( first + (int)( Q_random( &seed ) * numEntities ) % numEntities );
+		for ( j = 0 ; j < 3 ; j++ ) {
+			starts[i][j] = gEnt->r.currentOrigin[j] + Q_crandom( &seed ) * 64;
+			ends[i][j] = starts[i][j] + Q_crandom( &seed ) * ( ( i & 3 ) ? 256 : 1024 );
+		}
+		passEntities[i] = ( i & 1 ) ? gEnt->s.number : ENTITYNUM_NONE;
+		masks[i] = ( i & 2 ) ? MASK_PLAYERSOLID : ( CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_TRIGGER );
+	}
+
+	hits = svTraceCache.traces.hits + svTraceCache.points.hits;
+	checked = differ = 0;
+	for ( round = 0 ; round < rounds ; round++ ) {
+		for ( i = round & 7 ; i < numEntities ; i += 8 ) {
+			gEnt = SV_GentityNum( first + i );
+			if ( ( i >> 3 ) % 3 == 0 ) {
+				if ( gEnt->r.linked ) {
+					SV_UnlinkEntity( gEnt );
+					continue;
+				}
+			}
+			for ( j = 0 ; j < 3 ; j++ ) {
+				gEnt->r.currentOrigin[j] += Q_crandom( &seed ) * 48;
+			}
+			SV_LinkEntity( gEnt );
+		}
+
+		for ( i = 0 ; i < queries ; i++ ) {
+			mins = ( i & 4 ) ? vec3_origin : playerMins;
+			maxs = ( i & 4 ) ? vec3_origin : playerMaxs;
+			SV_TraceCacheTestQuery( &cached[i], &cachedContents[i], starts[i], mins, maxs, ends[i],
+				passEntities[i], masks[i] );
+		}
+
+		svTraceCache.suspended = qtrue;
+		for ( i = 0 ; i < queries ; i++ ) {
+			mins = ( i & 4 ) ? vec3_origin : playerMins;
+			maxs = ( i & 4 ) ? vec3_origin : playerMaxs;
+			SV_TraceCacheTestQuery( &trace, &contents, starts[i], mins, maxs, ends[i],
+				passEntities[i], masks[i] );
+			checked += 2;
+			if ( trace.fraction != cached[i].fraction
+				|| trace.allsolid != cached[i].allsolid
+				|| trace.startsolid != cached[i].startsolid
+				|| trace.entityNum != cached[i].entityNum
+				|| trace.contents != cached[i].contents
+				|| trace.surfaceFlags != cached[i].surfaceFlags
+				|| !VectorCompare( trace.endpos, cached[i].endpos )
+				|| !VectorCompare( trace.plane.normal, cached[i].plane.normal ) ) {
+				differ++;
+			}
+			if ( contents != cachedContents[i] ) {
+				differ++;
+			}
+		}
+		svTraceCache.suspended = qfalse;
+	}
+	hits = svTraceCache.traces.hits + svTraceCache.points.hits - hits;
+
+	// put the slots back and the world the way it was
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		SV_UnlinkEntity( SV_GentityNum( first + i ) );
+	}
+	Com_Memcpy( SV_GentityNum( first ), savedEntities, numEntities * sv.gentitySize );
+	Com_Memcpy( sv.svEntities + first, savedSvEntities, numEntities * sizeof( *savedSvEntities ) );
+	sv.num_entities = first;
+	Cvar_Set( "sv_traceCache", savedCache );
+	SV_TraceCacheForget();
+
+	Z_Free( savedEntities );
+	Z_Free( savedSvEntities );
+	Z_Free( starts );
+	Z_Free( ends );
+	Z_Free( passEntities );
+	Z_Free( masks );
+	Z_Free( cached );
+	Z_Free( cachedContents );
+
+	Com_Printf( "%i results checked over %i rounds, %i from the cache, %i differ\n",
+		checked, rounds, hits, differ );
+}
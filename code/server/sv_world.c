@@ -75,16 +75,212 @@ worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
 
+/*
+===============================================================================
+
+WORLD GRID
+
+With sv_worldGrid set when the map is loaded, the sectors are replaced by
+loose grids over the x/y extent of the world, one per level, each level with
+cells four times the size of the one below.  The smallest cells grow with
+big maps so a level never needs more than GRID_CELLS a side.
+
+An entity is kept in the cell of its center on the first level where it is
+at most half a cell wide, so it never sticks out of its cell by more than
+half a cell, and a query only has to look at the cells within half a cell
+of its bounds.  Whatever is too big for the top level goes on one list
+that every query checks.  Entities outside the grid are kept in the
+nearest edge cell, which the clamped queries still reach.
+
+===============================================================================
+*/
+
+#define	GRID_LEVELS		3
+#define	GRID_CELLS		64			// a side, at most
+#define	GRID_MIN_SIZE	64			// of the smallest cells, a player fits in one
+
+typedef struct {
+	qboolean	active;
+	float		origin[2];
+	float		size[GRID_LEVELS];
+	int			cells[GRID_LEVELS][2];
+	int			count[GRID_LEVELS];		// entities on each level
+	svEntity_t	*large;					// too big for the top level
+	svEntity_t	*heads[GRID_LEVELS][GRID_CELLS * GRID_CELLS];
+} worldGrid_t;
+
+static worldGrid_t	sv_grid;
+
+
+/*
+===============
+SV_CreateWorldGrid
+===============
+*/
+static void SV_CreateWorldGrid( vec3_t mins, vec3_t maxs ) {
+	float	size;
+	int		level, axis;
+
+	sv_grid.active = qtrue;
+	sv_grid.origin[0] = mins[0];
+	sv_grid.origin[1] = mins[1];
+
+	size = ( maxs[0] - mins[0] > maxs[1] - mins[1] ? maxs[0] - mins[0] : maxs[1] - mins[1] ) / GRID_CELLS;
+	if ( size < GRID_MIN_SIZE ) {
+		size = GRID_MIN_SIZE;
+	}
+
+	for ( level = 0 ; level < GRID_LEVELS ; level++, size *= 4 ) {
+		sv_grid.size[level] = size;
+		for ( axis = 0 ; axis < 2 ; axis++ ) {
+			sv_grid.cells[level][axis] = (int)ceil( ( maxs[axis] - mins[axis] ) / size );
+			if ( sv_grid.cells[level][axis] < 1 ) {
+				sv_grid.cells[level][axis] = 1;
+			} else if ( sv_grid.cells[level][axis] > GRID_CELLS ) {
+				sv_grid.cells[level][axis] = GRID_CELLS;
+			}
+		}
+	}
+}
+
+/*
+===============
+SV_GridCell
+
+Clamped to the grid, queries and links have to round the same way
+===============
+*/
+static int SV_GridCell( int level, int axis, float value ) {
+	float	cell;
+
+	cell = floor( ( value - sv_grid.origin[axis] ) / sv_grid.size[level] );
+	if ( cell < 0 ) {
+		return 0;
+	}
+	if ( cell >= sv_grid.cells[level][axis] ) {
+		return sv_grid.cells[level][axis] - 1;
+	}
+	return (int)cell;
+}
+
+/*
+===============
+SV_GridLevel
+
+The level of the list an entity is in, GRID_LEVELS for the large list
+===============
+*/
+static int SV_GridLevel( svEntity_t **head ) {
+	if ( head == &sv_grid.large ) {
+		return GRID_LEVELS;
+	}
+	return ( head - sv_grid.heads[0] ) / ( GRID_CELLS * GRID_CELLS );
+}
+
+/*
+===============
+SV_GridLink
+===============
+*/
+static void SV_GridLink( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	svEntity_t	**head;
+	float		half;
+	int			level;
+
+	half = gEnt->r.absmax[0] - gEnt->r.absmin[0];
+	if ( gEnt->r.absmax[1] - gEnt->r.absmin[1] > half ) {
+		half = gEnt->r.absmax[1] - gEnt->r.absmin[1];
+	}
+	half *= 0.5f;
+
+	// a unit to spare for the rounding of the center
+	for ( level = 0 ; level < GRID_LEVELS ; level++ ) {
+		if ( half + 1 <= sv_grid.size[level] * 0.5f ) {
+			break;
+		}
+	}
+
+	if ( level == GRID_LEVELS ) {
+		head = &sv_grid.large;
+	} else {
+		head = &sv_grid.heads[level][
+			SV_GridCell( level, 1, 0.5f * ( gEnt->r.absmin[1] + gEnt->r.absmax[1] ) ) * GRID_CELLS
+			+ SV_GridCell( level, 0, 0.5f * ( gEnt->r.absmin[0] + gEnt->r.absmax[0] ) )];
+		sv_grid.count[level]++;
+	}
+
+	ent->worldCell = head;
+	ent->nextEntityInWorldSector = *head;
+	*head = ent;
+}
+
+/*
+===============
+SV_GridUnlink
+===============
+*/
+static void SV_GridUnlink( svEntity_t *ent ) {
+	svEntity_t	**scan;
+	int			level;
+
+	if ( !ent->worldCell ) {
+		return;		// not linked in anywhere
+	}
+
+	for ( scan = ent->worldCell ; *scan ; scan = &(*scan)->nextEntityInWorldSector ) {
+		if ( *scan == ent ) {
+			*scan = ent->nextEntityInWorldSector;
+			level = SV_GridLevel( ent->worldCell );
+			if ( level < GRID_LEVELS ) {
+				sv_grid.count[level]--;
+			}
+			ent->worldCell = NULL;
+			return;
+		}
+	}
+
+	ent->worldCell = NULL;
+	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldCell\n" );
+}
+
+
 /*
 ===============
 SV_SectorList_f
 ===============
 */
 void SV_SectorList_f( void ) {
-	int				i, c;
+	int				i, c, level, cells, longest;
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
+	if ( sv_grid.active ) {
+		for ( level = 0 ; level < GRID_LEVELS ; level++ ) {
+			cells = longest = 0;
+			for ( i = 0 ; i < GRID_CELLS * GRID_CELLS ; i++ ) {
+				c = 0;
+				for ( ent = sv_grid.heads[level][i] ; ent ; ent = ent->nextEntityInWorldSector ) {
+					c++;
+				}
+				if ( c ) {
+					cells++;
+				}
+				if ( c > longest ) {
+					longest = c;
+				}
+			}
+			Com_Printf( "level %i: %ix%i cells of %i units, %i entities in %i cells, at most %i in one\n",
+				level, sv_grid.cells[level][0], sv_grid.cells[level][1], (int)sv_grid.size[level],
+				sv_grid.count[level], cells, longest );
+		}
+		c = 0;
+		for ( ent = sv_grid.large ; ent ; ent = ent->nextEntityInWorldSector ) {
+			c++;
+		}
+		Com_Printf( "large: %i entities\n", c );
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
 		sec = &sv_worldSectors[i];
 
@@ -140,39 +336,53 @@ worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
 
 /*
 ===============
-SV_ClearWorld
+SV_ResetWorld
 
+Empties the sectors or the grid, whichever is used from now on
 ===============
 */
-void SV_ClearWorld( void ) {
+static void SV_ResetWorld( qboolean grid ) {
 	clipHandle_t	h;
 	vec3_t			mins, maxs;
 
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
+	Com_Memset( &sv_grid, 0, sizeof( sv_grid ) );
 
 	// get world map bounds
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+	if ( grid ) {
+		SV_CreateWorldGrid( mins, maxs );
+	} else {
+		SV_CreateworldSector( 0, mins, maxs );
+	}
+}
+
+/*
+===============
+SV_ClearWorld
+
+Called after CM_LoadMap.  The game runs frames from SV_SpawnServer
+before the first SV_TraceCacheFrame, so forget the old map's traces.
+===============
+*/
+void SV_ClearWorld( void ) {
+	SV_ResetWorld( sv_worldGrid->integer != 0 );
+	SV_TraceCacheForget();
 }
 
 
 /*
 ===============
-SV_UnlinkEntity
+SV_SectorUnlink
 
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
+static void SV_SectorUnlink( svEntity_t *ent ) {
 	svEntity_t		*scan;
 	worldSector_t	*ws;
 
-	ent = SV_SvEntityForGentity( gEnt );
-
-	gEnt->r.linked = qfalse;
-
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -195,6 +405,61 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 }
 
 
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	if ( ent->worldSector || ent->worldCell ) {
+		SV_TraceCacheTouch( gEnt->r.absmin, gEnt->r.absmax );
+	}
+
+	if ( sv_grid.active ) {
+		SV_GridUnlink( ent );
+	} else {
+		SV_SectorUnlink( ent );
+	}
+}
+
+
+/*
+===============
+SV_SectorLink
+
+Into the first world sector node that the entity's box crosses
+===============
+*/
+static void SV_SectorLink( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
+
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( gEnt->r.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( gEnt->r.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+}
+
+
 /*
 ===============
 SV_LinkEntity
@@ -203,7 +468,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,7 +479,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
+	if ( ent->worldSector || ent->worldCell ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
 
@@ -295,6 +559,11 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		return;
 	}
 
+	// for SV_EntitiesInPVS
+	i = CM_PointLeafnum( origin );
+	ent->originCluster = CM_LeafCluster( i );
+	ent->originArea = CM_LeafArea( i );
+
 	// set areas, even from clusters that don't fit in the entity array
 	for (i=0 ; i<num_leafs ; i++) {
 		area = CM_LeafArea (leafs[i]);
@@ -333,24 +602,12 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+	if ( sv_grid.active ) {
+		SV_GridLink( ent, gEnt );
+	} else {
+		SV_SectorLink( ent, gEnt );
 	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	SV_TraceCacheTouch( gEnt->r.absmin, gEnt->r.absmax );
 
 	gEnt->r.linked = qtrue;
 }
@@ -422,6 +679,113 @@ void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_GridTouches
+====================
+*/
+static qboolean SV_GridTouches( const svEntity_t *check, const areaParms_t *ap ) {
+	const sharedEntity_t	*gcheck;
+
+	gcheck = SV_GEntityForSvEntity( (svEntity_t *)check );
+
+	return gcheck->r.absmin[0] <= ap->maxs[0]
+		&& gcheck->r.absmin[1] <= ap->maxs[1]
+		&& gcheck->r.absmin[2] <= ap->maxs[2]
+		&& gcheck->r.absmax[0] >= ap->mins[0]
+		&& gcheck->r.absmax[1] >= ap->mins[1]
+		&& gcheck->r.absmax[2] >= ap->mins[2];
+}
+
+/*
+====================
+SV_GridMark
+====================
+*/
+static void SV_GridMark( const svEntity_t *check, const areaParms_t *ap, unsigned *found ) {
+	int		num;
+
+	for ( ; check ; check = check->nextEntityInWorldSector ) {
+		if ( SV_GridTouches( check, ap ) ) {
+			num = check - sv.svEntities;
+			found[num >> 5] |= 1u << ( num & 31 );
+		}
+	}
+}
+
+/*
+====================
+SV_GridAdd
+====================
+*/
+static qboolean SV_GridAdd( areaParms_t *ap, int num ) {
+	if ( ap->count == ap->maxcount ) {
+		Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		return qfalse;
+	}
+
+	ap->list[ap->count] = num;
+	ap->count++;
+	return qtrue;
+}
+
+/*
+====================
+SV_GridAreaEntities
+
+The cells only mark what they hold, the list is made afterwards in
+entity order
+====================
+*/
+static void SV_GridAreaEntities( areaParms_t *ap ) {
+	unsigned	found[MAX_GENTITIES / 32], bits;
+	int			lo[GRID_LEVELS][2], hi[GRID_LEVELS][2];
+	int			level, axis, cells, x, y, i, j;
+	svEntity_t	*check;
+
+	cells = 0;
+	for ( level = 0 ; level < GRID_LEVELS ; level++ ) {
+		for ( axis = 0 ; axis < 2 ; axis++ ) {
+			lo[level][axis] = SV_GridCell( level, axis, ap->mins[axis] - sv_grid.size[level] * 0.5f );
+			hi[level][axis] = SV_GridCell( level, axis, ap->maxs[axis] + sv_grid.size[level] * 0.5f );
+		}
+		if ( sv_grid.count[level] ) {
+			cells += ( hi[level][0] - lo[level][0] + 1 ) * ( hi[level][1] - lo[level][1] + 1 );
+		}
+	}
+
+	// over most of the map it is cheaper to look at every entity
+	if ( cells > sv.num_entities ) {
+		for ( i = 0, check = sv.svEntities ; i < sv.num_entities ; i++, check++ ) {
+			if ( check->worldCell && SV_GridTouches( check, ap ) && !SV_GridAdd( ap, i ) ) {
+				return;
+			}
+		}
+		return;
+	}
+
+	Com_Memset( found, 0, sizeof( found ) );
+	SV_GridMark( sv_grid.large, ap, found );
+	for ( level = 0 ; level < GRID_LEVELS ; level++ ) {
+		if ( !sv_grid.count[level] ) {
+			continue;
+		}
+		for ( y = lo[level][1] ; y <= hi[level][1] ; y++ ) {
+			for ( x = lo[level][0] ; x <= hi[level][0] ; x++ ) {
+				SV_GridMark( sv_grid.heads[level][y * GRID_CELLS + x], ap, found );
+			}
+		}
+	}
+
+	for ( i = 0 ; i < MAX_GENTITIES / 32 ; i++ ) {
+		for ( j = 0, bits = found[i] ; bits ; j++, bits >>= 1 ) {
+			if ( ( bits & 1 ) && !SV_GridAdd( ap, i * 32 + j ) ) {
+				return;
+			}
+		}
+	}
+}
+
 /*
 ================
 SV_AreaEntities
@@ -436,7 +800,11 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_grid.active ) {
+		SV_GridAreaEntities( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
@@ -608,6 +976,10 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 		maxs = vec3_origin;
 	}
 
+	if ( SV_TraceCacheGetTrace( results, start, mins, maxs, end, passEntityNum, contentmask, capsule ) ) {
+		return;
+	}
+
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 	// clip to world
@@ -615,6 +987,7 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
 	if ( clip.trace.fraction == 0 ) {
 		*results = clip.trace;
+		SV_TraceCachePutTrace( results, NULL, NULL );
 		return;		// blocked immediately by the world
 	}
 
@@ -645,6 +1018,7 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	SV_ClipMoveToEntities ( &clip );
 
 	*results = clip.trace;
+	SV_TraceCachePutTrace( results, clip.boxmins, clip.boxmaxs );
 }
 
 
@@ -662,6 +1036,10 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	clipHandle_t	clipHandle;
 	float		*angles;
 
+	if ( SV_TraceCacheGetContents( &contents, p, passEntityNum ) ) {
+		return contents;
+	}
+
 	// get base contents from world
 	contents = CM_PointContents( p, 0 );
 
@@ -685,7 +1063,260 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 		contents |= c2;
 	}
 
+	SV_TraceCachePutContents( contents, p );
 	return contents;
 }
 
 
+
+/*
+===============================================================================
+
+WORLD BENCHMARK
+
+===============================================================================
+*/
+
+/*
+==================
+SV_RelinkWorld
+
+Moves every linked entity into the sectors or the grid.  This skips
+SV_LinkEntity, so the trace cache is cleared here, which also keeps one
+worldbench pass from reusing the traces of the other.
+==================
+*/
+static void SV_RelinkWorld( qboolean grid ) {
+	sharedEntity_t	*gEnt;
+	svEntity_t		*ent;
+	int				i;
+
+	SV_ResetWorld( grid );
+	for ( i = 0, ent = sv.svEntities ; i < sv.num_entities ; i++, ent++ ) {
+		ent->worldSector = NULL;
+		ent->worldCell = NULL;
+		gEnt = SV_GentityNum( i );
+		if ( !gEnt->r.linked ) {
+			continue;
+		}
+		if ( grid ) {
+			SV_GridLink( ent, gEnt );
+		} else {
+			SV_SectorLink( ent, gEnt );
+		}
+	}
+
+	SV_TraceCacheForget();
+}
+
+/*
+==================
+SV_WorldBenchEntity
+
+Mostly players, some items and a few big solids to fill the upper levels,
+also used by tracecachetest
+==================
+*/
+void SV_WorldBenchEntity( sharedEntity_t *gEnt, int num, int *seed, const vec3_t mins, const vec3_t maxs ) {
+	float	size, height;
+	int		i;
+
+	Com_Memset( gEnt, 0, sv.gentitySize );
+	gEnt->s.number = num;
+	gEnt->r.ownerNum = ENTITYNUM_NONE;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		gEnt->r.currentOrigin[i] = mins[i] + Q_random( seed ) * ( maxs[i] - mins[i] );
+	}
+
+	switch ( num & 7 ) {
+	case 0:
+		gEnt->r.contents = CONTENTS_TRIGGER;
+		VectorSet( gEnt->r.mins, -15, -15, -15 );
+		VectorSet( gEnt->r.maxs, 15, 15, 15 );
+		break;
+	case 1:
+		gEnt->r.contents = CONTENTS_SOLID;
+		size = 32 + Q_random( seed ) * 600;
+		height = 16 + Q_random( seed ) * 128;
+		VectorSet( gEnt->r.mins, -size, -size, -height );
+		VectorSet( gEnt->r.maxs, size, size, height );
+		break;
+	default:
+		gEnt->r.contents = CONTENTS_BODY;
+		VectorSet( gEnt->r.mins, -15, -15, -24 );
+		VectorSet( gEnt->r.maxs, 15, 15, 32 );
+		break;
+	}
+
+	VectorAdd( gEnt->r.currentOrigin, gEnt->r.mins, gEnt->r.absmin );
+	VectorAdd( gEnt->r.currentOrigin, gEnt->r.maxs, gEnt->r.absmax );
+	for ( i = 0 ; i < 3 ; i++ ) {
+		gEnt->r.absmin[i] -= 1;
+		gEnt->r.absmax[i] += 1;
+	}
+	gEnt->r.linked = qtrue;
+}
+
+/*
+==================
+SV_WorldBenchCompare
+==================
+*/
+static int QDECL SV_WorldBenchCompare( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+==================
+SV_WorldBench_f
+
+worldbench [entities] [queries]
+
+Adds boxes in the free entity slots and times SV_AreaEntities and
+SV_Trace on the sectors and on the grid, then counts the results that
+differ.  The slots are put back as they were afterwards.  The server
+stalls meanwhile, so with clients on it needs sv_cheats.
+==================
+*/
+void SV_WorldBench_f( void ) {
+	static const char	*names[2] = { "sectors", "grid" };
+	static vec3_t	playerMins = { -15, -15, -24 };
+	static vec3_t	playerMaxs = { 15, 15, 32 };
+	vec3_t		worldMins, worldMaxs, delta;
+	vec3_t		*boxes, *starts, *ends;
+	trace_t		*traces[2];
+	unsigned	*sums[2];
+	int			list[MAX_GENTITIES];
+	byte		*savedEntities;
+	svEntity_t	*savedSvEntities;
+	qboolean	wasGrid;
+	int			numEntities, first, queries, seed, found;
+	int			i, j, pass, count, areaMismatches, traceMismatches, otherEntity;
+	int64_t		start, areaUsec[2], traceUsec[2];
+	float		size;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !SV_BenchAllowed() ) {
+		return;
+	}
+
+	numEntities = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 512;
+	queries = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 20000;
+	first = sv.num_entities;
+	if ( numEntities > ENTITYNUM_MAX_NORMAL - first ) {
+		numEntities = ENTITYNUM_MAX_NORMAL - first;
+	}
+	if ( numEntities < 0 || queries <= 0 ) {
+		Com_Printf( "Usage: worldbench [entities] [queries]\n" );
+		return;
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+
+	savedEntities = Z_Malloc( numEntities * sv.gentitySize );
+	savedSvEntities = Z_Malloc( numEntities * sizeof( *savedSvEntities ) );
+	boxes = Z_Malloc( queries * 2 * sizeof( *boxes ) );
+	starts = Z_Malloc( queries * sizeof( *starts ) );
+	ends = Z_Malloc( queries * sizeof( *ends ) );
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		traces[pass] = Z_Malloc( queries * sizeof( *traces[pass] ) );
+		sums[pass] = Z_Malloc( queries * sizeof( *sums[pass] ) );
+	}
+
+	Com_Memcpy( savedEntities, SV_GentityNum( first ), numEntities * sv.gentitySize );
+	Com_Memcpy( savedSvEntities, sv.svEntities + first, numEntities * sizeof( *savedSvEntities ) );
+	wasGrid = sv_grid.active;
+
+	seed = 1;
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		SV_WorldBenchEntity( SV_GentityNum( first + i ), first + i, &seed, worldMins, worldMaxs );
+	}
+	sv.num_entities = first + numEntities;
+
+	// boxes the size of a room, short moves and one long shot in eight
+	for ( i = 0 ; i < queries ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			size = 8 + Q_random( &seed ) * ( j == 2 ? 128 : 256 );
+			boxes[i * 2][j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] ) - size;
+			boxes[i * 2 + 1][j] = boxes[i * 2][j] + size * 2;
+			starts[i][j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			delta[j] = Q_crandom( &seed ) * ( ( i & 7 ) ? 512 : 4096 );
+		}
+		VectorAdd( starts[i], delta, ends[i] );
+	}
+
+	found = 0;
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		SV_RelinkWorld( pass );
+
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < queries ; i++ ) {
+			found += SV_AreaEntities( boxes[i * 2], boxes[i * 2 + 1], list, MAX_GENTITIES );
+		}
+		areaUsec[pass] = Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < queries ; i++ ) {
+			SV_Trace( &traces[pass][i], starts[i], playerMins, playerMaxs, ends[i],
+				ENTITYNUM_NONE, CONTENTS_SOLID | CONTENTS_BODY, qfalse );
+		}
+		traceUsec[pass] = Sys_Microseconds() - start;
+
+		// the sectors don't list in entity order
+		for ( i = 0 ; i < queries ; i++ ) {
+			count = SV_AreaEntities( boxes[i * 2], boxes[i * 2 + 1], list, MAX_GENTITIES );
+			qsort( list, count, sizeof( list[0] ), SV_WorldBenchCompare );
+			sums[pass][i] = count;
+			for ( j = 0 ; j < count ; j++ ) {
+				sums[pass][i] = sums[pass][i] * 31 + list[j];
+			}
+		}
+	}
+
+	// the entity a trace reports, and startsolid after an allsolid, depend
+	// on the order the entities are listed in when several stop it at once
+	areaMismatches = traceMismatches = otherEntity = 0;
+	for ( i = 0 ; i < queries ; i++ ) {
+		if ( sums[0][i] != sums[1][i] ) {
+			areaMismatches++;
+		}
+		if ( traces[0][i].fraction != traces[1][i].fraction
+			|| traces[0][i].allsolid != traces[1][i].allsolid
+			|| !VectorCompare( traces[0][i].endpos, traces[1][i].endpos ) ) {
+			traceMismatches++;
+		} else if ( traces[0][i].entityNum != traces[1][i].entityNum
+			|| traces[0][i].startsolid != traces[1][i].startsolid ) {
+			otherEntity++;
+		}
+	}
+
+	// put the slots back and the world the way it was
+	Com_Memcpy( SV_GentityNum( first ), savedEntities, numEntities * sv.gentitySize );
+	Com_Memcpy( sv.svEntities + first, savedSvEntities, numEntities * sizeof( *savedSvEntities ) );
+	sv.num_entities = first;
+	SV_RelinkWorld( wasGrid );
+
+	Z_Free( savedEntities );
+	Z_Free( savedSvEntities );
+	Z_Free( boxes );
+	Z_Free( starts );
+	Z_Free( ends );
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		Z_Free( traces[pass] );
+		Z_Free( sums[pass] );
+	}
+
+	Com_Printf( "%i entities, %i queries, %.1f entities per area query\n",
+		sv.num_entities + numEntities, queries, (float)found / ( queries * 2 ) );
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		Com_Printf( "%-8s %9i area queries/s %9i traces/s\n", names[pass],
+			(int)( queries * (int64_t)1000000 / ( areaUsec[pass] + 1 ) ),
+			(int)( queries * (int64_t)1000000 / ( traceUsec[pass] + 1 ) ) );
+	}
+	Com_Printf( "%i area and %i trace mismatches, %i traces stopped by another entity at the same point\n",
+		areaMismatches, traceMismatches, otherEntity );
+}
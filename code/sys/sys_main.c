@@ -41,6 +41,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #endif
 #endif
 
+#if defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+#	include <cpuid.h>
+#elif defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#	include <intrin.h>
+#endif
+
 #include "sys_local.h"
 #include "sys_loadlib.h"
 
@@ -183,6 +189,27 @@ cpuFeatures_t Sys_GetProcessorFeatures( void )
 	if( SDL_HasAltiVec( ) )  features |= CF_ALTIVEC;
 #endif
 
+	// not reported by SDL, and needed by dedicated servers too
+#if defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+	{
+		unsigned int eax, ebx, ecx, edx;
+
+		if( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+		{
+			if( ecx & ( 1 << 1 ) )   features |= CF_PCLMUL;
+			if( ecx & ( 1 << 19 ) )  features |= CF_SSE41;
+		}
+	}
+#elif defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+	{
+		int regs[4];
+
+		__cpuid( regs, 1 );
+		if( regs[2] & ( 1 << 1 ) )   features |= CF_PCLMUL;
+		if( regs[2] & ( 1 << 19 ) )  features |= CF_SSE41;
+	}
+#endif
+
 	return features;
 }
 
@@ -581,6 +608,9 @@ int main( int argc, char **argv )
 	}
 
 	Com_Init( commandLine );
+#ifdef DEDICATED
+	Sys_SpawnInstances( );
+#endif
 	NET_Init( );
 
 	CON_Init( );
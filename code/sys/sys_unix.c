@@ -34,6 +34,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <sys/time.h>
 #include <pwd.h>
 #include <libgen.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 // Used to determine where to store user-specific files
 static char homePath[ MAX_OSPATH ] = { 0 };
@@ -104,6 +111,22 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+Monotonic, only meaningful as a difference between two calls
+================
+*/
+int64_t Sys_Microseconds( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 #if !id386
 /*
 ==================
@@ -479,6 +502,232 @@ void Sys_Sleep( int msec )
 	}
 }
 
+typedef struct {
+	pthread_t	thread;
+	void		(*function)( void *arg );
+	void		*arg;
+} sysThread_t;
+
+/*
+==================
+Sys_ThreadStart
+==================
+*/
+static void *Sys_ThreadStart( void *data )
+{
+	sysThread_t *t = data;
+
+	t->function( t->arg );
+	return NULL;
+}
+
+/*
+==================
+Sys_CreateThread
+
+Returns NULL if the thread couldn't be started
+==================
+*/
+void *Sys_CreateThread( void (*function)( void *arg ), void *arg )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->arg = arg;
+	if( pthread_create( &t->thread, NULL, Sys_ThreadStart, t ) != 0 )
+	{
+		free( t );
+		return NULL;
+	}
+	return t;
+}
+
+/*
+==================
+Sys_JoinThread
+==================
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	pthread_join( t->thread, NULL );
+	free( t );
+}
+
+/*
+==================
+Sys_ThreadSleep
+
+Unlike Sys_Sleep, doesn't wake up for console input
+==================
+*/
+void Sys_ThreadSleep( int msec )
+{
+	usleep( msec * 1000 );
+}
+
+/*
+==================
+Sys_FileInfo
+
+Size and modification time of a file, qfalse if there is none
+==================
+*/
+qboolean Sys_FileInfo( const char *path, int64_t *size, int64_t *mtime )
+{
+	struct stat	st;
+
+	if( stat( path, &st ) == -1 || !S_ISREG( st.st_mode ) )
+		return qfalse;
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+
+Read only view of a whole file, NULL if it can't be mapped
+==================
+*/
+const void *Sys_MapFile( const char *path, int *length )
+{
+	struct stat	st;
+	void		*data;
+	int			fd;
+
+	fd = open( path, O_RDONLY );
+	if( fd == -1 )
+		return NULL;
+
+	if( fstat( fd, &st ) == -1 || st.st_size <= 0 || st.st_size > 0x7fffffff )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	data = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( data == MAP_FAILED )
+		return NULL;
+
+	*length = st.st_size;
+	return data;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( const void *data, int length )
+{
+	munmap( (void *)data, length );
+}
+
+#define MAX_INSTANCES 32
+
+static pid_t instancePids[ MAX_INSTANCES ];
+static int numInstancePids = 0;
+
+/*
+==================
+Sys_ReapInstances
+
+Only collects our own instances so other waitpid() users
+(the USE_GAS compiler fork) still get their children
+==================
+*/
+static void Sys_ReapInstances( int signal )
+{
+	int i;
+
+	for( i = 0; i < numInstancePids; i++ )
+	{
+		if( instancePids[ i ] > 0 && waitpid( instancePids[ i ], NULL, WNOHANG ) > 0 )
+			instancePids[ i ] = 0;
+	}
+}
+
+/*
+==================
+Sys_SpawnInstances
+
+Forks com_instances - 1 additional dedicated servers once Com_Init is done.
+Everything loaded so far, the pk3 directory index in particular, stays
+shared copy-on-write between the instances.  Instance n listens on
+exactly net_port + n and execs instance<n>.cfg before NET_Init.
+==================
+*/
+void Sys_SpawnInstances( void )
+{
+	int   instances;
+	int   basePort;
+	int   i;
+	int   fd;
+	pid_t pid;
+
+	instances = com_instances->integer;
+	if( instances <= 1 )
+		return;
+
+	if( instances > MAX_INSTANCES )
+	{
+		Com_Printf( "WARNING: com_instances clamped to %i\n", MAX_INSTANCES );
+		instances = MAX_INSTANCES;
+	}
+
+	basePort = Cvar_Get( "net_port", va( "%i", PORT_SERVER ), CVAR_LATCH )->integer;
+
+	signal( SIGCHLD, Sys_ReapInstances );
+
+	for( i = 1; i < instances; i++ )
+	{
+		// don't let the children inherit unwritten log data
+		AsyncLog_Drain( );
+		fflush( NULL );
+
+		pid = fork( );
+		if( pid < 0 )
+		{
+			Com_Printf( "WARNING: couldn't fork server instance %i: %s\n",
+				i, strerror( errno ) );
+			break;
+		}
+
+		if( pid == 0 )
+		{
+			signal( SIGCHLD, SIG_DFL );
+#ifdef __linux__
+			// go down with the first instance
+			prctl( PR_SET_PDEATHSIG, SIGTERM );
+#endif
+			// only the first instance reads the terminal
+			fd = open( "/dev/null", O_RDONLY );
+			if( fd >= 0 )
+			{
+				dup2( fd, STDIN_FILENO );
+				close( fd );
+			}
+
+			AsyncLog_AfterFork( );
+			Com_SetInstance( i, basePort + i );
+			return;
+		}
+
+		instancePids[ numInstancePids++ ] = pid;
+		Com_Printf( "Server instance %i forked (pid %i, port %i)\n",
+			i, (int)pid, basePort + i );
+	}
+}
+
 /*
 ==============
 Sys_ErrorDialog
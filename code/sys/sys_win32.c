@@ -70,6 +70,24 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds( void )
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER count;
+
+	if( !frequency.QuadPart )
+		QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &count );
+
+	return count.QuadPart / frequency.QuadPart * 1000000 +
+		count.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
 #ifndef __GNUC__ //see snapvectora.s
 /*
 ================
@@ -485,6 +503,158 @@ void Sys_Sleep( int msec )
 		WaitForSingleObject( GetStdHandle( STD_INPUT_HANDLE ), msec );
 }
 
+/*
+==============
+Sys_FileInfo
+
+Size and modification time of a file, qfalse if there is none
+==============
+*/
+qboolean Sys_FileInfo( const char *path, int64_t *size, int64_t *mtime )
+{
+	WIN32_FILE_ATTRIBUTE_DATA	data;
+
+	if( !GetFileAttributesEx( path, GetFileExInfoStandard, &data ) ||
+		( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) )
+		return qfalse;
+
+	*size = ( (int64_t)data.nFileSizeHigh << 32 ) | data.nFileSizeLow;
+	// 100 nanosecond ticks, only ever compared
+	*mtime = ( (int64_t)data.ftLastWriteTime.dwHighDateTime << 32 ) | data.ftLastWriteTime.dwLowDateTime;
+	return qtrue;
+}
+
+/*
+==============
+Sys_MapFile
+
+Read only view of a whole file, NULL if it can't be mapped
+==============
+*/
+const void *Sys_MapFile( const char *path, int *length )
+{
+	HANDLE	file, mapping;
+	DWORD	size, high;
+	void	*data;
+
+	file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	size = GetFileSize( file, &high );
+	if( size == INVALID_FILE_SIZE || high || !size || size > 0x7fffffff )
+	{
+		CloseHandle( file );
+		return NULL;
+	}
+
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping )
+		return NULL;
+
+	// the view keeps the mapping alive
+	data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if( !data )
+		return NULL;
+
+	*length = size;
+	return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( const void *data, int length )
+{
+	UnmapViewOfFile( data );
+}
+
+typedef struct {
+	HANDLE	handle;
+	void	(*function)( void *arg );
+	void	*arg;
+} sysThread_t;
+
+/*
+==============
+Sys_ThreadStart
+==============
+*/
+static DWORD WINAPI Sys_ThreadStart( LPVOID data )
+{
+	sysThread_t *t = data;
+
+	t->function( t->arg );
+	return 0;
+}
+
+/*
+==============
+Sys_CreateThread
+
+Returns NULL if the thread couldn't be started
+==============
+*/
+void *Sys_CreateThread( void (*function)( void *arg ), void *arg )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->arg = arg;
+	t->handle = CreateThread( NULL, 0, Sys_ThreadStart, t, 0, NULL );
+	if( !t->handle )
+	{
+		free( t );
+		return NULL;
+	}
+	return t;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	WaitForSingleObject( t->handle, INFINITE );
+	CloseHandle( t->handle );
+	free( t );
+}
+
+/*
+==============
+Sys_ThreadSleep
+
+Unlike Sys_Sleep, doesn't wake up for console input
+==============
+*/
+void Sys_ThreadSleep( int msec )
+{
+	Sleep( msec );
+}
+
+/*
+==================
+Sys_SpawnInstances
+==================
+*/
+void Sys_SpawnInstances( void )
+{
+	if( com_instances->integer > 1 )
+		Com_Printf( "WARNING: com_instances is not supported on Windows\n" );
+}
+
 /*
 ==============
 Sys_ErrorDialog